@@ -0,0 +1,42 @@
+/*
+ *
+ * Andrew Frost
+ * benchmarks.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace bench {
+
+///////////////////////////////////////////////////////////////////////////
+// Benchmarks                                                            //
+///////////////////////////////////////////////////////////////////////////
+// CPU only checks and timings of the loaders and allocators, run by     //
+// 'benchmarks.exe <name>'. Each returns false when a check failed.      //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// Parallel chunked parser against tinyobj::ObjReader, the arrays of both
+// must be bit identical
+//
+bool objParse(const std::string& filename, uint32_t runs);
+
+//-------------------------------------------------------------------------
+// Small uploads through the staging manager with frames in flight, its
+// blocks in host memory, against a first fit scan of the blocks. The
+// uploads alive at once must not overlap.
+//
+bool stagingStress(uint32_t uploads, uint32_t runs);
+
+//-------------------------------------------------------------------------
+// Fragmentation heavy allocations and frees of the range allocator, the
+// sorted array against TLSF. The ranges are checked against a page map.
+//
+bool rangeAllocator(uint32_t operations, uint32_t runs);
+
+} // namespace bench
@@ -0,0 +1,54 @@
+/*
+ *
+ * Andrew Frost
+ * main.cpp
+ * 2020
+ *
+ */
+
+#include <iostream>
+#include <stdlib.h>
+
+#include "benchmarks.hpp"
+
+//-------------------------------------------------------------------------
+//
+//
+static void usage()
+{
+    std::cerr << "usage: benchmarks obj [file.obj] [runs]" << std::endl;
+    std::cerr << "       benchmarks staging [uploads] [runs]" << std::endl;
+    std::cerr << "       benchmarks range [operations] [runs]" << std::endl;
+}
+
+//-------------------------------------------------------------------------
+//  Main / Entry Point
+//
+int main(int argc, char* argv[])
+{
+    const std::string name = argc > 1 ? argv[1] : "";
+
+    bool passed;
+    if (name == "obj") {
+        const std::string filename = argc > 2 ? argv[2] : "../../media/scenes/Medieval_building.obj";
+        const uint32_t    runs     = argc > 3 ? static_cast<uint32_t>(atoi(argv[3])) : 5;
+        passed = bench::objParse(filename, runs);
+    }
+    else if (name == "staging") {
+        const uint32_t uploads = argc > 2 ? static_cast<uint32_t>(atoi(argv[2])) : 50000;
+        const uint32_t runs    = argc > 3 ? static_cast<uint32_t>(atoi(argv[3])) : 5;
+        passed = bench::stagingStress(uploads, runs);
+    }
+    else if (name == "range") {
+        const uint32_t operations = argc > 2 ? static_cast<uint32_t>(atoi(argv[2])) : 400000;
+        const uint32_t runs       = argc > 3 ? static_cast<uint32_t>(atoi(argv[3])) : 3;
+        passed = bench::rangeAllocator(operations, runs);
+    }
+    else {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    std::cout << (passed ? "passed" : "FAILED") << std::endl;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,75 @@
+/*
+ *
+ * Andrew Frost
+ * objparse.cpp
+ * 2020
+ *
+ */
+
+#include "benchmarks.hpp"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#include "../external/obj_loader.h"
+
+namespace bench {
+
+template <class T>
+static bool sameBytes(const std::vector<T>& a, const std::vector<T>& b)
+{
+    return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+//-------------------------------------------------------------------------
+// Arrays handed to the upload, the materials with their padding
+//
+static bool sameModel(const ObjLoader& a, const ObjLoader& b)
+{
+    return sameBytes(a.m_vertices, b.m_vertices) && sameBytes(a.m_indices, b.m_indices)
+           && sameBytes(a.m_matIndx, b.m_matIndx) && sameBytes(a.m_materials, b.m_materials)
+           && sameBytes(a.m_lods, b.m_lods) && a.m_textures == b.m_textures;
+}
+
+//-------------------------------------------------------------------------
+// Best time of the runs, without the cache. The mesh optimization and the
+// LODs are the same for both parsers, they are left out of the timings.
+//
+bool objParse(const std::string& filename, uint32_t runs)
+{
+    double    best[2] = { 1e30, 1e30 };
+    ObjLoader first[2];
+
+    for (uint32_t run = 0; run < std::max(runs, 1u); ++run) {
+        for (int parallel = 0; parallel < 2; ++parallel) {
+            ObjLoader loader;
+            loader.m_useCache      = false;
+            loader.m_parallelParse = parallel != 0;
+            loader.m_optimizeMesh  = run == 0;
+            loader.m_generateLods  = run == 0;
+
+            const auto start = std::chrono::steady_clock::now();
+            loader.loadModel(filename);
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            // the first run compares the whole import, optimization and LODs included
+            if (run == 0)
+                first[parallel] = std::move(loader);
+            else
+                best[parallel] = std::min(best[parallel], ms);
+        }
+    }
+
+    const bool same = sameModel(first[0], first[1]);
+
+    printf("%s: %zu vertices, %zu indices, %zu materials\n", filename.c_str(), first[0].m_vertices.size(),
+           first[0].m_indices.size(), first[0].m_materials.size());
+    if (runs > 1)
+        printf("  tinyobj  %8.2f ms\n  parallel %8.2f ms (x%.2f)\n", best[0], best[1], best[0] / best[1]);
+    printf("  arrays %s\n", same ? "bit identical" : "DIFFER");
+
+    return same && !first[0].m_indices.empty();
+}
+
+} // namespace bench
@@ -0,0 +1,198 @@
+/*
+ *
+ * Andrew Frost
+ * rangeallocator.cpp
+ * 2020
+ *
+ */
+
+#include "benchmarks.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../general_helpers/trangeallocator.hpp"
+
+namespace bench {
+
+static const uint64_t PAGE_SIZE   = 256;  // Granularity of both backends
+static const uint32_t CHECK_SEEDS = 5;
+static const uint32_t CHECK_EVERY = 997;  // Operations between two checks of the largest free range
+
+using SortedArrayRanges = tools::TRangeAllocator<256, tools::RangeBackend::eSortedArray>;
+using TlsfRanges        = tools::TRangeAllocator<256, tools::RangeBackend::eTLSF>;
+
+//-------------------------------------------------------------------------
+// Fragmentation heavy sequence: slightly more allocations than frees, of
+// 1 B up to 'maxPages' pages, freed in random order. When 'check' is set
+// the pages of the live ranges are marked in a page map: a range must not
+// overlap another one, and the largest free range must be the longest run
+// of free pages. All the ranges must merge back once freed.
+//
+template <class Ranges>
+static bool runRanges(uint64_t total, uint32_t operations, uint32_t maxPages, bool check, uint32_t seed, double& ms,
+                      uint32_t& failed)
+{
+    using size_type = typename Ranges::size_type;
+
+    struct Allocation
+    {
+        size_type offset;
+        size_type size;
+    };
+
+    Ranges ranges;
+    ranges.init(static_cast<size_type>(total));
+
+    std::mt19937            rng(seed);
+    std::vector<Allocation> live;
+    std::vector<bool>       pages(check ? static_cast<size_t>(total / PAGE_SIZE) : 0, false);
+    bool                    valid = true;
+
+    failed = 0;
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < operations && valid; ++i) {
+        if (live.empty() || rng() % 100 < 55) {
+            const uint64_t size  = 1 + rng() % (maxPages * PAGE_SIZE);
+            const uint64_t align = rng() % 8 == 0 ? 1024 : 16;
+
+            size_type offset, aligned, used;
+            if (!ranges.subAllocate(static_cast<size_type>(size), static_cast<size_type>(align), offset, aligned, used)) {
+                failed++;
+                continue;
+            }
+
+            if (check) {
+                valid = aligned % align == 0 && aligned >= offset && aligned + size <= uint64_t(offset) + used
+                     && uint64_t(offset) + used <= total;
+                for (uint64_t page = offset / PAGE_SIZE; page < (uint64_t(offset) + used) / PAGE_SIZE && valid; ++page) {
+                    valid       = !pages[page];
+                    pages[page] = true;
+                }
+            }
+            live.push_back({ offset, used });
+        }
+        else {
+            const size_t     index      = rng() % live.size();
+            const Allocation allocation = live[index];
+            live[index] = live.back();
+            live.pop_back();
+
+            if (check)
+                std::fill(pages.begin() + allocation.offset / PAGE_SIZE,
+                          pages.begin() + (uint64_t(allocation.offset) + allocation.size) / PAGE_SIZE, false);
+            ranges.subFree(allocation.offset, allocation.size);
+        }
+
+        if (check && i % CHECK_EVERY == 0) {
+            uint64_t run = 0, largest = 0;
+            for (bool used : pages) {
+                run     = used ? 0 : run + 1;
+                largest = std::max(largest, run);
+            }
+            valid = valid && uint64_t(ranges.largestFreeRange()) == largest * PAGE_SIZE;
+        }
+    }
+
+    for (const auto& allocation : live)
+        ranges.subFree(allocation.offset, allocation.size);
+
+    ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    return valid && ranges.isEmpty() && ranges.isAvailable(static_cast<size_type>(total), static_cast<size_type>(PAGE_SIZE));
+}
+
+//-------------------------------------------------------------------------
+// Page map check over a few seeds
+//
+template <class Ranges>
+static bool checkRanges(const char* name, uint32_t operations)
+{
+    bool passed = true;
+    for (uint32_t seed = 1; seed <= CHECK_SEEDS; ++seed) {
+        double   ms;
+        uint32_t failed;
+        passed = runRanges<Ranges>(64ull << 20, operations, 64, true, seed, ms, failed) && passed;
+    }
+
+    std::cout << "  " << name << ": " << (passed ? "ok" : "overlapping or lost ranges") << std::endl;
+    return passed;
+}
+
+//-------------------------------------------------------------------------
+// Best of the timed runs
+//
+template <class Ranges>
+static bool measureRanges(const char* name, uint64_t total, uint32_t operations, uint32_t maxPages, uint32_t seed,
+                          uint32_t runs, double& bestMs)
+{
+    bool     passed = true;
+    uint32_t failed = 0;
+    bestMs          = 0.0;
+    for (uint32_t run = 0; run < runs; ++run) {
+        double ms;
+        passed = runRanges<Ranges>(total, operations, maxPages, false, seed, ms, failed) && passed;
+        bestMs = run == 0 ? ms : std::min(bestMs, ms);
+    }
+
+    std::cout << "  " << name << ": " << bestMs << " ms, " << operations / std::max(bestMs, 1e-3) * 1e-3
+              << " M operations/s, " << failed << " failed allocations" << std::endl;
+    return passed;
+}
+
+//-------------------------------------------------------------------------
+// Page map checks, ranges above 4 GB for TLSF, then the timings of both
+// backends with small and large ranges
+//
+bool rangeAllocator(uint32_t operations, uint32_t runs)
+{
+    runs = std::max(runs, 1u);
+
+    std::cout << "page map check, " << CHECK_SEEDS << " seeds" << std::endl;
+    bool passed = checkRanges<SortedArrayRanges>("sorted array", std::min(operations, 50000u));
+    passed      = checkRanges<TlsfRanges>("TLSF", std::min(operations, 50000u)) && passed;
+
+    {
+        TlsfRanges ranges;
+        ranges.init(64ull << 30);
+
+        TlsfRanges::size_type offset, aligned, size;
+        const bool large = ranges.subAllocate(6ull << 30, 256, offset, aligned, size) && size == (6ull << 30)
+                        && ranges.subAllocate(40ull << 30, 256, offset, aligned, size)
+                        && ranges.largestFreeRange() == (18ull << 30);
+        std::cout << "  TLSF above 4 GB: " << (large ? "ok" : "failed") << std::endl;
+        passed = large && passed;
+    }
+
+    struct Case
+    {
+        const char* name;
+        uint64_t    total;
+        uint32_t    maxPages;
+        uint32_t    seed;
+    };
+    const Case cases[] = {
+        { "256 MB, up to 16 pages", 256ull << 20, 16, 42 },
+        { "256 MB, up to 256 pages", 256ull << 20, 256, 42 },
+        { "64 MB staging block, up to 64 pages", 64ull << 20, 64, 7 },
+    };
+
+    for (const Case& test : cases) {
+        std::cout << test.name << ", " << operations << " operations" << std::endl;
+
+        double sortedMs, tlsfMs;
+        passed = measureRanges<SortedArrayRanges>("sorted array", test.total, operations, test.maxPages, test.seed, runs,
+                                                  sortedMs) && passed;
+        passed = measureRanges<TlsfRanges>("TLSF", test.total, operations, test.maxPages, test.seed, runs, tlsfMs) && passed;
+
+        std::cout << "  TLSF against the sorted array " << sortedMs / std::max(tlsfMs, 1e-3) << "x" << std::endl;
+    }
+    return passed;
+}
+
+} // namespace bench
@@ -0,0 +1,282 @@
+/*
+ *
+ * Andrew Frost
+ * staging.cpp
+ * 2020
+ *
+ */
+
+#include "benchmarks.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../vk_helpers/memorymanagement.hpp"
+
+namespace bench {
+
+static const uint32_t       FRAMES_IN_FLIGHT  = 3;
+static const uint32_t       UPLOADS_PER_FRAME = 256;
+static const vk::DeviceSize LARGE_UPLOAD      = 32 * 1024;  // Every 64 uploads, the others are 16 B to 4 KB
+static const uint32_t       NO_SET            = ~0u;
+
+///////////////////////////////////////////////////////////////////////////
+// HostStaging                                                           //
+///////////////////////////////////////////////////////////////////////////
+// Staging manager with its blocks in host memory, the sets are released //
+// by frame instead of through fences                                    //
+///////////////////////////////////////////////////////////////////////////
+
+class HostStaging : public app::StagingMemoryManager
+{
+public:
+    HostStaging(vk::DeviceSize blockSize)
+    {
+        init(vk::Device(), vk::PhysicalDevice(), blockSize);
+        setFreeUnusedOnRelease(false);
+    }
+
+    // 'deinit' needs a device
+    ~HostStaging() { free(false); }
+
+    uint8_t* allocate(vk::DeviceSize size, vk::DeviceSize& offset)
+    {
+        vk::Buffer buffer;
+        return static_cast<uint8_t*>(getStagingSpace(size, buffer, offset));
+    }
+
+    uint32_t finalizeFrame()
+    {
+        const uint32_t set = m_stagingIndex;
+        finalizeResources();
+        return set;
+    }
+
+    void releaseFrame(uint32_t set) { releaseResources(set); }
+
+    uint32_t blockCount() const { return m_stats.blockCount; }
+
+protected:
+    vk::Result allocBlockMemory(uint32_t id, vk::DeviceSize size, bool toDevice, Block& block) override
+    {
+        block.mapping = static_cast<uint8_t*>(malloc(static_cast<size_t>(size)));
+        if (!block.mapping)
+            return vk::Result::eErrorOutOfHostMemory;
+
+        // any handle that is not null, the blocks are never copied from
+        static_assert(sizeof(VkBuffer) == sizeof(uint64_t), "buffer handles are 64 bit");
+        const uint64_t handle = uint64_t(id) + 1;
+        VkBuffer       buffer;
+        memcpy(&buffer, &handle, sizeof(buffer));
+        block.buffer = vk::Buffer(buffer);
+        return vk::Result::eSuccess;
+    }
+
+    void freeBlockMemory(uint32_t id, const Block& block) override { ::free(block.mapping); }
+};
+
+///////////////////////////////////////////////////////////////////////////
+// ScanStaging                                                           //
+///////////////////////////////////////////////////////////////////////////
+// Reference of the previous block search: the blocks are scanned in     //
+// order and the first one with a free range that fits is used. With     //
+// the sorted array ranges it is the previous staging manager.           //
+///////////////////////////////////////////////////////////////////////////
+
+template <tools::RangeBackend BACKEND>
+class ScanStaging
+{
+public:
+    ScanStaging(vk::DeviceSize blockSize)
+        : m_blockSize(blockSize)
+    {
+    }
+
+    uint8_t* allocate(vk::DeviceSize size, vk::DeviceSize& offset)
+    {
+        using size_type = typename Range::size_type;
+        size_type usedOffset, usedAligned, usedSize;
+
+        const size_type rangeSize = static_cast<size_type>(size);
+
+        uint32_t index = 0;
+        while (index < m_blocks.size() && !m_blocks[index]->range.subAllocate(rangeSize, 16, usedOffset, usedAligned, usedSize))
+            index++;
+
+        if (index == m_blocks.size()) {
+            auto            block     = std::make_unique<Block>();
+            const size_type blockSize = Range::alignedSize(static_cast<size_type>(std::max(m_blockSize, size)));
+            block->memory.resize(static_cast<size_t>(blockSize));
+            block->range.init(blockSize);
+            block->range.subAllocate(rangeSize, 16, usedOffset, usedAligned, usedSize);
+            m_blocks.push_back(std::move(block));
+        }
+
+        m_current.push_back({ index, usedOffset, usedSize });
+        offset = usedAligned;
+        return m_blocks[index]->memory.data() + static_cast<size_t>(usedAligned);
+    }
+
+    uint32_t finalizeFrame()
+    {
+        m_sets.push_back(std::move(m_current));
+        m_current.clear();
+        return static_cast<uint32_t>(m_sets.size() - 1);
+    }
+
+    void releaseFrame(uint32_t set)
+    {
+        for (const auto& entry : m_sets[set])
+            m_blocks[entry.block]->range.subFree(entry.offset, entry.size);
+        m_sets[set].clear();
+    }
+
+    uint32_t blockCount() const { return static_cast<uint32_t>(m_blocks.size()); }
+
+private:
+    using Range = tools::TRangeAllocator<256, BACKEND>;
+
+    struct Block
+    {
+        std::vector<uint8_t> memory;
+        Range                range;
+    };
+
+    struct Entry
+    {
+        uint32_t                  block;
+        typename Range::size_type offset;
+        typename Range::size_type size;
+    };
+
+    vk::DeviceSize                      m_blockSize;
+    std::vector<std::unique_ptr<Block>> m_blocks;
+    std::vector<std::vector<Entry>>     m_sets;
+    std::vector<Entry>                  m_current;
+};
+
+//-------------------------------------------------------------------------
+// Small uploads by frames, the set of a frame is released once the frame
+// that used the same slot is done. When 'check' is set the uploads are
+// filled and read back before their release, an overlap is a mismatch.
+//
+template <class Staging>
+static bool runUploads(Staging& staging, uint32_t uploads, bool check, double& ms)
+{
+    struct Upload
+    {
+        uint8_t* data;
+        uint32_t size;
+        uint8_t  value;
+    };
+
+    std::mt19937                            rng(42);
+    std::uniform_int_distribution<uint32_t> smallSize(16, 4096);
+
+    std::vector<uint32_t>            frameSets(FRAMES_IN_FLIGHT, NO_SET);
+    std::vector<std::vector<Upload>> frameUploads(FRAMES_IN_FLIGHT);
+    bool                             valid = true;
+
+    auto release = [&](uint32_t slot) {
+        if (frameSets[slot] == NO_SET)
+            return;
+        for (const auto& upload : frameUploads[slot])
+            valid = valid && std::all_of(upload.data, upload.data + upload.size, [&](uint8_t v) { return v == upload.value; });
+        staging.releaseFrame(frameSets[slot]);
+        frameSets[slot] = NO_SET;
+        frameUploads[slot].clear();
+    };
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    uint32_t done = 0;
+    for (uint32_t frame = 0; done < uploads; ++frame) {
+        const uint32_t slot = frame % FRAMES_IN_FLIGHT;
+        release(slot);
+
+        const uint32_t count = std::min(UPLOADS_PER_FRAME, uploads - done);
+        for (uint32_t i = 0; i < count; ++i) {
+            const uint32_t size = (done + i) % 64 == 63 ? static_cast<uint32_t>(LARGE_UPLOAD) : smallSize(rng);
+
+            vk::DeviceSize offset;
+            uint8_t*       data = staging.allocate(size, offset);
+            valid = valid && data && offset % 16 == 0;
+
+            if (check) {
+                const uint8_t value = static_cast<uint8_t>(done + i);
+                memset(data, value, size);
+                frameUploads[slot].push_back({ data, size, value });
+            }
+        }
+        frameSets[slot] = staging.finalizeFrame();
+        done += count;
+    }
+
+    for (uint32_t slot = 0; slot < FRAMES_IN_FLIGHT; ++slot)
+        release(slot);
+
+    ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    return valid;
+}
+
+//-------------------------------------------------------------------------
+// Checked once, then the best of the timed runs
+//
+template <class Staging>
+static bool measureUploads(const char* name, vk::DeviceSize blockSize, uint32_t uploads, uint32_t runs, double& bestMs)
+{
+    double ms;
+    bool   passed;
+    {
+        Staging staging(blockSize);
+        passed = runUploads(staging, uploads, true, ms);
+    }
+
+    uint32_t blocks = 0;
+    bestMs          = 0.0;
+    for (uint32_t run = 0; run < runs; ++run) {
+        Staging staging(blockSize);
+        passed = runUploads(staging, uploads, false, ms) && passed;
+        blocks = staging.blockCount();
+        bestMs = run == 0 ? ms : std::min(bestMs, ms);
+    }
+
+    std::cout << "  " << name << ": " << bestMs << " ms, " << uploads / std::max(bestMs, 1e-3) * 1e-3
+              << " M uploads/s, " << blocks << " blocks" << (passed ? "" : ", overlapping uploads") << std::endl;
+    return passed;
+}
+
+//-------------------------------------------------------------------------
+// The frames in flight fill a few large blocks, then many small ones
+//
+bool stagingStress(uint32_t uploads, uint32_t runs)
+{
+    std::cout << uploads << " uploads, " << UPLOADS_PER_FRAME << " per frame, " << FRAMES_IN_FLIGHT
+              << " frames in flight" << std::endl;
+
+    runs = std::max(runs, 1u);
+
+    bool passed = true;
+    for (vk::DeviceSize blockSize : { vk::DeviceSize(1024 * 1024), vk::DeviceSize(64 * 1024) }) {
+        std::cout << blockSize / 1024 << " KB blocks" << std::endl;
+
+        double listsMs, scanMs, previousMs;
+        passed = measureUploads<HostStaging>("segregated lists, sorted array", blockSize, uploads, runs, listsMs) && passed;
+        passed = measureUploads<ScanStaging<tools::RangeBackend::eTLSF>>("first fit scan, TLSF", blockSize, uploads,
+                                                                         runs, scanMs) && passed;
+        passed = measureUploads<ScanStaging<tools::RangeBackend::eSortedArray>>("first fit scan, sorted array (previous)",
+                                                                                blockSize, uploads, runs, previousMs) && passed;
+
+        std::cout << "  against the first fit scan " << scanMs / std::max(listsMs, 1e-3) << "x, against the previous "
+                  << previousMs / std::max(listsMs, 1e-3) << "x" << std::endl;
+    }
+    return passed;
+}
+
+} // namespace bench
@@ -9,6 +9,17 @@
 
 #include "obj_loader.h"
 
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define OBJ_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+#include "../general_helpers/threadpool.hpp"
+
 //-----------------------------------------------------------------------------
 // Extract the directory component from a complete path.
 //
@@ -33,8 +44,1185 @@ static inline std::string get_path(const std::string& file)
     return dir;
 }
 
+//-----------------------------------------------------------------------------
+// Binary cache
+// Header followed by the vertex, index, material index, material and LOD
+// arrays (16 bytes aligned), then the texture names as <uint32 length><chars>
+// and the material libraries as <uint32 length><chars><uint64 size><int64 time>.
+// The cache is valid as long as the OBJ path, size and write time match, the
+// material libraries have the same size and write time, and the normals were
+// generated, the mesh optimized and the LODs built with the same settings.
+//
+static const uint32_t OBJ_CACHE_MAGIC   = 0x434A424F; // "OBJC"
+static const uint32_t OBJ_CACHE_VERSION = 6;
+
+struct ObjCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;   // hash of the OBJ path
+    uint64_t sourceSize;   // size in bytes of the OBJ
+    int64_t  sourceTime;   // last write time of the OBJ
+    uint32_t vertexStride;
+    uint32_t materialStride;
+    float    creaseAngle;     // normal generation settings
+    uint32_t angleWeighted;
+    uint32_t optimized;
+    float    acmrBefore;      // vertex cache statistics of the optimization
+    float    atvrBefore;
+    float    acmrAfter;
+    float    atvrAfter;
+    uint32_t lodLevels;       // LOD settings, 0 when disabled
+    uint32_t padding;
+    uint64_t nbVertices;
+    uint64_t nbIndices;
+    uint64_t nbMatIndx;
+    uint64_t nbMaterials;
+    uint64_t nbTextures;
+    uint64_t nbLods;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t matIndxOffset;
+    uint64_t materialOffset;
+    uint64_t lodOffset;
+    uint64_t textureOffset;
+    uint64_t nbMtlFiles;
+    uint64_t mtlOffset;
+};
+
+// Material library referenced by the OBJ, a missing file has a size of ~0
+struct ObjCacheMtlFile
+{
+    std::string path;
+    uint64_t    size;
+    int64_t     time;
+};
+
+static inline std::string get_cache_name(const std::string& file)
+{
+    return file + ".objcache";
+}
+
+static inline uint64_t hash_string(const std::string& str)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : str)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Size and last write time of a file, false if it does not exist
+static bool get_file_stamp(const std::string& file, uint64_t& size, int64_t& time)
+{
+    std::error_code ec;
+    const auto      fileSize = std::filesystem::file_size(file, ec);
+    if (ec)
+        return false;
+    const auto fileTime = std::filesystem::last_write_time(file, ec);
+    if (ec)
+        return false;
+
+    size = static_cast<uint64_t>(fileSize);
+    time = static_cast<int64_t>(fileTime.time_since_epoch().count());
+    return true;
+}
+
+// Fill the part of the header identifying the source file, false if it does not exist
+static bool get_cache_key(const std::string& file, const ObjLoader& loader, ObjCacheHeader& header)
+{
+    uint64_t size;
+    int64_t  time;
+    if (!get_file_stamp(file, size, time))
+        return false;
+
+    header.magic          = OBJ_CACHE_MAGIC;
+    header.version        = OBJ_CACHE_VERSION;
+    header.sourceHash     = hash_string(file);
+    header.sourceSize     = size;
+    header.sourceTime     = time;
+    header.vertexStride   = sizeof(VertexObj);
+    header.materialStride = sizeof(MaterialObj);
+    header.creaseAngle    = loader.m_creaseAngle;
+    header.angleWeighted  = loader.m_angleWeightedNormals ? 1 : 0;
+    header.optimized      = loader.m_optimizeMesh ? 1 : 0;
+    header.lodLevels      = loader.m_generateLods ? loader.m_maxLods : 0;
+    return true;
+}
+
+// Material libraries of the 'mtllib' lines, every name of a line as the
+// readers try each of them, relative to the directory of the OBJ
+static std::vector<ObjCacheMtlFile> get_mtl_files(const std::string& file)
+{
+    std::vector<ObjCacheMtlFile> mtlFiles;
+
+    tools::MappedFile obj;
+    if (!obj.open(file))
+        return mtlFiles;
+
+    const std::string dir = get_path(file);
+    std::string_view  text(reinterpret_cast<const char*>(obj.data()), obj.size());
+    while (!text.empty())
+    {
+        const size_t     end  = text.find_first_of("\r\n");
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+        line.remove_prefix(std::min(line.find_first_not_of(" \t"), line.size()));
+        if (line.compare(0, 6, "mtllib") != 0 || line.size() < 7 || (line[6] != ' ' && line[6] != '\t'))
+            continue;
+
+        line.remove_prefix(7);
+        while (!line.empty())
+        {
+            const size_t     space = line.find(' ');
+            std::string_view name  = line.substr(0, space);
+            line.remove_prefix(space == std::string_view::npos ? line.size() : space + 1);
+            if (name.empty())
+                continue;
+
+            ObjCacheMtlFile mtlFile = { dir + std::string(name), ~0ull, 0 };
+            get_file_stamp(mtlFile.path, mtlFile.size, mtlFile.time);
+            mtlFiles.push_back(mtlFile);
+        }
+    }
+
+    return mtlFiles;
+}
+
+static inline uint64_t align_cache_offset(uint64_t offset)
+{
+    return (offset + 15) & ~uint64_t(15);
+}
+
+//-----------------------------------------------------------------------------
+// Loading the OBJ, from the binary cache when it is up to date
+//
 void ObjLoader::loadModel(const std::string& filename)
 {
+    if (m_useCache && loadCache(filename))
+        return;
+
+    parseObj(filename);
+
+    if (m_optimizeMesh)
+        optimizeMesh();
+
+    m_lods = { { 0, static_cast<uint32_t>(m_indices.size()), 0.f } };
+    if (m_generateLods)
+        generateLods();
+
+    if (m_useCache)
+        saveCache(filename);
+}
+
+ObjArray<VertexObj> ObjLoader::getVertices() const
+{
+    if (isCached())
+        return { reinterpret_cast<const VertexObj*>(m_cache.data() + m_cacheVertexOffset), m_cacheNbVertices };
+    return { m_vertices.data(), m_vertices.size() };
+}
+
+ObjArray<uint32_t> ObjLoader::getIndices() const
+{
+    if (isCached())
+        return { reinterpret_cast<const uint32_t*>(m_cache.data() + m_cacheIndexOffset), m_cacheNbIndices };
+    return { m_indices.data(), m_indices.size() };
+}
+
+ObjArray<uint32_t> ObjLoader::getMatIndices() const
+{
+    if (isCached())
+        return { reinterpret_cast<const uint32_t*>(m_cache.data() + m_cacheMatIndxOffset), m_cacheNbMatIndx };
+    return { m_matIndx.data(), m_matIndx.size() };
+}
+
+//-----------------------------------------------------------------------------
+// Map the cache, vertices and indices stay in the mapping while materials
+// and textures are copied
+//
+bool ObjLoader::loadCache(const std::string& filename)
+{
+    ObjCacheHeader key = {};
+    if (!get_cache_key(filename, *this, key))
+        return false;
+
+    tools::MappedFile file;
+    if (!file.open(get_cache_name(filename)) || file.size() < sizeof(ObjCacheHeader))
+        return false;
+
+    ObjCacheHeader header;
+    memcpy(&header, file.data(), sizeof(ObjCacheHeader));
+
+    if (header.magic != key.magic || header.version != key.version
+        || header.sourceHash != key.sourceHash || header.sourceSize != key.sourceSize
+        || header.sourceTime != key.sourceTime || header.vertexStride != key.vertexStride
+        || header.materialStride != key.materialStride || header.creaseAngle != key.creaseAngle
+        || header.angleWeighted != key.angleWeighted || header.optimized != key.optimized
+        || header.lodLevels != key.lodLevels)
+        return false;
+
+    const uint64_t fileSize = file.size();
+    if (header.vertexOffset + header.nbVertices * sizeof(VertexObj) > fileSize
+        || header.indexOffset + header.nbIndices * sizeof(uint32_t) > fileSize
+        || header.matIndxOffset + header.nbMatIndx * sizeof(uint32_t) > fileSize
+        || header.materialOffset + header.nbMaterials * sizeof(MaterialObj) > fileSize
+        || header.lodOffset + header.nbLods * sizeof(ObjLod) > fileSize || header.nbLods == 0
+        || header.textureOffset > fileSize || header.mtlOffset > fileSize)
+        return false;
+
+    // Material libraries, edited or created since the cache was written
+    uint64_t offset = header.mtlOffset;
+    for (uint64_t i = 0; i < header.nbMtlFiles; ++i)
+    {
+        uint32_t length;
+        if (offset + sizeof(uint32_t) > fileSize)
+            return false;
+        memcpy(&length, file.data() + offset, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+        if (offset + length + sizeof(uint64_t) + sizeof(int64_t) > fileSize)
+            return false;
+
+        ObjCacheMtlFile cached = { std::string(reinterpret_cast<const char*>(file.data() + offset), length), 0, 0 };
+        memcpy(&cached.size, file.data() + offset + length, sizeof(uint64_t));
+        memcpy(&cached.time, file.data() + offset + length + sizeof(uint64_t), sizeof(int64_t));
+        offset += length + sizeof(uint64_t) + sizeof(int64_t);
+
+        ObjCacheMtlFile current = { cached.path, ~0ull, 0 };
+        get_file_stamp(current.path, current.size, current.time);
+        if (current.size != cached.size || current.time != cached.time)
+            return false;
+    }
+
+    // Texture names
+    std::vector<std::string> textures;
+    offset = header.textureOffset;
+    for (uint64_t i = 0; i < header.nbTextures; ++i)
+    {
+        uint32_t length;
+        if (offset + sizeof(uint32_t) > fileSize)
+            return false;
+        memcpy(&length, file.data() + offset, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+        if (offset + length > fileSize)
+            return false;
+        textures.emplace_back(reinterpret_cast<const char*>(file.data() + offset), length);
+        offset += length;
+    }
+
+    const MaterialObj* materials = reinterpret_cast<const MaterialObj*>(file.data() + header.materialOffset);
+    m_materials.assign(materials, materials + header.nbMaterials);
+    m_textures = std::move(textures);
+
+    const ObjLod* lods = reinterpret_cast<const ObjLod*>(file.data() + header.lodOffset);
+    m_lods.assign(lods, lods + header.nbLods);
+
+    m_cacheVertexOffset  = static_cast<size_t>(header.vertexOffset);
+    m_cacheIndexOffset   = static_cast<size_t>(header.indexOffset);
+    m_cacheMatIndxOffset = static_cast<size_t>(header.matIndxOffset);
+    m_cacheNbVertices    = static_cast<size_t>(header.nbVertices);
+    m_cacheNbIndices     = static_cast<size_t>(header.nbIndices);
+    m_cacheNbMatIndx     = static_cast<size_t>(header.nbMatIndx);
+    m_cache              = std::move(file);
+
+    m_vertexCacheBefore.acmr = header.acmrBefore;
+    m_vertexCacheBefore.atvr = header.atvrBefore;
+    m_vertexCacheAfter.acmr  = header.acmrAfter;
+    m_vertexCacheAfter.atvr  = header.atvrAfter;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Write the parsed arrays to the cache. The header is written last, so an
+// interrupted write never produces a valid cache.
+//
+void ObjLoader::saveCache(const std::string& filename) const
+{
+    ObjCacheHeader header = {};
+    if (!get_cache_key(filename, *this, header))
+        return;
+
+    const std::string cacheName = get_cache_name(filename);
+    std::ofstream     out(cacheName, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        return;
+
+    header.nbVertices  = m_vertices.size();
+    header.nbIndices   = m_indices.size();
+    header.nbMatIndx   = m_matIndx.size();
+    header.nbMaterials = m_materials.size();
+    header.nbTextures  = m_textures.size();
+    header.nbLods      = m_lods.size();
+    header.acmrBefore  = m_vertexCacheBefore.acmr;
+    header.atvrBefore  = m_vertexCacheBefore.atvr;
+    header.acmrAfter   = m_vertexCacheAfter.acmr;
+    header.atvrAfter   = m_vertexCacheAfter.atvr;
+
+    header.vertexOffset   = align_cache_offset(sizeof(ObjCacheHeader));
+    header.indexOffset    = align_cache_offset(header.vertexOffset + m_vertices.size() * sizeof(VertexObj));
+    header.matIndxOffset  = align_cache_offset(header.indexOffset + m_indices.size() * sizeof(uint32_t));
+    header.materialOffset = align_cache_offset(header.matIndxOffset + m_matIndx.size() * sizeof(uint32_t));
+    header.lodOffset      = align_cache_offset(header.materialOffset + m_materials.size() * sizeof(MaterialObj));
+    header.textureOffset  = header.lodOffset + m_lods.size() * sizeof(ObjLod);
+
+    const std::vector<ObjCacheMtlFile> mtlFiles = get_mtl_files(filename);
+    header.nbMtlFiles = mtlFiles.size();
+    header.mtlOffset  = header.textureOffset;
+    for (const auto& texture : m_textures)
+        header.mtlOffset += sizeof(uint32_t) + texture.size();
+
+    auto writeAt = [&out](uint64_t offset, const void* data, size_t size) {
+        out.seekp(static_cast<std::streamoff>(offset));
+        out.write(reinterpret_cast<const char*>(data), size);
+    };
+
+    const ObjCacheHeader invalid = {};
+    writeAt(0, &invalid, sizeof(ObjCacheHeader));
+    writeAt(header.vertexOffset, m_vertices.data(), m_vertices.size() * sizeof(VertexObj));
+    writeAt(header.indexOffset, m_indices.data(), m_indices.size() * sizeof(uint32_t));
+    writeAt(header.matIndxOffset, m_matIndx.data(), m_matIndx.size() * sizeof(uint32_t));
+    writeAt(header.materialOffset, m_materials.data(), m_materials.size() * sizeof(MaterialObj));
+    writeAt(header.lodOffset, m_lods.data(), m_lods.size() * sizeof(ObjLod));
+
+    out.seekp(static_cast<std::streamoff>(header.textureOffset));
+    for (const auto& texture : m_textures)
+    {
+        uint32_t length = static_cast<uint32_t>(texture.size());
+        out.write(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+        out.write(texture.data(), length);
+    }
+
+    for (const auto& mtlFile : mtlFiles)
+    {
+        uint32_t length = static_cast<uint32_t>(mtlFile.path.size());
+        out.write(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+        out.write(mtlFile.path.data(), length);
+        out.write(reinterpret_cast<const char*>(&mtlFile.size), sizeof(uint64_t));
+        out.write(reinterpret_cast<const char*>(&mtlFile.time), sizeof(int64_t));
+    }
+
+    writeAt(0, &header, sizeof(ObjCacheHeader));
+    out.close();
+
+    if (out.fail())
+    {
+        std::cerr << "Cannot write cache: " << cacheName << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(cacheName, ec);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Reorder the triangles for the post-transform cache, then by clusters to
+// reduce overdraw, then the vertices in order of first use
+//
+void ObjLoader::optimizeMesh()
+{
+    const size_t nbVertices  = m_vertices.size();
+    const size_t nbTriangles = m_indices.size() / 3;
+
+    m_vertexCacheBefore = tools::mesh::analyzeVertexCache(m_indices.data(), m_indices.size(), nbVertices);
+    m_vertexCacheAfter  = m_vertexCacheBefore;
+
+    // Material indices are per triangle and follow the new order
+    if (nbTriangles == 0 || m_matIndx.size() != nbTriangles)
+        return;
+
+    std::vector<uint32_t> triangleOrder;
+    std::vector<uint32_t> clusters;
+    tools::mesh::tipsify(m_indices.data(), m_indices.size(), nbVertices, triangleOrder, clusters);
+    tools::mesh::optimizeOverdraw(m_indices.data(), m_indices.size(), nbVertices, &m_vertices[0].pos.x,
+                                  sizeof(VertexObj), triangleOrder, clusters);
+
+    std::vector<uint32_t> indices(nbTriangles * 3);
+    std::vector<uint32_t> matIndx(nbTriangles);
+    for (size_t t = 0; t < nbTriangles; ++t)
+    {
+        const uint32_t triangle = triangleOrder[t];
+        indices[3 * t + 0]      = m_indices[3 * triangle + 0];
+        indices[3 * t + 1]      = m_indices[3 * triangle + 1];
+        indices[3 * t + 2]      = m_indices[3 * triangle + 2];
+        matIndx[t]              = m_matIndx[triangle];
+    }
+
+    // Keeping the original order if it was already better
+    if (tools::mesh::analyzeVertexCache(indices.data(), indices.size(), nbVertices).acmr > m_vertexCacheBefore.acmr)
+    {
+        indices = m_indices;
+        matIndx = m_matIndx;
+    }
+
+    std::vector<uint32_t> remap;
+    const size_t          nbReferenced = tools::mesh::optimizeVertexFetch(indices.data(), indices.size(), nbVertices, remap);
+
+    std::vector<VertexObj> vertices(nbReferenced);
+    for (size_t v = 0; v < nbVertices; ++v)
+    {
+        if (remap[v] != ~0u)
+            vertices[remap[v]] = m_vertices[v];
+    }
+    for (auto& index : indices)
+        index = remap[index];
+
+    m_vertices.swap(vertices);
+    m_indices.swap(indices);
+    m_matIndx.swap(matIndx);
+
+    m_vertexCacheAfter = tools::mesh::analyzeVertexCache(m_indices.data(), m_indices.size(), m_vertices.size());
+}
+
+//-----------------------------------------------------------------------------
+// Simplify the full mesh down to half the triangles of the previous level,
+// stopping when a level is not at least 10% smaller. The triangles of each
+// level are reordered for the vertex cache.
+//
+void ObjLoader::generateLods()
+{
+    const size_t nbTriangles = m_indices.size() / 3;
+    if (nbTriangles == 0 || m_matIndx.size() != nbTriangles)
+        return;
+
+    tools::mesh::Simplifier simplifier(m_indices.data(), m_indices.size(), &m_vertices[0].pos.x, m_vertices.size(),
+                                       sizeof(VertexObj), m_matIndx.data());
+
+    std::vector<uint32_t> triangleOrder;
+    std::vector<uint32_t> clusters;
+
+    for (uint32_t level = 1; level < m_maxLods; ++level)
+    {
+        const size_t previous = m_lods.back().nbIndices;
+        const size_t target   = previous / 6 * 3;
+        const size_t count    = simplifier.simplify(target);
+        if (count == 0 || count * 10 > previous * 9)
+            break;
+
+        const std::vector<uint32_t>& indices = simplifier.indices();
+        const std::vector<uint32_t>& matIndx = simplifier.triangleGroups();
+        tools::mesh::tipsify(indices.data(), count, m_vertices.size(), triangleOrder, clusters);
+
+        ObjLod lod     = {};
+        lod.firstIndex = static_cast<uint32_t>(m_indices.size());
+        lod.nbIndices  = static_cast<uint32_t>(count);
+        lod.error      = simplifier.error();
+
+        for (uint32_t triangle : triangleOrder)
+        {
+            m_indices.insert(m_indices.end(), &indices[3 * triangle], &indices[3 * triangle] + 3);
+            m_matIndx.push_back(matIndx[triangle]);
+        }
+        m_lods.push_back(lod);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Parallel parsing
+// The mapped OBJ is split in line-aligned chunks. A first pass counts the
+// records of each chunk, the prefix sums give where each chunk writes in the
+// output arrays, allocated once. The second pass parses the chunks in place,
+// out of the mapping: lines and fields are string_views, numbers are parsed
+// like tinyobj does, so the result is the same as ObjReader. Materials,
+// groups and triangulation are then replayed in file order with the tinyobj
+// code.
+//
+static const size_t OBJ_CHUNK_MIN_SIZE = size_t(1) << 20;
+
+struct ObjChunkFace
+{
+    uint32_t firstCorner;
+    uint32_t nbCorners;
+};
+
+struct ObjChunkRecord
+{
+    enum Type
+    {
+        eUseMtl,
+        eMtlLib,
+        eGroup,
+        eObject,
+        eSmoothing
+    };
+
+    Type        type;
+    size_t      face;   // number of faces of the file read before this record
+    uint32_t    value;  // smoothing group id
+    std::string text;
+};
+
+struct ObjChunk
+{
+    // Record counts of the pre-scan
+    size_t nbV       = 0;
+    size_t nbVn      = 0;
+    size_t nbVt      = 0;
+    size_t nbFaces   = 0;
+    size_t nbCorners = 0;
+
+    // First element of the chunk in the output arrays
+    size_t firstV      = 0;
+    size_t firstVn     = 0;
+    size_t firstVt     = 0;
+    size_t firstFace   = 0;
+    size_t firstCorner = 0;
+
+    std::vector<ObjChunkRecord> records;
+    bool                        valid = true;
+};
+
+// Output arrays shared by the chunks
+struct ObjArrays
+{
+    tinyobj::attrib_t*                   attrib;
+    std::vector<ObjChunkFace>            faces;
+    std::vector<tinyobj::vertex_index_t> corners;  // resolved, -1 when absent
+};
+
+static inline bool is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// Same as strspn(token, " \t")
+static inline void skip_blanks(std::string_view& s)
+{
+    size_t i = 0;
+    while (i < s.size() && is_blank(s[i]))
+        ++i;
+    s.remove_prefix(i);
+}
+
+// Same as strcspn(token, " \t\r"), lines never contain '\r'
+static inline std::string_view next_field(std::string_view& s)
+{
+    skip_blanks(s);
+    size_t i = 0;
+    while (i < s.size() && !is_blank(s[i]))
+        ++i;
+    std::string_view field = s.substr(0, i);
+    s.remove_prefix(i);
+    return field;
+}
+
+// Same as strcspn(token, "/ \t\r")
+static inline void skip_index(std::string_view& s)
+{
+    size_t i = 0;
+    while (i < s.size() && s[i] != '/' && !is_blank(s[i]))
+        ++i;
+    s.remove_prefix(i);
+}
+
+// Same as atoi, bounded by the line
+static inline int parse_int(std::string_view s)
+{
+    size_t i = 0;
+    while (i < s.size() && (is_blank(s[i]) || s[i] == '\v' || s[i] == '\f'))
+        ++i;
+
+    bool negative = false;
+    if (i < s.size() && (s[i] == '+' || s[i] == '-'))
+        negative = s[i++] == '-';
+
+    int64_t value = 0;
+    while (i < s.size() && IS_DIGIT(s[i]) && value <= INT32_MAX)
+        value = value * 10 + (s[i++] - '0');
+
+    return static_cast<int>(negative ? -value : value);
+}
+
+// Parses the number at the start of the field, with the same arithmetic as
+// tinyobj::tryParseDouble so both readers agree on every bit
+static bool parse_double(std::string_view s, double& result)
+{
+    static const double pow_lut[] = { 1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001 };
+
+    if (s.empty())
+        return false;
+
+    const char* curr = s.data();
+    const char* end  = s.data() + s.size();
+
+    double mantissa = 0.0;
+    int    exponent = 0;
+    bool   negative = false;
+
+    // Sign, then the integer part unless the number starts with a '.'
+    if (*curr == '+' || *curr == '-')
+        negative = *curr++ == '-';
+    else if (!IS_DIGIT(*curr) && *curr != '.')
+        return false;
+
+    if (curr == end || *curr != '.')
+    {
+        int read = 0;
+        for (; curr != end && IS_DIGIT(*curr); ++curr, ++read)
+        {
+            mantissa *= 10;
+            mantissa += static_cast<int>(*curr - '0');
+        }
+        if (read == 0)
+            return false;
+    }
+
+    // Decimal part
+    if (curr != end && *curr == '.')
+    {
+        ++curr;
+        for (int read = 1; curr != end && IS_DIGIT(*curr); ++curr, ++read)
+            mantissa += static_cast<int>(*curr - '0') * (read < 8 ? pow_lut[read] : std::pow(10.0, -read));
+    }
+
+    // Exponent
+    if (curr != end && (*curr == 'e' || *curr == 'E'))
+    {
+        ++curr;
+        bool negativeExponent = false;
+        if (curr != end && (*curr == '+' || *curr == '-'))
+            negativeExponent = *curr++ == '-';
+        else if (curr == end || !IS_DIGIT(*curr))
+            return false;
+
+        int read = 0;
+        for (; curr != end && IS_DIGIT(*curr); ++curr, ++read)
+        {
+            exponent *= 10;
+            exponent += static_cast<int>(*curr - '0');
+        }
+        if (read == 0)
+            return false;
+        exponent = negativeExponent ? -exponent : exponent;
+    }
+
+    result = (negative ? -1 : 1) * (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+    return true;
+}
+
+// Same as tinyobj::parseReal with a default value
+static inline tinyobj::real_t parse_real(std::string_view& s, double defaultValue = 0.0)
+{
+    double value = defaultValue;
+    parse_double(next_field(s), value);
+    return static_cast<tinyobj::real_t>(value);
+}
+
+// Same as tinyobj::parseReal without default value
+static inline bool parse_real(std::string_view& s, tinyobj::real_t& out)
+{
+    double value;
+    if (!parse_double(next_field(s), value))
+        return false;
+    out = static_cast<tinyobj::real_t>(value);
+    return true;
+}
+
+// Same as tinyobj::parseTriple, the indices are kept as written (0 when absent)
+static bool parse_raw_triple(std::string_view& s, tinyobj::vertex_index_t& vi)
+{
+    vi.v_idx  = parse_int(s);
+    vi.vt_idx = 0;
+    vi.vn_idx = 0;
+    if (vi.v_idx == 0)
+        return false;
+
+    skip_index(s);
+    if (s.empty() || s[0] != '/')
+        return true;
+    s.remove_prefix(1);
+
+    // i//k
+    if (!s.empty() && s[0] == '/')
+    {
+        s.remove_prefix(1);
+        vi.vn_idx = parse_int(s);
+        skip_index(s);
+        return vi.vn_idx != 0;
+    }
+
+    // i/j/k or i/j
+    vi.vt_idx = parse_int(s);
+    if (vi.vt_idx == 0)
+        return false;
+
+    skip_index(s);
+    if (s.empty() || s[0] != '/')
+        return true;
+
+    // i/j/k
+    s.remove_prefix(1);
+    vi.vn_idx = parse_int(s);
+    skip_index(s);
+    return vi.vn_idx != 0;
+}
+
+// Next line without its leading blanks, lines end with "\n", "\r\n" or "\r"
+static inline std::string_view next_line(const char*& cur, const char* end)
+{
+    const char* lineEnd = cur;
+    while (lineEnd < end && *lineEnd != '\n' && *lineEnd != '\r')
+        ++lineEnd;
+
+    std::string_view line(cur, static_cast<size_t>(lineEnd - cur));
+    cur = lineEnd;
+    if (cur < end && *cur == '\r')
+        ++cur;
+    if (cur < end && *cur == '\n')
+        ++cur;
+
+    skip_blanks(line);
+    return line;
+}
+
+static inline bool is_command(std::string_view line, const char* command, size_t length)
+{
+    return line.size() > length && line.compare(0, length, command) == 0 && is_blank(line[length]);
+}
+
+// Count the attributes, faces and corners of [begin, end)
+static void scan_chunk(const char* begin, const char* end, ObjChunk& chunk)
+{
+    const char* cur = begin;
+    while (cur < end)
+    {
+        std::string_view line = next_line(cur, end);
+
+        if (is_command(line, "v", 1))
+            chunk.nbV++;
+        else if (is_command(line, "vn", 2))
+            chunk.nbVn++;
+        else if (is_command(line, "vt", 2))
+            chunk.nbVt++;
+        else if (is_command(line, "f", 1))
+        {
+            line.remove_prefix(2);
+            while (!next_field(line).empty())
+                chunk.nbCorners++;
+            chunk.nbFaces++;
+        }
+    }
+}
+
+// Parse the lines in [begin, end) in the output arrays, mirrors the line
+// handling of tinyobj::LoadObj. Lines, points and tags are not handled, the
+// chunk is then invalid.
+static void parse_chunk(const char* begin, const char* end, ObjChunk& chunk, ObjArrays& arrays)
+{
+    tinyobj::real_t* v  = arrays.attrib->vertices.data() + 3 * chunk.firstV;
+    tinyobj::real_t* vc = arrays.attrib->colors.data() + 3 * chunk.firstV;
+    tinyobj::real_t* vn = arrays.attrib->normals.data() + 3 * chunk.firstVn;
+    tinyobj::real_t* vt = arrays.attrib->texcoords.data() + 2 * chunk.firstVt;
+
+    size_t nbV = 0, nbVn = 0, nbVt = 0, nbFaces = 0, nbCorners = 0;
+
+    const char* cur = begin;
+    while (cur < end)
+    {
+        std::string_view line = next_line(cur, end);
+
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        // vertex
+        if (is_command(line, "v", 1))
+        {
+            if (nbV == chunk.nbV)
+                break;
+
+            line.remove_prefix(2);
+            v[3 * nbV + 0] = parse_real(line);
+            v[3 * nbV + 1] = parse_real(line);
+            v[3 * nbV + 2] = parse_real(line);
+
+            // missing colors are white, as with ObjReaderConfig::vertex_color
+            tinyobj::real_t r, g, b;
+            if (!(parse_real(line, r) && parse_real(line, g) && parse_real(line, b)))
+                r = g = b = 1.0f;
+            vc[3 * nbV + 0] = r;
+            vc[3 * nbV + 1] = g;
+            vc[3 * nbV + 2] = b;
+            nbV++;
+            continue;
+        }
+
+        // normal
+        if (is_command(line, "vn", 2))
+        {
+            if (nbVn == chunk.nbVn)
+                break;
+
+            line.remove_prefix(3);
+            vn[3 * nbVn + 0] = parse_real(line);
+            vn[3 * nbVn + 1] = parse_real(line);
+            vn[3 * nbVn + 2] = parse_real(line);
+            nbVn++;
+            continue;
+        }
+
+        // texcoord
+        if (is_command(line, "vt", 2))
+        {
+            if (nbVt == chunk.nbVt)
+                break;
+
+            line.remove_prefix(3);
+            vt[2 * nbVt + 0] = parse_real(line);
+            vt[2 * nbVt + 1] = parse_real(line);
+            nbVt++;
+            continue;
+        }
+
+        // line, points and tags are left to tinyobj
+        if (is_command(line, "l", 1) || is_command(line, "p", 1) || is_command(line, "t", 1))
+            break;
+
+        // face, indices resolved against the attributes read so far
+        if (is_command(line, "f", 1))
+        {
+            if (nbFaces == chunk.nbFaces)
+                break;
+
+            line.remove_prefix(2);
+            skip_blanks(line);
+
+            ObjChunkFace& face = arrays.faces[chunk.firstFace + nbFaces];
+            face.firstCorner   = static_cast<uint32_t>(chunk.firstCorner + nbCorners);
+
+            const int sizeV  = static_cast<int>(chunk.firstV + nbV);
+            const int sizeVn = static_cast<int>(chunk.firstVn + nbVn);
+            const int sizeVt = static_cast<int>(chunk.firstVt + nbVt);
+
+            while (!line.empty())
+            {
+                tinyobj::vertex_index_t raw;
+                if (nbCorners == chunk.nbCorners || !parse_raw_triple(line, raw))
+                {
+                    chunk.valid = false;
+                    return;
+                }
+
+                tinyobj::vertex_index_t& vi = arrays.corners[chunk.firstCorner + nbCorners];
+                vi                          = tinyobj::vertex_index_t();
+                tinyobj::fixIndex(raw.v_idx, sizeV, &vi.v_idx);
+                if (raw.vn_idx != 0)
+                    tinyobj::fixIndex(raw.vn_idx, sizeVn, &vi.vn_idx);
+                if (raw.vt_idx != 0)
+                    tinyobj::fixIndex(raw.vt_idx, sizeVt, &vi.vt_idx);
+                nbCorners++;
+
+                skip_blanks(line);
+            }
+
+            face.nbCorners = static_cast<uint32_t>(chunk.firstCorner + nbCorners) - face.firstCorner;
+            nbFaces++;
+            continue;
+        }
+
+        const size_t faceIndex = chunk.firstFace + nbFaces;
+
+        // use mtl
+        if (line.compare(0, 6, "usemtl") == 0)
+        {
+            line.remove_prefix(6);
+            chunk.records.push_back({ ObjChunkRecord::eUseMtl, faceIndex, 0, std::string(next_field(line)) });
+            continue;
+        }
+
+        // load mtl
+        if (is_command(line, "mtllib", 6))
+        {
+            chunk.records.push_back({ ObjChunkRecord::eMtlLib, faceIndex, 0, std::string(line.substr(7)) });
+            continue;
+        }
+
+        // group name
+        if (is_command(line, "g", 1))
+        {
+            chunk.records.push_back({ ObjChunkRecord::eGroup, faceIndex, 0, std::string(line) });
+            continue;
+        }
+
+        // object name
+        if (is_command(line, "o", 1))
+        {
+            chunk.records.push_back({ ObjChunkRecord::eObject, faceIndex, 0, std::string(line.substr(2)) });
+            continue;
+        }
+
+        // smoothing group id
+        if (is_command(line, "s", 1))
+        {
+            line.remove_prefix(2);
+            skip_blanks(line);
+
+            if (line.empty())
+                continue;
+
+            uint32_t smoothingId = 0;
+            if (line.compare(0, 3, "off") != 0)
+            {
+                int smGroupId = parse_int(line);
+                smoothingId   = smGroupId < 0 ? 0 : static_cast<uint32_t>(smGroupId);
+            }
+            chunk.records.push_back({ ObjChunkRecord::eSmoothing, faceIndex, smoothingId, std::string() });
+            continue;
+        }
+
+        // Ignore unknown command.
+    }
+
+    chunk.valid = cur >= end && nbV == chunk.nbV && nbVn == chunk.nbVn && nbVt == chunk.nbVt
+                  && nbFaces == chunk.nbFaces && nbCorners == chunk.nbCorners;
+}
+
+// Faces waiting to be flushed in a shape, mirrors tinyobj::PrimGroup::faceGroup
+struct ObjPendingFace
+{
+    uint32_t face;
+    uint32_t smoothingId;
+};
+
+// Same as tinyobj::exportGroupsToShape for faces. Triangles are added directly,
+// polygons go through tinyobj for the triangulation.
+static bool export_faces(tinyobj::shape_t* shape, const std::vector<ObjPendingFace>& pendingFaces,
+    const ObjArrays& arrays, int materialId, const std::string& name)
+{
+    if (pendingFaces.empty())
+        return false;
+
+    shape->name = name;
+
+    const std::vector<tinyobj::tag_t> tags;
+    for (const auto& pending : pendingFaces)
+    {
+        const ObjChunkFace& face = arrays.faces[pending.face];
+        if (face.nbCorners < 3)
+            continue;
+
+        const auto firstCorner = arrays.corners.begin() + face.firstCorner;
+        if (face.nbCorners == 3)
+        {
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                const tinyobj::vertex_index_t& vi = firstCorner[k];
+
+                tinyobj::index_t idx;
+                idx.vertex_index   = vi.v_idx;
+                idx.normal_index   = vi.vn_idx;
+                idx.texcoord_index = vi.vt_idx;
+                shape->mesh.indices.push_back(idx);
+            }
+            shape->mesh.num_face_vertices.push_back(3);
+            shape->mesh.material_ids.push_back(materialId);
+            shape->mesh.smoothing_group_ids.push_back(pending.smoothingId);
+        }
+        else
+        {
+            tinyobj::PrimGroup polygon;
+            polygon.faceGroup.resize(1);
+            polygon.faceGroup[0].smoothing_group_id = pending.smoothingId;
+            polygon.faceGroup[0].vertex_indices.assign(firstCorner, firstCorner + face.nbCorners);
+            tinyobj::exportGroupsToShape(shape, polygon, tags, materialId, name, true, arrays.attrib->vertices);
+        }
+    }
+    shape->mesh.tags = tags;
+
+    return true;
+}
+
+// Parse the OBJ in parallel, returns false if tinyobj must be used instead
+static bool parse_obj_parallel(const std::string& filename, tinyobj::attrib_t& attrib,
+    std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials)
+{
+    tools::MappedFile file;
+    if (!file.open(filename))
+        return false;
+
+    const char*  data = reinterpret_cast<const char*>(file.data());
+    const size_t size = file.size();
+
+    // Line-aligned chunks
+    tools::ThreadPool& threadPool = tools::ThreadPool::Singleton();
+    const size_t       nbChunks   = std::max<size_t>(1, std::min<size_t>(threadPool.size() * 4, size / OBJ_CHUNK_MIN_SIZE));
+
+    std::vector<size_t> bounds(1, 0);
+    for (size_t c = 1; c < nbChunks; ++c)
+    {
+        size_t split = std::max(bounds.back(), size * c / nbChunks);
+        while (split < size && data[split] != '\n')
+            ++split;
+        if (split < size)
+            ++split;
+        if (split > bounds.back() && split < size)
+            bounds.push_back(split);
+    }
+    bounds.push_back(size);
+
+    // Pre-scan and placement of each chunk in the output arrays
+    std::vector<ObjChunk> chunks(bounds.size() - 1);
+    threadPool.parallelFor(chunks.size(), [&](size_t c) {
+        scan_chunk(data + bounds[c], data + bounds[c + 1], chunks[c]);
+    });
+
+    size_t nbV = 0, nbVn = 0, nbVt = 0, nbFaces = 0, nbCorners = 0;
+    for (auto& chunk : chunks)
+    {
+        chunk.firstV      = nbV;
+        chunk.firstVn     = nbVn;
+        chunk.firstVt     = nbVt;
+        chunk.firstFace   = nbFaces;
+        chunk.firstCorner = nbCorners;
+        nbV += chunk.nbV;
+        nbVn += chunk.nbVn;
+        nbVt += chunk.nbVt;
+        nbFaces += chunk.nbFaces;
+        nbCorners += chunk.nbCorners;
+    }
+
+    if (nbV > INT32_MAX || nbCorners > UINT32_MAX)
+        return false;
+
+    ObjArrays arrays;
+    arrays.attrib = &attrib;
+    attrib.vertices.resize(3 * nbV);
+    attrib.colors.resize(3 * nbV);
+    attrib.normals.resize(3 * nbVn);
+    attrib.texcoords.resize(2 * nbVt);
+    arrays.faces.resize(nbFaces);
+    arrays.corners.resize(nbCorners);
+
+    threadPool.parallelFor(chunks.size(), [&](size_t c) {
+        parse_chunk(data + bounds[c], data + bounds[c + 1], chunks[c], arrays);
+    });
+
+    for (const auto& chunk : chunks)
+    {
+        if (!chunk.valid)
+        {
+            attrib = tinyobj::attrib_t();
+            return false;
+        }
+    }
+
+    // Replay in file order
+    std::string mtlBaseDir;
+    if (filename.find_last_of("/\\") != std::string::npos)
+        mtlBaseDir = filename.substr(0, filename.find_last_of("/\\"));
+    tinyobj::MaterialFileReader matFileReader(mtlBaseDir);
+
+    std::map<std::string, int>  materialMap;
+    int                         material    = -1;
+    uint32_t                    smoothingId = 0;
+    std::string                 name;
+    std::vector<ObjPendingFace> pendingFaces;
+    tinyobj::shape_t            shape;
+
+    auto applyRecord = [&](const ObjChunkRecord& record) {
+        switch (record.type)
+        {
+        case ObjChunkRecord::eUseMtl:
+        {
+            int  newMaterialId = -1;
+            auto found         = materialMap.find(record.text);
+            if (found != materialMap.end())
+                newMaterialId = found->second;
+
+            if (newMaterialId != material)
+            {
+                export_faces(&shape, pendingFaces, arrays, material, name);
+                pendingFaces.clear();
+                material = newMaterialId;
+            }
+            break;
+        }
+        case ObjChunkRecord::eMtlLib:
+        {
+            std::vector<std::string> mtlFiles;
+            tinyobj::SplitString(record.text, ' ', mtlFiles);
+            for (const auto& mtlFile : mtlFiles)
+            {
+                std::string warn, err;
+                if (matFileReader(mtlFile.c_str(), &materials, &materialMap, &warn, &err))
+                    break;
+            }
+            break;
+        }
+        case ObjChunkRecord::eGroup:
+        {
+            export_faces(&shape, pendingFaces, arrays, material, name);
+            if (shape.mesh.indices.size() > 0)
+                shapes.push_back(std::move(shape));
+
+            shape = tinyobj::shape_t();
+            pendingFaces.clear();
+
+            std::vector<std::string> names;
+            const char*              token = record.text.c_str();
+            while (!IS_NEW_LINE(token[0]))
+            {
+                names.push_back(tinyobj::parseString(&token));
+                token += strspn(token, " \t\r");
+            }
+
+            name.clear();
+            for (size_t i = 1; i < names.size(); i++)
+                name += (i > 1 ? " " : "") + names[i];
+            break;
+        }
+        case ObjChunkRecord::eObject:
+        {
+            export_faces(&shape, pendingFaces, arrays, material, name);
+            if (shape.mesh.indices.size() > 0)
+                shapes.push_back(std::move(shape));
+
+            pendingFaces.clear();
+            shape = tinyobj::shape_t();
+            name  = record.text;
+            break;
+        }
+        case ObjChunkRecord::eSmoothing:
+            smoothingId = record.value;
+            break;
+        }
+    };
+
+    for (const auto& chunk : chunks)
+    {
+        size_t record = 0;
+        for (size_t f = chunk.firstFace; f < chunk.firstFace + chunk.nbFaces; ++f)
+        {
+            while (record < chunk.records.size() && chunk.records[record].face == f)
+                applyRecord(chunk.records[record++]);
+
+            pendingFaces.push_back({ static_cast<uint32_t>(f), smoothingId });
+        }
+
+        while (record < chunk.records.size())
+            applyRecord(chunk.records[record++]);
+    }
+
+    if (export_faces(&shape, pendingFaces, arrays, material, name) || shape.mesh.indices.size())
+        shapes.push_back(std::move(shape));
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Parsing the OBJ, in parallel chunks or with tinyobj
+//
+void ObjLoader::parseObj(const std::string& filename)
+{
+    tinyobj::attrib_t                attrib;
+    std::vector<tinyobj::shape_t>    shapes;
+    std::vector<tinyobj::material_t> materials;
+
+    if (m_parallelParse && parse_obj_parallel(filename, attrib, shapes, materials))
+    {
+        convertObj(attrib, shapes, materials);
+        return;
+    }
+
     tinyobj::ObjReader reader;
     reader.ParseFromFile(filename);
     if (!reader.Valid())
@@ -43,8 +1231,17 @@ void ObjLoader::loadModel(const std::string& filename)
         assert(reader.Valid());
     }
 
+    convertObj(reader.GetAttrib(), reader.GetShapes(), reader.GetMaterials());
+}
+
+//-----------------------------------------------------------------------------
+// Converting the tinyobj representation to the arrays of the loader
+//
+void ObjLoader::convertObj(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes,
+                           const std::vector<tinyobj::material_t>& materials)
+{
     // Collecting the material in the scene
-    for (const auto& material : reader.GetMaterials())
+    for (const auto& material : materials)
     {
         MaterialObj m;
         m.ambient = glm::vec3(material.ambient[0], material.ambient[1], material.ambient[2]);
@@ -70,65 +1267,340 @@ void ObjLoader::loadModel(const std::string& filename)
     if (m_materials.empty())
         m_materials.emplace_back(MaterialObj());
 
-    const tinyobj::attrib_t& attrib = reader.GetAttrib();
+    const bool computeNormals = attrib.normals.empty();
+
+    // Welding identical vertices, each unique (pos, nrm, color, texCoord)
+    // tuple is stored once and referenced by the index buffer
+    std::unordered_map<VertexObj, uint32_t, VertexObjHash> uniqueVertices;
+    uniqueVertices.reserve(attrib.vertices.size() / 3);
+
+    // OBJ position of each welded vertex, to smooth across texture seams
+    std::vector<uint32_t> positionIds;
 
-    for (const auto& shape : reader.GetShapes())
+    for (const auto& shape : shapes)
     {
-        m_vertices.reserve(shape.mesh.indices.size() + m_vertices.size());
         m_indices.reserve(shape.mesh.indices.size() + m_indices.size());
         m_matIndx.insert(m_matIndx.end(), shape.mesh.material_ids.begin(),
             shape.mesh.material_ids.end());
 
-        for (const auto& index : shape.mesh.indices)
+        // Faces are triangulated by tinyobj, always 3 indices per face
+        for (size_t i = 0; i + 2 < shape.mesh.indices.size(); i += 3)
         {
-            VertexObj    vertex = {};
-            const float* vp = &attrib.vertices[3 * index.vertex_index];
-            vertex.pos = { *(vp + 0), *(vp + 1), *(vp + 2) };
+            VertexObj triangle[3] = {};
 
-            if (!attrib.normals.empty() && index.normal_index >= 0)
+            for (size_t k = 0; k < 3; ++k)
             {
-                const float* np = &attrib.normals[3 * index.normal_index];
-                vertex.nrm = { *(np + 0), *(np + 1), *(np + 2) };
-            }
+                const tinyobj::index_t& index  = shape.mesh.indices[i + k];
+                VertexObj&              vertex = triangle[k];
 
-            if (!attrib.texcoords.empty() && index.texcoord_index >= 0)
-            {
-                const float* tp = &attrib.texcoords[2 * index.texcoord_index + 0];
-                vertex.texCoord = { *tp, 1.0f - *(tp + 1) };
+                const float* vp = &attrib.vertices[3 * index.vertex_index];
+                vertex.pos = { *(vp + 0), *(vp + 1), *(vp + 2) };
+
+                if (!attrib.normals.empty() && index.normal_index >= 0)
+                {
+                    const float* np = &attrib.normals[3 * index.normal_index];
+                    vertex.nrm = { *(np + 0), *(np + 1), *(np + 2) };
+                }
+
+                if (!attrib.texcoords.empty() && index.texcoord_index >= 0)
+                {
+                    const float* tp = &attrib.texcoords[2 * index.texcoord_index + 0];
+                    vertex.texCoord = { *tp, 1.0f - *(tp + 1) };
+                }
+
+                if (!attrib.colors.empty())
+                {
+                    const float* vc = &attrib.colors[3 * index.vertex_index];
+                    vertex.color = { *(vc + 0), *(vc + 1), *(vc + 2) };
+                }
             }
 
-            if (!attrib.colors.empty())
+            for (size_t k = 0; k < 3; ++k)
             {
-                const float* vc = &attrib.colors[3 * index.vertex_index];
-                vertex.color = { *(vc + 0), *(vc + 1), *(vc + 2) };
-            }
+                auto inserted = uniqueVertices.emplace(triangle[k], static_cast<uint32_t>(m_vertices.size()));
+                if (inserted.second)
+                {
+                    m_vertices.push_back(triangle[k]);
+                    if (computeNormals)
+                        positionIds.push_back(static_cast<uint32_t>(shape.mesh.indices[i + k].vertex_index));
+                }
 
-            m_vertices.push_back(vertex);
-            m_indices.push_back(static_cast<int>(m_indices.size()));
+                m_indices.push_back(inserted.first->second);
+            }
         }
     }
 
+    // Compute normals when no normal were provided, on the welded vertices
+    if (computeNormals)
+        generateNormals(positionIds, attrib.vertices.size() / 3);
+
     // Fixing material indices
     for (auto& mi : m_matIndx)
     {
         if (mi < 0 || mi > m_materials.size())
             mi = 0;
     }
+}
+
+//-----------------------------------------------------------------------------
+// Normal generation
+// Face normals and corner weights are computed 4 triangles at a time from
+// SoA positions. Each corner then sums the weighted normals of the faces
+// sharing its OBJ position, skipping faces beyond the crease angle.
+// Vertices whose corners end up with different normals are split.
+//
+static const size_t OBJ_NORMAL_BLOCK_SIZE = 4096;
+
+// Split [0, count) in blocks processed on the thread pool
+template <typename F>
+static void parallel_blocks(size_t count, F&& fn)
+{
+    const size_t nbBlocks = (count + OBJ_NORMAL_BLOCK_SIZE - 1) / OBJ_NORMAL_BLOCK_SIZE;
+    tools::ThreadPool::Singleton().parallelFor(nbBlocks, [&](size_t block) {
+        const size_t begin = block * OBJ_NORMAL_BLOCK_SIZE;
+        fn(begin, std::min(count, begin + OBJ_NORMAL_BLOCK_SIZE));
+    });
+}
+
+// Angle between two edges given their dot product and squared lengths
+static inline float corner_angle(float dot, float len2A, float len2B)
+{
+    const float len = std::sqrt(len2A * len2B);
+    return len > 0.0f ? std::acos(std::max(-1.0f, std::min(1.0f, dot / len))) : 0.0f;
+}
+
+// Unit face normals of triangles [begin, end) and the weight of each corner,
+// either the corner angle or the face area
+static void compute_face_normals(size_t begin, size_t end, const uint32_t* indices,
+    const float* px, const float* py, const float* pz, bool angleWeighted,
+    glm::vec3* faceNormals, float* cornerWeights)
+{
+    size_t t = begin;
+
+#ifdef OBJ_USE_SSE
+    for (; t + 4 <= end; t += 4)
+    {
+        alignas(16) float x[3][4], y[3][4], z[3][4];
+        for (size_t lane = 0; lane < 4; ++lane)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                const uint32_t v = indices[3 * (t + lane) + k];
+                x[k][lane]       = px[v];
+                y[k][lane]       = py[v];
+                z[k][lane]       = pz[v];
+            }
+        }
+
+        // Edges p0->p1, p0->p2 and p1->p2
+        const __m128 e0x = _mm_sub_ps(_mm_load_ps(x[1]), _mm_load_ps(x[0]));
+        const __m128 e0y = _mm_sub_ps(_mm_load_ps(y[1]), _mm_load_ps(y[0]));
+        const __m128 e0z = _mm_sub_ps(_mm_load_ps(z[1]), _mm_load_ps(z[0]));
+        const __m128 e1x = _mm_sub_ps(_mm_load_ps(x[2]), _mm_load_ps(x[0]));
+        const __m128 e1y = _mm_sub_ps(_mm_load_ps(y[2]), _mm_load_ps(y[0]));
+        const __m128 e1z = _mm_sub_ps(_mm_load_ps(z[2]), _mm_load_ps(z[0]));
+
+        // Cross product, its length is twice the area
+        const __m128 nx   = _mm_sub_ps(_mm_mul_ps(e0y, e1z), _mm_mul_ps(e0z, e1y));
+        const __m128 ny   = _mm_sub_ps(_mm_mul_ps(e0z, e1x), _mm_mul_ps(e0x, e1z));
+        const __m128 nz   = _mm_sub_ps(_mm_mul_ps(e0x, e1y), _mm_mul_ps(e0y, e1x));
+        const __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+        const __m128 len  = _mm_sqrt_ps(len2);
+
+        // Degenerated triangles get a null normal and weight
+        const __m128 valid = _mm_cmpgt_ps(len, _mm_setzero_ps());
+        const __m128 inv   = _mm_and_ps(valid, _mm_div_ps(_mm_set1_ps(1.0f), len));
+
+        alignas(16) float n[3][4], area[4];
+        _mm_store_ps(n[0], _mm_mul_ps(nx, inv));
+        _mm_store_ps(n[1], _mm_mul_ps(ny, inv));
+        _mm_store_ps(n[2], _mm_mul_ps(nz, inv));
+        _mm_store_ps(area, _mm_mul_ps(len, _mm_set1_ps(0.5f)));
+
+        alignas(16) float d0[4], d1[4], d2[4], l0[4], l1[4], l2[4];
+        if (angleWeighted)
+        {
+            const __m128 e2x = _mm_sub_ps(e1x, e0x);
+            const __m128 e2y = _mm_sub_ps(e1y, e0y);
+            const __m128 e2z = _mm_sub_ps(e1z, e0z);
+
+            auto dot = [](__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz) {
+                return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+            };
+
+            // Corner 0 between e0 and e1, corner 1 between -e0 and e2, corner 2 between -e1 and -e2
+            _mm_store_ps(d0, dot(e0x, e0y, e0z, e1x, e1y, e1z));
+            _mm_store_ps(d1, _mm_sub_ps(_mm_setzero_ps(), dot(e0x, e0y, e0z, e2x, e2y, e2z)));
+            _mm_store_ps(d2, dot(e1x, e1y, e1z, e2x, e2y, e2z));
+            _mm_store_ps(l0, dot(e0x, e0y, e0z, e0x, e0y, e0z));
+            _mm_store_ps(l1, dot(e1x, e1y, e1z, e1x, e1y, e1z));
+            _mm_store_ps(l2, dot(e2x, e2y, e2z, e2x, e2y, e2z));
+        }
+
+        for (size_t lane = 0; lane < 4; ++lane)
+        {
+            const size_t face = t + lane;
+            faceNormals[face] = { n[0][lane], n[1][lane], n[2][lane] };
+
+            if (angleWeighted && area[lane] > 0.0f)
+            {
+                cornerWeights[3 * face + 0] = corner_angle(d0[lane], l0[lane], l1[lane]);
+                cornerWeights[3 * face + 1] = corner_angle(d1[lane], l0[lane], l2[lane]);
+                cornerWeights[3 * face + 2] = corner_angle(d2[lane], l1[lane], l2[lane]);
+            }
+            else
+            {
+                cornerWeights[3 * face + 0] = area[lane];
+                cornerWeights[3 * face + 1] = area[lane];
+                cornerWeights[3 * face + 2] = area[lane];
+            }
+        }
+    }
+#endif
+
+    // Remaining triangles
+    for (; t < end; ++t)
+    {
+        glm::vec3 p[3];
+        for (size_t k = 0; k < 3; ++k)
+        {
+            const uint32_t v = indices[3 * t + k];
+            p[k]             = { px[v], py[v], pz[v] };
+        }
+
+        const glm::vec3 e0  = p[1] - p[0];
+        const glm::vec3 e1  = p[2] - p[0];
+        const glm::vec3 e2  = p[2] - p[1];
+        const glm::vec3 n   = glm::cross(e0, e1);
+        const float     len = glm::length(n);
+
+        faceNormals[t] = len > 0.0f ? n / len : glm::vec3(0.0f);
+
+        if (angleWeighted && len > 0.0f)
+        {
+            cornerWeights[3 * t + 0] = corner_angle(glm::dot(e0, e1), glm::dot(e0, e0), glm::dot(e1, e1));
+            cornerWeights[3 * t + 1] = corner_angle(-glm::dot(e0, e2), glm::dot(e0, e0), glm::dot(e2, e2));
+            cornerWeights[3 * t + 2] = corner_angle(glm::dot(e1, e2), glm::dot(e1, e1), glm::dot(e2, e2));
+        }
+        else
+        {
+            cornerWeights[3 * t + 0] = 0.5f * len;
+            cornerWeights[3 * t + 1] = 0.5f * len;
+            cornerWeights[3 * t + 2] = 0.5f * len;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Smooth normals of the welded vertices, positionIds is the OBJ position of
+// each vertex: vertices on both sides of a texture seam are smoothed together
+//
+void ObjLoader::generateNormals(const std::vector<uint32_t>& positionIds, size_t nbPositions)
+{
+    const size_t nbVertices  = m_vertices.size();
+    const size_t nbCorners   = m_indices.size();
+    const size_t nbTriangles = nbCorners / 3;
+    if (nbTriangles == 0)
+        return;
+
+    // SoA positions
+    std::vector<float> px(nbVertices), py(nbVertices), pz(nbVertices);
+    parallel_blocks(nbVertices, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v)
+        {
+            px[v] = m_vertices[v].pos.x;
+            py[v] = m_vertices[v].pos.y;
+            pz[v] = m_vertices[v].pos.z;
+        }
+    });
+
+    std::vector<glm::vec3> faceNormals(nbTriangles);
+    std::vector<float>     cornerWeights(nbCorners);
+    parallel_blocks(nbTriangles, [&](size_t begin, size_t end) {
+        compute_face_normals(begin, end, m_indices.data(), px.data(), py.data(), pz.data(),
+                             m_angleWeightedNormals, faceNormals.data(), cornerWeights.data());
+    });
+
+    // Corners sharing each position (CSR)
+    std::vector<uint32_t> positionCorners(nbCorners);
+    std::vector<uint32_t> positionOffsets(nbPositions + 1, 0);
+    for (size_t c = 0; c < nbCorners; ++c)
+        positionOffsets[positionIds[m_indices[c]] + 1]++;
+    for (size_t p = 0; p < nbPositions; ++p)
+        positionOffsets[p + 1] += positionOffsets[p];
+    {
+        std::vector<uint32_t> cursor(positionOffsets.begin(), positionOffsets.end() - 1);
+        for (size_t c = 0; c < nbCorners; ++c)
+            positionCorners[cursor[positionIds[m_indices[c]]]++] = static_cast<uint32_t>(c);
+    }
+
+    auto sumNormals = [&](uint32_t position, size_t face, float minDot) {
+        // Degenerated faces take the normal of all their neighbors
+        if (faceNormals[face] == glm::vec3(0.0f))
+            minDot = -2.0f;
+
+        glm::vec3 n(0.0f);
+        for (uint32_t i = positionOffsets[position]; i < positionOffsets[position + 1]; ++i)
+        {
+            const uint32_t corner = positionCorners[i];
+            const size_t   other  = corner / 3;
+            if (glm::dot(faceNormals[face], faceNormals[other]) >= minDot)
+                n += faceNormals[other] * cornerWeights[corner];
+        }
+        const float len = glm::length(n);
+        return len > 0.0f ? n / len : faceNormals[face];
+    };
+
+    // Without crease, all corners of a position share the same normal
+    if (m_creaseAngle >= 180.0f)
+    {
+        parallel_blocks(nbVertices, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; ++v)
+            {
+                const uint32_t position = positionIds[v];
+                const uint32_t first    = positionCorners[positionOffsets[position]];
+                m_vertices[v].nrm       = sumNormals(position, first / 3, -2.0f);
+            }
+        });
+        return;
+    }
 
+    const float            minDot = std::cos(glm::radians(std::max(0.0f, m_creaseAngle)));
+    std::vector<glm::vec3> cornerNormals(nbCorners);
+    parallel_blocks(nbCorners, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c)
+            cornerNormals[c] = sumNormals(positionIds[m_indices[c]], c / 3, minDot);
+    });
 
-    // Compute normal when no normal were provided.
-    if (attrib.normals.empty())
+    // Splitting the vertices shared by corners with different normals,
+    // the copies of a vertex are chained through nextCopy
+    std::vector<uint8_t>  assigned(nbVertices, 0);
+    std::vector<uint32_t> nextCopy(nbVertices, ~0u);
+    for (size_t c = 0; c < nbCorners; ++c)
     {
-        for (size_t i = 0; i < m_indices.size(); i += 3)
+        uint32_t         v = m_indices[c];
+        const glm::vec3& n = cornerNormals[c];
+
+        if (!assigned[v])
         {
-            VertexObj& v0 = m_vertices[m_indices[i + 0]];
-            VertexObj& v1 = m_vertices[m_indices[i + 1]];
-            VertexObj& v2 = m_vertices[m_indices[i + 2]];
+            m_vertices[v].nrm = n;
+            assigned[v]       = 1;
+            continue;
+        }
+
+        while (m_vertices[v].nrm != n && nextCopy[v] != ~0u)
+            v = nextCopy[v];
 
-            glm::vec3 n = glm::normalize(glm::cross((v1.pos - v0.pos), (v2.pos - v0.pos)));
-            v0.nrm = n;
-            v1.nrm = n;
-            v2.nrm = n;
+        if (m_vertices[v].nrm != n)
+        {
+            VertexObj copy = m_vertices[v];
+            copy.nrm       = n;
+            nextCopy[v]    = static_cast<uint32_t>(m_vertices.size());
+            v              = nextCopy[v];
+            m_vertices.push_back(copy);
+            nextCopy.push_back(~0u);
         }
+
+        m_indices[c] = v;
     }
-}
\ No newline at end of file
+}
@@ -5,7 +5,11 @@
 #pragma once
 #include "tiny_obj_loader.h"
 #include "glm/glm.hpp"
+#include "../general_helpers/mappedfile.hpp"
+#include "../general_helpers/meshoptimize.hpp"
+#include "../general_helpers/meshsimplify.hpp"
 #include <array>
+#include <cstring>
 #include <iostream>
 #include <unordered_map>
 #include <vector>
@@ -24,6 +28,9 @@ struct MaterialObj
         // illumination model (see http://www.fileformat.info/format/material/)
     int illum = 0;
     int textureID = -1;
+    // Rectangle of the texture in its image, smaller when packed in an atlas
+    glm::vec2 uvScale = glm::vec2(1.f, 1.f);
+    glm::vec2 uvOffset = glm::vec2(0.f, 0.f);
 };
 // OBJ representation of a vertex
 struct VertexObj
@@ -32,6 +39,28 @@ struct VertexObj
     glm::vec3 nrm;
     glm::vec3 color;
     glm::vec2 texCoord;
+
+    bool operator==(const VertexObj& other) const
+    {
+        return memcmp(this, &other, sizeof(VertexObj)) == 0;
+    }
+};
+
+// Hash of all the attributes of a vertex, used for welding
+struct VertexObjHash
+{
+    size_t operator()(const VertexObj& vertex) const
+    {
+        // FNV-1a over the raw bits of the vertex
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&vertex);
+        uint64_t       hash  = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(VertexObj); ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return static_cast<size_t>(hash);
+    }
 };
 
 
@@ -42,14 +71,85 @@ struct shapeObj
     uint32_t matIndex;
 };
 
+// Level of detail, a range of the index buffer over the same vertices
+struct ObjLod
+{
+    uint32_t firstIndex;
+    uint32_t nbIndices;
+    float    error; // largest distance to the full mesh, in object units
+};
+
+// View over a contiguous array, owned by the loader or mapped from the cache
+template <typename T>
+struct ObjArray
+{
+    const T* data  = nullptr;
+    size_t   count = 0;
+
+    size_t sizeBytes() const { return count * sizeof(T); }
+};
+
 class ObjLoader
 {
 public:
     void loadModel(const std::string& filename);
 
+    // Arrays to upload, valid as long as the loader lives
+    ObjArray<VertexObj> getVertices() const;
+    ObjArray<uint32_t>  getIndices() const;
+    ObjArray<uint32_t>  getMatIndices() const;
+
+    // True when the geometry was read from the binary cache
+    bool isCached() const { return m_cache.isOpen(); }
+
+    // Read and write '<filename>.objcache' next to the OBJ
+    bool m_useCache = true;
+
+    // Parse the OBJ in chunks on the thread pool instead of tinyobj::ObjReader
+    bool m_parallelParse = true;
+
+    // Normals generated when the OBJ has none, weighted by the corner angle
+    // (or the face area). Faces further apart than the crease angle, in
+    // degrees, are not smoothed together: 180 is fully smooth, 0 is flat.
+    // The default keeps the edges of boxes and low-poly props hard.
+    float m_creaseAngle          = 60.0f;
+    bool  m_angleWeightedNormals = true;
+
+    // Reorder triangles and vertices for the vertex cache, overdraw and
+    // vertex fetch, with the cache efficiency before and after
+    bool                          m_optimizeMesh = true;
+    tools::mesh::VertexCacheStats m_vertexCacheBefore;
+    tools::mesh::VertexCacheStats m_vertexCacheAfter;
+
+    // Simplified levels of detail appended to the indices and material
+    // indices, each with about half the triangles of the previous one.
+    // m_lods[0] is the full mesh.
+    bool                m_generateLods = true;
+    uint32_t            m_maxLods      = 5;
+    std::vector<ObjLod> m_lods;
+
     std::vector<VertexObj>   m_vertices;
     std::vector<uint32_t>    m_indices;
     std::vector<MaterialObj> m_materials;
     std::vector<std::string> m_textures;
     std::vector<uint32_t>    m_matIndx;
-};
\ No newline at end of file
+
+private:
+    void parseObj(const std::string& filename);
+    void convertObj(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes,
+                    const std::vector<tinyobj::material_t>& materials);
+    void generateNormals(const std::vector<uint32_t>& positionIds, size_t nbPositions);
+    void optimizeMesh();
+    void generateLods();
+
+    bool loadCache(const std::string& filename);
+    void saveCache(const std::string& filename) const;
+
+    tools::MappedFile m_cache;
+    size_t            m_cacheVertexOffset{ 0 };
+    size_t            m_cacheIndexOffset{ 0 };
+    size_t            m_cacheMatIndxOffset{ 0 };
+    size_t            m_cacheNbVertices{ 0 };
+    size_t            m_cacheNbIndices{ 0 };
+    size_t            m_cacheNbMatIndx{ 0 };
+};
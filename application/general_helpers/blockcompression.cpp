@@ -0,0 +1,547 @@
+/*
+ *
+ * Andrew Frost
+ * blockcompression.cpp
+ * 2020
+ *
+ */
+
+#include "blockcompression.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <string.h>
+
+namespace tools {
+namespace texture {
+
+// Pixels of a 4x4 block, RGBA
+typedef uint8_t BlockPixels[16][4];
+
+//////////////////////////////////////////////////////////////////////////
+// Encoding helpers                                                     //
+//////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// Copy of a block, repeating the last column and row at the edges
+//
+static void fetchBlock(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, BlockPixels block)
+{
+    for (uint32_t y = 0; y < 4; ++y) {
+        const uint32_t sy = std::min(by * 4 + y, height - 1);
+        for (uint32_t x = 0; x < 4; ++x) {
+            const uint32_t sx = std::min(bx * 4 + x, width - 1);
+            memcpy(block[y * 4 + x], &rgba[(static_cast<size_t>(sy) * width + sx) * 4], 4);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// Endpoints at the extremes of the principal axis of the block colors,
+// over the first 'nbChannels' channels
+//
+static void principalEndpoints(const BlockPixels block, int nbChannels, float e0[4], float e1[4])
+{
+    float mean[4] = { 0.f, 0.f, 0.f, 0.f };
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < nbChannels; ++c)
+            mean[c] += block[i][c] / 16.f;
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        float d[4];
+        for (int c = 0; c < nbChannels; ++c)
+            d[c] = block[i][c] - mean[c];
+        for (int a = 0; a < nbChannels; ++a)
+            for (int b = 0; b < nbChannels; ++b)
+                cov[a][b] += d[a] * d[b];
+    }
+
+    // Power iteration, starting from the channel with the largest variance
+    float axis[4] = { 0.f, 0.f, 0.f, 0.f };
+    int   widest  = 0;
+    for (int c = 1; c < nbChannels; ++c)
+        if (cov[c][c] > cov[widest][widest])
+            widest = c;
+    axis[widest] = 1.f;
+
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = { 0.f, 0.f, 0.f, 0.f };
+        float length  = 0.f;
+        for (int a = 0; a < nbChannels; ++a) {
+            for (int b = 0; b < nbChannels; ++b)
+                next[a] += cov[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+        if (length == 0.f)
+            break;
+        length = 1.f / std::sqrt(length);
+        for (int c = 0; c < nbChannels; ++c)
+            axis[c] = next[c] * length;
+    }
+
+    float tMin = FLT_MAX, tMax = -FLT_MAX;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.f;
+        for (int c = 0; c < nbChannels; ++c)
+            t += (block[i][c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+
+    for (int c = 0; c < 4; ++c) {
+        e0[c] = c < nbChannels ? std::min(255.f, std::max(0.f, mean[c] + axis[c] * tMax)) : 255.f;
+        e1[c] = c < nbChannels ? std::min(255.f, std::max(0.f, mean[c] + axis[c] * tMin)) : 255.f;
+    }
+}
+
+//-------------------------------------------------------------------------
+// Least squares endpoints for fixed interpolation weights of e1,
+// false when the system is singular (e.g. all weights equal)
+//
+static bool fitEndpoints(const BlockPixels block, int nbChannels, const float weights[16], float e0[4], float e1[4])
+{
+    float aa = 0.f, ab = 0.f, bb = 0.f;
+    float ax[4] = { 0.f, 0.f, 0.f, 0.f };
+    float bx[4] = { 0.f, 0.f, 0.f, 0.f };
+
+    for (int i = 0; i < 16; ++i) {
+        const float b = weights[i];
+        const float a = 1.f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < nbChannels; ++c) {
+            ax[c] += a * block[i][c];
+            bx[c] += b * block[i][c];
+        }
+    }
+
+    const float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f)
+        return false;
+
+    for (int c = 0; c < nbChannels; ++c) {
+        e0[c] = std::min(255.f, std::max(0.f, (ax[c] * bb - bx[c] * ab) / det));
+        e1[c] = std::min(255.f, std::max(0.f, (bx[c] * aa - ax[c] * ab) / det));
+    }
+    return true;
+}
+
+// Bits written from the least significant bit of the first byte
+struct BitWriter
+{
+    uint8_t* data;
+    uint32_t position{ 0 };
+
+    void write(uint32_t value, uint32_t nbBits)
+    {
+        for (uint32_t b = 0; b < nbBits; ++b, ++position)
+            if ((value >> b) & 1)
+                data[position >> 3] |= static_cast<uint8_t>(1 << (position & 7));
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////
+// BC1                                                                  //
+//////////////////////////////////////////////////////////////////////////
+
+static uint16_t packRGB565(const float color[3])
+{
+    const uint32_t r = static_cast<uint32_t>(color[0] * 31.f / 255.f + 0.5f);
+    const uint32_t g = static_cast<uint32_t>(color[1] * 63.f / 255.f + 0.5f);
+    const uint32_t b = static_cast<uint32_t>(color[2] * 31.f / 255.f + 0.5f);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(uint16_t packed, int color[3])
+{
+    const int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0]    = (r << 3) | (r >> 2);
+    color[1]    = (g << 2) | (g >> 4);
+    color[2]    = (b << 3) | (b >> 2);
+}
+
+//-------------------------------------------------------------------------
+// Four color mode, indices of the packed endpoints and their error
+//
+static uint32_t bc1Indices(const BlockPixels block, uint16_t c0, uint16_t c1, uint32_t& error)
+{
+    int palette[4][3];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    error            = 0;
+    for (int i = 0; i < 16; ++i) {
+        uint32_t best = 0, bestError = UINT32_MAX;
+        for (uint32_t p = 0; p < 4; ++p) {
+            uint32_t e = 0;
+            for (int c = 0; c < 3; ++c)
+                e += (block[i][c] - palette[p][c]) * (block[i][c] - palette[p][c]);
+            if (e < bestError) {
+                bestError = e;
+                best      = p;
+            }
+        }
+        indices |= best << (2 * i);
+        error += bestError;
+    }
+    return indices;
+}
+
+static void encodeBC1(const BlockPixels block, uint8_t* out)
+{
+    // Interpolation weight of c1 for each index
+    static const float weightOfIndex[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+
+    float e0[4], e1[4];
+    principalEndpoints(block, 3, e0, e1);
+
+    uint16_t bestC0 = 0, bestC1 = 0;
+    uint32_t bestIndices = 0, bestError = UINT32_MAX;
+
+    for (int iteration = 0; iteration < 3; ++iteration) {
+        uint16_t c0 = packRGB565(e0);
+        uint16_t c1 = packRGB565(e1);
+
+        // c0 > c1 selects the four color mode
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        uint32_t error;
+        uint32_t indices = c0 == c1 ? 0 : bc1Indices(block, c0, c1, error);
+        if (c0 == c1) {
+            int color[3];
+            unpackRGB565(c0, color);
+            error = 0;
+            for (int i = 0; i < 16; ++i)
+                for (int c = 0; c < 3; ++c)
+                    error += (block[i][c] - color[c]) * (block[i][c] - color[c]);
+        }
+
+        if (error < bestError) {
+            bestError   = error;
+            bestC0      = c0;
+            bestC1      = c1;
+            bestIndices = indices;
+        }
+        if (bestError == 0 || c0 == c1)
+            break;
+
+        float weights[16];
+        for (int i = 0; i < 16; ++i)
+            weights[i] = weightOfIndex[(indices >> (2 * i)) & 3];
+        if (!fitEndpoints(block, 3, weights, e0, e1))
+            break;
+    }
+
+    out[0] = static_cast<uint8_t>(bestC0 & 0xff);
+    out[1] = static_cast<uint8_t>(bestC0 >> 8);
+    out[2] = static_cast<uint8_t>(bestC1 & 0xff);
+    out[3] = static_cast<uint8_t>(bestC1 >> 8);
+    for (int b = 0; b < 4; ++b)
+        out[4 + b] = static_cast<uint8_t>(bestIndices >> (8 * b));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// BC5                                                                  //
+//////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// One BC4 channel in the eight value mode
+//
+static void encodeBC4(const BlockPixels block, int channel, uint8_t* out)
+{
+    int minValue = 255, maxValue = 0;
+    for (int i = 0; i < 16; ++i) {
+        minValue = std::min<int>(minValue, block[i][channel]);
+        maxValue = std::max<int>(maxValue, block[i][channel]);
+    }
+
+    out[0] = static_cast<uint8_t>(maxValue);
+    out[1] = static_cast<uint8_t>(minValue);
+    memset(out + 2, 0, 6);
+    if (maxValue == minValue)
+        return;
+
+    int palette[8] = { maxValue, minValue };
+    for (int p = 2; p < 8; ++p)
+        palette[p] = ((8 - p) * maxValue + (p - 1) * minValue) / 7;
+
+    BitWriter writer{ out + 2 };
+    for (int i = 0; i < 16; ++i) {
+        uint32_t best = 0;
+        int      bestError = INT32_MAX;
+        for (uint32_t p = 0; p < 8; ++p) {
+            const int e = std::abs(block[i][channel] - palette[p]);
+            if (e < bestError) {
+                bestError = e;
+                best      = p;
+            }
+        }
+        writer.write(best, 3);
+    }
+}
+
+static void encodeBC5(const BlockPixels block, uint8_t* out)
+{
+    encodeBC4(block, 0, out);
+    encodeBC4(block, 1, out + 8);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// BC7                                                                  //
+//////////////////////////////////////////////////////////////////////////
+// Mode 6 only: one subset, 7 bit RGBA endpoints with a parity bit each //
+// and 4 bit indices, which suits smooth color and alpha content        //
+//////////////////////////////////////////////////////////////////////////
+
+static const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BC7Mode6
+{
+    uint8_t  endpoints[2][4]; // 7 bits
+    uint8_t  parity[2];
+    uint8_t  indices[16];
+    uint32_t error;
+};
+
+//-------------------------------------------------------------------------
+// Quantized endpoints for the given parities, then the closest indices
+//
+static void bc7Evaluate(const BlockPixels block, const float e0[4], const float e1[4], BC7Mode6& mode)
+{
+    int color[2][4];
+    for (int e = 0; e < 2; ++e) {
+        const float* source = e == 0 ? e0 : e1;
+        for (int c = 0; c < 4; ++c) {
+            const int q = std::min(127, std::max(0, static_cast<int>((source[c] - mode.parity[e]) * 0.5f + 0.5f)));
+            mode.endpoints[e][c] = static_cast<uint8_t>(q);
+            color[e][c]          = (q << 1) | mode.parity[e];
+        }
+    }
+
+    int palette[16][4];
+    for (int p = 0; p < 16; ++p)
+        for (int c = 0; c < 4; ++c)
+            palette[p][c] = ((64 - BC7_WEIGHTS4[p]) * color[0][c] + BC7_WEIGHTS4[p] * color[1][c] + 32) >> 6;
+
+    mode.error = 0;
+    for (int i = 0; i < 16; ++i) {
+        uint32_t best = 0, bestError = UINT32_MAX;
+        for (uint32_t p = 0; p < 16; ++p) {
+            uint32_t e = 0;
+            for (int c = 0; c < 4; ++c)
+                e += (block[i][c] - palette[p][c]) * (block[i][c] - palette[p][c]);
+            if (e < bestError) {
+                bestError = e;
+                best      = p;
+            }
+        }
+        mode.indices[i] = static_cast<uint8_t>(best);
+        mode.error += bestError;
+    }
+}
+
+//-------------------------------------------------------------------------
+// Best of the four parity combinations
+//
+static BC7Mode6 bc7Quantize(const BlockPixels block, const float e0[4], const float e1[4])
+{
+    BC7Mode6 best = {};
+    best.error    = UINT32_MAX;
+    for (uint8_t p = 0; p < 4; ++p) {
+        BC7Mode6 mode  = {};
+        mode.parity[0] = p & 1;
+        mode.parity[1] = p >> 1;
+        bc7Evaluate(block, e0, e1, mode);
+        if (mode.error < best.error)
+            best = mode;
+    }
+    return best;
+}
+
+static void encodeBC7(const BlockPixels block, uint8_t* out)
+{
+    float e0[4], e1[4];
+    principalEndpoints(block, 4, e0, e1);
+
+    BC7Mode6 best = bc7Quantize(block, e0, e1);
+    for (int iteration = 0; iteration < 2 && best.error > 0; ++iteration) {
+        float weights[16];
+        for (int i = 0; i < 16; ++i)
+            weights[i] = BC7_WEIGHTS4[best.indices[i]] / 64.f;
+        if (!fitEndpoints(block, 4, weights, e0, e1))
+            break;
+
+        BC7Mode6 refined = bc7Quantize(block, e0, e1);
+        if (refined.error >= best.error)
+            break;
+        best = refined;
+    }
+
+    // The most significant bit of the first index is implicit and zero
+    if (best.indices[0] >= 8) {
+        std::swap(best.endpoints[0], best.endpoints[1]);
+        std::swap(best.parity[0], best.parity[1]);
+        for (auto& index : best.indices)
+            index = static_cast<uint8_t>(15 - index);
+    }
+
+    memset(out, 0, 16);
+    BitWriter writer{ out };
+    writer.write(1 << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        writer.write(best.endpoints[0][c], 7);
+        writer.write(best.endpoints[1][c], 7);
+    }
+    writer.write(best.parity[0], 1);
+    writer.write(best.parity[1], 1);
+    writer.write(best.indices[0], 3);
+    for (int i = 1; i < 16; ++i)
+        writer.write(best.indices[i], 4);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Mip chain                                                            //
+//////////////////////////////////////////////////////////////////////////
+
+static float srgbToLinear(uint8_t value)
+{
+    const float v = value / 255.f;
+    return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+}
+
+static uint8_t linearToSrgb(float value)
+{
+    const float v = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+    return static_cast<uint8_t>(std::min(255.f, std::max(0.f, v * 255.f + 0.5f)));
+}
+
+//-------------------------------------------------------------------------
+// 2x2 box filter, the color of sRGB images is averaged in linear space
+//
+std::vector<uint8_t> downsample(const uint8_t* source, uint32_t width, uint32_t height, bool srgb,
+                                uint32_t& outWidth, uint32_t& outHeight)
+{
+    static const std::vector<float> linear = [] {
+        std::vector<float> table(256);
+        for (int i = 0; i < 256; ++i)
+            table[i] = srgbToLinear(static_cast<uint8_t>(i));
+        return table;
+    }();
+
+    outWidth  = std::max(1u, width / 2);
+    outHeight = std::max(1u, height / 2);
+
+    std::vector<uint8_t> result(static_cast<size_t>(outWidth) * outHeight * 4);
+
+    ThreadPool::Singleton().parallelFor(outHeight, [&](size_t y) {
+        const uint32_t y0 = std::min(static_cast<uint32_t>(2 * y), height - 1);
+        const uint32_t y1 = std::min(static_cast<uint32_t>(2 * y + 1), height - 1);
+        for (uint32_t x = 0; x < outWidth; ++x) {
+            const uint32_t x0 = std::min(2 * x, width - 1);
+            const uint32_t x1 = std::min(2 * x + 1, width - 1);
+            const uint8_t* p[4] = { &source[(static_cast<size_t>(y0) * width + x0) * 4], &source[(static_cast<size_t>(y0) * width + x1) * 4],
+                                    &source[(static_cast<size_t>(y1) * width + x0) * 4], &source[(static_cast<size_t>(y1) * width + x1) * 4] };
+            uint8_t* dst = &result[(y * outWidth + x) * 4];
+
+            for (int c = 0; c < 4; ++c) {
+                if (srgb && c < 3) {
+                    dst[c] = linearToSrgb((linear[p[0][c]] + linear[p[1][c]] + linear[p[2][c]] + linear[p[3][c]]) * 0.25f);
+                }
+                else {
+                    dst[c] = static_cast<uint8_t>((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+                }
+            }
+        }
+    });
+
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public                                                               //
+//////////////////////////////////////////////////////////////////////////
+
+uint32_t blockBytes(BlockFormat format)
+{
+    return format == BlockFormat::eBC1 ? 8 : 16;
+}
+
+BlockFormat chooseBlockFormat(const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+    const size_t nbPixels = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < nbPixels; ++i)
+        if (rgba[i * 4 + 3] != 255)
+            return BlockFormat::eBC7;
+    return BlockFormat::eBC1;
+}
+
+std::vector<uint8_t> compressImage(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t blocksY = (height + 3) / 4;
+    const uint32_t bytes   = blockBytes(format);
+
+    std::vector<uint8_t> result(static_cast<size_t>(blocksX) * blocksY * bytes);
+
+    ThreadPool::Singleton().parallelFor(blocksY, [&](size_t by) {
+        BlockPixels block;
+        for (uint32_t bx = 0; bx < blocksX; ++bx) {
+            uint8_t* out = &result[(by * blocksX + bx) * bytes];
+            fetchBlock(rgba, width, height, bx, static_cast<uint32_t>(by), block);
+
+            switch (format) {
+            case BlockFormat::eBC1:
+                encodeBC1(block, out);
+                break;
+            case BlockFormat::eBC5:
+                encodeBC5(block, out);
+                break;
+            case BlockFormat::eBC7:
+                encodeBC7(block, out);
+                break;
+            }
+        }
+    });
+
+    return result;
+}
+
+CompressedTexture compressTexture(const uint8_t* rgba, uint32_t width, uint32_t height,
+                                  BlockFormat format, bool srgb, bool mipmaps)
+{
+    CompressedTexture texture;
+    texture.format = format;
+    texture.srgb   = srgb;
+    texture.width  = width;
+    texture.height = height;
+
+    texture.levels.push_back(compressImage(format, rgba, width, height));
+
+    // Each level is filtered from the previous one
+    std::vector<uint8_t> level;
+    const uint8_t*       source = rgba;
+    while (mipmaps && (width > 1 || height > 1)) {
+        uint32_t nextWidth, nextHeight;
+        level  = downsample(source, width, height, srgb, nextWidth, nextHeight);
+        source = level.data();
+        width  = nextWidth;
+        height = nextHeight;
+
+        texture.levels.push_back(compressImage(format, source, width, height));
+    }
+
+    return texture;
+}
+
+} // namespace texture
+} // namespace tools
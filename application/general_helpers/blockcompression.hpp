@@ -0,0 +1,74 @@
+/*
+ *
+ * Andrew Frost
+ * blockcompression.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace tools {
+
+//////////////////////////////////////////////////////////////////////////
+// Block Compression                                                    //
+//////////////////////////////////////////////////////////////////////////
+// CPU encoders of the BC formats sampled by the GPU                    //
+// - BC1 : RGB, 8 bytes per 4x4 block                                   //
+// - BC5 : two channels (e.g. normal XY), 16 bytes per 4x4 block        //
+// - BC7 : RGBA, 16 bytes per 4x4 block, encoded in mode 6              //
+// - Mips are filtered on the CPU, in linear space for sRGB data, and   //
+//   blocks are encoded on the thread pool                              //
+//////////////////////////////////////////////////////////////////////////
+
+namespace texture {
+
+enum class BlockFormat : uint32_t
+{
+    eBC1,
+    eBC5,
+    eBC7
+};
+
+// Compressed image with its mip chain, level 0 first
+struct CompressedTexture
+{
+    BlockFormat                       format{ BlockFormat::eBC1 };
+    bool                              srgb{ true };
+    uint32_t                          width{ 0 };
+    uint32_t                          height{ 0 };
+    std::vector<std::vector<uint8_t>> levels;
+};
+
+uint32_t blockBytes(BlockFormat format);
+
+//-------------------------------------------------------------------------
+// BC7 when some pixels are not opaque, BC1 otherwise
+//
+BlockFormat chooseBlockFormat(const uint8_t* rgba, uint32_t width, uint32_t height);
+
+//-------------------------------------------------------------------------
+// Blocks of an RGBA8 image, row by row. Partial blocks on the right and
+// bottom edges repeat the last column and row.
+//
+std::vector<uint8_t> compressImage(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height);
+
+//-------------------------------------------------------------------------
+// Full mip chain down to 1x1 when mipmaps is set, like the Vulkan images
+//
+CompressedTexture compressTexture(const uint8_t* rgba, uint32_t width, uint32_t height,
+                                  BlockFormat format, bool srgb, bool mipmaps = true);
+
+//-------------------------------------------------------------------------
+// Next level of an RGBA8 image with a 2x2 box filter, in linear space for
+// sRGB data
+//
+std::vector<uint8_t> downsample(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb,
+                                uint32_t& outWidth, uint32_t& outHeight);
+
+} // namespace texture
+} // namespace tools
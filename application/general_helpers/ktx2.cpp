@@ -0,0 +1,305 @@
+/*
+ *
+ * Andrew Frost
+ * ktx2.cpp
+ * 2020
+ *
+ */
+
+#include "ktx2.hpp"
+#include "mappedfile.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string.h>
+
+namespace tools {
+namespace texture {
+
+static const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// Key/value entry of the source image, with the encoder version that is
+// bumped when the encoders change so the files are written again
+static const char*    KTX2_SOURCE_KEY      = "ExampleVulkanSource";
+static const uint32_t KTX2_ENCODER_VERSION = 1;
+
+// VkFormat values
+static const uint32_t VK_FORMAT_BC1_RGB_UNORM = 131;
+static const uint32_t VK_FORMAT_BC1_RGB_SRGB  = 132;
+static const uint32_t VK_FORMAT_BC5_UNORM     = 141;
+static const uint32_t VK_FORMAT_BC7_UNORM     = 145;
+static const uint32_t VK_FORMAT_BC7_SRGB      = 146;
+
+// Data format descriptor values
+static const uint32_t KHR_DF_MODEL_BC1A      = 128;
+static const uint32_t KHR_DF_MODEL_BC5       = 132;
+static const uint32_t KHR_DF_MODEL_BC7       = 134;
+static const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+static const uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+static const uint32_t KHR_DF_TRANSFER_SRGB   = 2;
+
+struct Ktx2Header
+{
+    uint8_t  identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must be packed");
+
+struct Ktx2Level
+{
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+//-------------------------------------------------------------------------
+// Value identifying the source image and the encoder, empty if the source
+// cannot be accessed
+//
+static std::string sourceKey(const std::string& sourceFile)
+{
+    std::error_code ec;
+    const auto      size = std::filesystem::file_size(sourceFile, ec);
+    if (ec)
+        return std::string();
+    const auto time = std::filesystem::last_write_time(sourceFile, ec);
+    if (ec)
+        return std::string();
+
+    return std::to_string(KTX2_ENCODER_VERSION) + " " + std::to_string(size) + " " +
+           std::to_string(static_cast<int64_t>(time.time_since_epoch().count()));
+}
+
+static size_t levelSize(const CompressedTexture& texture, uint32_t level)
+{
+    const uint32_t width  = std::max(1u, texture.width >> level);
+    const uint32_t height = std::max(1u, texture.height >> level);
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(texture.format);
+}
+
+static inline uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+//-------------------------------------------------------------------------
+// Basic data format descriptor of the block format
+//
+static std::vector<uint32_t> dataFormatDescriptor(const CompressedTexture& texture)
+{
+    const uint32_t nbSamples = texture.format == BlockFormat::eBC5 ? 2 : 1;
+    const uint32_t bytes     = blockBytes(texture.format);
+    const uint32_t model     = texture.format == BlockFormat::eBC1 ? KHR_DF_MODEL_BC1A
+                             : texture.format == BlockFormat::eBC5 ? KHR_DF_MODEL_BC5
+                                                                   : KHR_DF_MODEL_BC7;
+    const uint32_t transfer  = texture.srgb && texture.format != BlockFormat::eBC5 ? KHR_DF_TRANSFER_SRGB
+                                                                                   : KHR_DF_TRANSFER_LINEAR;
+
+    std::vector<uint32_t> dfd;
+    dfd.push_back(0);                                        // total size, set below
+    dfd.push_back(0);                                        // vendor and descriptor type
+    dfd.push_back(2 | ((24 + 16 * nbSamples) << 16));        // version and block size
+    dfd.push_back(model | (KHR_DF_PRIMARIES_BT709 << 8) | (transfer << 16));
+    dfd.push_back(3 | (3 << 8));                             // 4x4 texel blocks
+    dfd.push_back(bytes);
+    dfd.push_back(0);
+
+    // One sample covering the block, two 64 bit halves for BC5 red and green
+    for (uint32_t s = 0; s < nbSamples; ++s) {
+        const uint32_t bitLength = (nbSamples == 1 ? bytes * 8 : 64) - 1;
+        dfd.push_back((s * 64) | (bitLength << 16) | (s << 24));
+        dfd.push_back(0);
+        dfd.push_back(0);
+        dfd.push_back(UINT32_MAX);
+    }
+
+    dfd[0] = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+    return dfd;
+}
+
+uint32_t vkFormatOf(const CompressedTexture& texture)
+{
+    return vkFormatOf(texture.format, texture.srgb);
+}
+
+uint32_t vkFormatOf(BlockFormat format, bool srgb)
+{
+    switch (format) {
+    case BlockFormat::eBC1:
+        return srgb ? VK_FORMAT_BC1_RGB_SRGB : VK_FORMAT_BC1_RGB_UNORM;
+    case BlockFormat::eBC5:
+        return VK_FORMAT_BC5_UNORM;
+    default:
+        return srgb ? VK_FORMAT_BC7_SRGB : VK_FORMAT_BC7_UNORM;
+    }
+}
+
+bool readKtx2(const std::string& filename, const std::string& sourceFile, CompressedTexture& texture)
+{
+    const std::string key = sourceKey(sourceFile);
+    if (key.empty())
+        return false;
+
+    MappedFile file;
+    if (!file.open(filename) || file.size() < sizeof(Ktx2Header))
+        return false;
+
+    Ktx2Header header;
+    memcpy(&header, file.data(), sizeof(Ktx2Header));
+
+    if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 || header.supercompressionScheme != 0 ||
+        header.levelCount == 0 || header.levelCount > 32 || header.pixelDepth != 0 || header.faceCount != 1 ||
+        sizeof(Ktx2Header) + header.levelCount * sizeof(Ktx2Level) > file.size())
+        return false;
+
+    switch (header.vkFormat) {
+    case VK_FORMAT_BC1_RGB_UNORM:
+    case VK_FORMAT_BC1_RGB_SRGB:
+        texture.format = BlockFormat::eBC1;
+        break;
+    case VK_FORMAT_BC5_UNORM:
+        texture.format = BlockFormat::eBC5;
+        break;
+    case VK_FORMAT_BC7_UNORM:
+    case VK_FORMAT_BC7_SRGB:
+        texture.format = BlockFormat::eBC7;
+        break;
+    default:
+        return false;
+    }
+    texture.srgb   = header.vkFormat == VK_FORMAT_BC1_RGB_SRGB || header.vkFormat == VK_FORMAT_BC7_SRGB;
+    texture.width  = header.pixelWidth;
+    texture.height = header.pixelHeight;
+
+    // Source key in the key/value data
+    if (static_cast<uint64_t>(header.kvdByteOffset) + header.kvdByteLength > file.size())
+        return false;
+
+    bool     keyMatch = false;
+    uint32_t offset   = header.kvdByteOffset;
+    while (offset + sizeof(uint32_t) <= header.kvdByteOffset + header.kvdByteLength) {
+        uint32_t length;
+        memcpy(&length, file.data() + offset, sizeof(uint32_t));
+        if (offset + sizeof(uint32_t) + length > header.kvdByteOffset + header.kvdByteLength)
+            return false;
+
+        const char*       entry = reinterpret_cast<const char*>(file.data() + offset + sizeof(uint32_t));
+        const std::string entryKey(entry, strnlen(entry, length));
+        if (entryKey == KTX2_SOURCE_KEY && entryKey.size() < length) {
+            const size_t valueLength = length - entryKey.size() - 1;
+            keyMatch = std::string(entry + entryKey.size() + 1, strnlen(entry + entryKey.size() + 1, valueLength)) == key;
+        }
+        offset = static_cast<uint32_t>(alignOffset(offset + sizeof(uint32_t) + length, 4));
+    }
+    if (!keyMatch)
+        return false;
+
+    texture.levels.resize(header.levelCount);
+    for (uint32_t level = 0; level < header.levelCount; ++level) {
+        Ktx2Level index;
+        memcpy(&index, file.data() + sizeof(Ktx2Header) + level * sizeof(Ktx2Level), sizeof(Ktx2Level));
+        if (index.byteLength != levelSize(texture, level) || index.byteOffset + index.byteLength > file.size())
+            return false;
+
+        const uint8_t* data = file.data() + index.byteOffset;
+        texture.levels[level].assign(data, data + index.byteLength);
+    }
+
+    return true;
+}
+
+bool writeKtx2(const std::string& filename, const std::string& sourceFile, const CompressedTexture& texture)
+{
+    const std::string key = sourceKey(sourceFile);
+    if (key.empty() || texture.levels.empty())
+        return false;
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        return false;
+
+    const std::vector<uint32_t> dfd = dataFormatDescriptor(texture);
+
+    // Key/value entries: length, key and value both null terminated, padding
+    std::vector<uint8_t> kvd;
+    auto addEntry = [&kvd](const std::string& entryKey, const std::string& value) {
+        const uint32_t length = static_cast<uint32_t>(entryKey.size() + value.size() + 2);
+        kvd.insert(kvd.end(), reinterpret_cast<const uint8_t*>(&length), reinterpret_cast<const uint8_t*>(&length) + sizeof(uint32_t));
+        kvd.insert(kvd.end(), entryKey.begin(), entryKey.end());
+        kvd.push_back(0);
+        kvd.insert(kvd.end(), value.begin(), value.end());
+        kvd.push_back(0);
+        kvd.resize(alignOffset(kvd.size(), 4), 0);
+    };
+    addEntry("KTXwriter", "ExampleVulkan");
+    addEntry(KTX2_SOURCE_KEY, key);
+
+    const uint32_t levelCount = static_cast<uint32_t>(texture.levels.size());
+
+    Ktx2Header header = {};
+    memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    header.vkFormat      = vkFormatOf(texture);
+    header.typeSize      = 1;
+    header.pixelWidth    = texture.width;
+    header.pixelHeight   = texture.height;
+    header.faceCount     = 1;
+    header.levelCount    = levelCount;
+    header.dfdByteOffset = static_cast<uint32_t>(sizeof(Ktx2Header) + levelCount * sizeof(Ktx2Level));
+    header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+    header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+    header.kvdByteLength = static_cast<uint32_t>(kvd.size());
+
+    // The smallest level comes first in the file, aligned on the block size
+    std::vector<Ktx2Level> levels(levelCount);
+    uint64_t               offset = header.kvdByteOffset + header.kvdByteLength;
+    for (uint32_t level = levelCount; level-- > 0;) {
+        offset                              = alignOffset(offset, blockBytes(texture.format));
+        levels[level].byteOffset             = offset;
+        levels[level].byteLength             = texture.levels[level].size();
+        levels[level].uncompressedByteLength = texture.levels[level].size();
+        offset += texture.levels[level].size();
+    }
+
+    auto writeAt = [&out](uint64_t position, const void* data, size_t size) {
+        out.seekp(static_cast<std::streamoff>(position));
+        out.write(reinterpret_cast<const char*>(data), size);
+    };
+
+    // The identifier is written last, an interrupted write is not a valid file
+    const Ktx2Header invalid = {};
+    writeAt(0, &invalid, sizeof(Ktx2Header));
+    writeAt(sizeof(Ktx2Header), levels.data(), levels.size() * sizeof(Ktx2Level));
+    writeAt(header.dfdByteOffset, dfd.data(), header.dfdByteLength);
+    writeAt(header.kvdByteOffset, kvd.data(), kvd.size());
+    for (uint32_t level = 0; level < levelCount; ++level)
+        writeAt(levels[level].byteOffset, texture.levels[level].data(), texture.levels[level].size());
+    writeAt(0, &header, sizeof(Ktx2Header));
+    out.close();
+
+    if (out.fail()) {
+        std::cerr << "Cannot write texture: " << filename << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(filename, ec);
+        return false;
+    }
+    return true;
+}
+
+} // namespace texture
+} // namespace tools
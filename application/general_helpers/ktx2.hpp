@@ -0,0 +1,43 @@
+/*
+ *
+ * Andrew Frost
+ * ktx2.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <string>
+
+#include "blockcompression.hpp"
+
+namespace tools {
+
+//////////////////////////////////////////////////////////////////////////
+// KTX2                                                                 //
+//////////////////////////////////////////////////////////////////////////
+// Khronos texture container for the block compressed textures          //
+// - One 2D image with its mip chain, no supercompression               //
+// - The size and time of the source image are stored in the key/value  //
+//   data, a file written for another source version is not read        //
+//////////////////////////////////////////////////////////////////////////
+
+namespace texture {
+
+// VkFormat of the texture, as stored in the KTX2 header
+uint32_t vkFormatOf(const CompressedTexture& texture);
+uint32_t vkFormatOf(BlockFormat format, bool srgb);
+
+//-------------------------------------------------------------------------
+// False if the file is missing, invalid or older than the source image
+//
+bool readKtx2(const std::string& filename, const std::string& sourceFile, CompressedTexture& texture);
+
+//-------------------------------------------------------------------------
+// False if the source image or the file cannot be accessed
+//
+bool writeKtx2(const std::string& filename, const std::string& sourceFile, const CompressedTexture& texture);
+
+} // namespace texture
+} // namespace tools
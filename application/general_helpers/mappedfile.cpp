@@ -0,0 +1,138 @@
+/*
+ *
+ * Andrew Frost
+ * mappedfile.cpp
+ * 2020
+ *
+ */
+
+#include "mappedfile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tools {
+
+///////////////////////////////////////////////////////////////////////////
+// MappedFile                                                            //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// Move, the other file gives up its mapping
+//
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other) {
+        close();
+
+        m_data = other.m_data;
+        m_size = other.m_size;
+        m_file = other.m_file;
+#ifdef _WIN32
+        m_mapping = other.m_mapping;
+        other.m_mapping = nullptr;
+        other.m_file    = nullptr;
+#else
+        other.m_file = -1;
+#endif
+        other.m_data = nullptr;
+        other.m_size = 0;
+    }
+    return *this;
+}
+
+//-------------------------------------------------------------------------
+// Map the whole file, returns false if it does not exist or is empty
+//
+bool MappedFile::open(const std::string& filename)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file    = file;
+    m_mapping = mapping;
+    m_data    = static_cast<const uint8_t*>(data);
+    m_size    = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int file = ::open(filename.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+        ::close(file);
+        return false;
+    }
+
+    void* data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    if (data == MAP_FAILED) {
+        ::close(file);
+        return false;
+    }
+
+    m_file = file;
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = static_cast<size_t>(fileStat.st_size);
+#endif
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// Unmap and close the file
+//
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file)
+        CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file    = nullptr;
+#else
+    if (m_data)
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    if (m_file >= 0)
+        ::close(m_file);
+    m_file = -1;
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+} // namespace tools
@@ -0,0 +1,57 @@
+/*
+ *
+ * Andrew Frost
+ * mappedfile.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+namespace tools {
+
+///////////////////////////////////////////////////////////////////////////
+// MappedFile                                                            //
+///////////////////////////////////////////////////////////////////////////
+// Read-only memory mapping of a whole file                              //
+// - the mapping stays valid until close() or destruction                //
+///////////////////////////////////////////////////////////////////////////
+
+class MappedFile
+{
+public:
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool open(const std::string& filename);
+
+    void close();
+
+    bool           isOpen() const { return m_data != nullptr; }
+    const uint8_t* data()   const { return m_data; }
+    size_t         size()   const { return m_size; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t         m_size = 0;
+
+#ifdef _WIN32
+    void*          m_file    = nullptr;
+    void*          m_mapping = nullptr;
+#else
+    int            m_file    = -1;
+#endif
+
+}; // class MappedFile
+
+} // namespace tools
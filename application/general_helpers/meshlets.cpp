@@ -0,0 +1,290 @@
+/*
+ *
+ * Andrew Frost
+ * meshlets.cpp
+ * 2020
+ *
+ */
+
+#include "meshlets.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace tools {
+namespace mesh {
+
+// Triangles per task, meshlets never cross two blocks
+static const size_t MESHLET_BLOCK_TRIANGLES = 1 << 16;
+
+//////////////////////////////////////////////////////////////////////////
+// Meshlet Vertex Table                                                 //
+//////////////////////////////////////////////////////////////////////////
+// Open addressing table from a mesh vertex to its index in the current //
+// meshlet, cleared when the meshlet is full                            //
+//////////////////////////////////////////////////////////////////////////
+
+class MeshletVertexTable
+{
+public:
+    explicit MeshletVertexTable(uint32_t maxVertices)
+    {
+        size_t capacity = 1;
+        while (capacity < 2 * maxVertices)
+            capacity <<= 1;
+        m_keys.assign(capacity, ~0u);
+        m_values.assign(capacity, 0);
+        m_mask = capacity - 1;
+    }
+
+    // Local index of the vertex or ~0u
+    uint32_t find(uint32_t vertex) const
+    {
+        for (size_t slot = hash(vertex);; slot = (slot + 1) & m_mask) {
+            if (m_keys[slot] == vertex)
+                return m_values[slot];
+            if (m_keys[slot] == ~0u)
+                return ~0u;
+        }
+    }
+
+    void insert(uint32_t vertex, uint8_t local)
+    {
+        size_t slot = hash(vertex);
+        while (m_keys[slot] != ~0u)
+            slot = (slot + 1) & m_mask;
+        m_keys[slot]   = vertex;
+        m_values[slot] = local;
+    }
+
+    void clear() { std::fill(m_keys.begin(), m_keys.end(), ~0u); }
+
+private:
+    size_t hash(uint32_t vertex) const { return (vertex * 2654435761u >> 7) & m_mask; }
+
+    std::vector<uint32_t> m_keys;
+    std::vector<uint8_t>  m_values;
+    size_t                m_mask{ 0 };
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Meshlet Building                                                     //
+//////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// Ritter's bounding sphere, from the points furthest apart along the axes
+//
+static void computeSphere(const uint32_t* vertices, uint32_t nbVertices, const float* positions,
+    size_t positionStride, float center[3], float& radius)
+{
+    auto position = [&](uint32_t i) {
+        const uint32_t vertex = vertices[i];
+        return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + vertex * positionStride);
+    };
+
+    uint32_t pmin[3] = { 0, 0, 0 };
+    uint32_t pmax[3] = { 0, 0, 0 };
+    for (uint32_t i = 0; i < nbVertices; ++i) {
+        const float* p = position(i);
+        for (int k = 0; k < 3; ++k) {
+            if (p[k] < position(pmin[k])[k])
+                pmin[k] = i;
+            if (p[k] > position(pmax[k])[k])
+                pmax[k] = i;
+        }
+    }
+
+    auto distance2 = [](const float* a, const float* b) {
+        return (a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]);
+    };
+
+    // Widest axis gives the initial sphere
+    int   axis    = 0;
+    float spread2 = -1.f;
+    for (int k = 0; k < 3; ++k) {
+        const float d2 = distance2(position(pmin[k]), position(pmax[k]));
+        if (d2 > spread2) {
+            spread2 = d2;
+            axis    = k;
+        }
+    }
+
+    const float* p0 = position(pmin[axis]);
+    const float* p1 = position(pmax[axis]);
+    for (int k = 0; k < 3; ++k)
+        center[k] = (p0[k] + p1[k]) * 0.5f;
+    radius = std::sqrt(spread2) * 0.5f;
+
+    // Growing it over the points outside
+    for (uint32_t i = 0; i < nbVertices; ++i) {
+        const float* p  = position(i);
+        const float  d2 = distance2(p, center);
+        if (d2 > radius * radius) {
+            const float d     = std::sqrt(d2);
+            const float shift = (d - radius) * 0.5f / d;
+            for (int k = 0; k < 3; ++k)
+                center[k] += (p[k] - center[k]) * shift;
+            radius = (radius + d) * 0.5f;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// Average of the triangle normals, and the sine of the widest angle to it
+//
+static void computeCone(const uint32_t* vertices, const uint8_t* triangles, uint32_t nbTriangles,
+    const float* positions, size_t positionStride, float axis[3], float& cutoff)
+{
+    auto position = [&](uint8_t local) {
+        const uint32_t vertex = vertices[local];
+        return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + vertex * positionStride);
+    };
+
+    std::vector<float> normals(3 * nbTriangles, 0.f);
+    std::vector<bool>  valid(nbTriangles, false);
+    axis[0] = axis[1] = axis[2] = 0.f;
+
+    for (uint32_t t = 0; t < nbTriangles; ++t) {
+        const uint8_t* triangle = &triangles[3 * t];
+        const float*   p0       = position(triangle[0]);
+        const float*   p1       = position(triangle[1]);
+        const float*   p2       = position(triangle[2]);
+
+        const float e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        const float e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float       n[3]  = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.f)
+            continue;
+
+        for (int k = 0; k < 3; ++k) {
+            normals[3 * t + k] = n[k] / length;
+            axis[k] += normals[3 * t + k];
+        }
+        valid[t] = true;
+    }
+
+    cutoff = 1.f;
+
+    const float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (length == 0.f)
+        return;
+    for (int k = 0; k < 3; ++k)
+        axis[k] /= length;
+
+    float minDot = 1.f;
+    for (uint32_t t = 0; t < nbTriangles; ++t) {
+        if (valid[t])
+            minDot = std::min(minDot, normals[3 * t] * axis[0] + normals[3 * t + 1] * axis[1] + normals[3 * t + 2] * axis[2]);
+    }
+
+    // Cones close to a half space are not worth testing
+    if (minDot > 0.1f)
+        cutoff = std::sqrt(1.f - minDot * minDot);
+}
+
+//-------------------------------------------------------------------------
+// Greedy split of a block, a meshlet is closed when the next triangle
+// does not fit in it
+//
+static void buildBlock(const uint32_t* indices, size_t firstTriangle, size_t nbTriangles,
+    uint32_t maxVertices, uint32_t maxTriangles, Meshlets& result)
+{
+    MeshletVertexTable table(maxVertices);
+    Meshlet            meshlet = {};
+    meshlet.triangleOffset     = static_cast<uint32_t>(firstTriangle);
+
+    result.triangles.reserve(3 * nbTriangles);
+
+    for (size_t t = firstTriangle; t < firstTriangle + nbTriangles; ++t) {
+        const uint32_t* triangle = &indices[3 * t];
+
+        // Vertices not in the meshlet yet, counting repeated ones once
+        uint32_t nbNew = 0;
+        for (int k = 0; k < 3; ++k) {
+            if (table.find(triangle[k]) == ~0u && (k == 0 || triangle[k] != triangle[0]) && (k < 2 || triangle[2] != triangle[1]))
+                nbNew++;
+        }
+
+        if (meshlet.vertexCount + nbNew > maxVertices || meshlet.triangleCount + 1 > maxTriangles) {
+            result.meshlets.push_back(meshlet);
+            meshlet                = {};
+            meshlet.vertexOffset   = static_cast<uint32_t>(result.vertices.size());
+            meshlet.triangleOffset = static_cast<uint32_t>(t);
+            table.clear();
+        }
+
+        for (int k = 0; k < 3; ++k) {
+            uint32_t index = table.find(triangle[k]);
+            if (index == ~0u) {
+                index = meshlet.vertexCount++;
+                table.insert(triangle[k], static_cast<uint8_t>(index));
+                result.vertices.push_back(triangle[k]);
+            }
+            result.triangles.push_back(static_cast<uint8_t>(index));
+        }
+        meshlet.triangleCount++;
+    }
+
+    if (meshlet.triangleCount > 0)
+        result.meshlets.push_back(meshlet);
+}
+
+//-------------------------------------------------------------------------
+// Blocks are built and bounded in parallel, then concatenated in order
+//
+Meshlets buildMeshlets(const uint32_t* indices, size_t nbIndices, const float* positions, size_t positionStride,
+    uint32_t maxVertices, uint32_t maxTriangles)
+{
+    maxVertices  = std::min(std::max(maxVertices, 3u), 256u);
+    maxTriangles = std::max(maxTriangles, 1u);
+
+    const size_t nbTriangles = nbIndices / 3;
+    const size_t nbBlocks    = (nbTriangles + MESHLET_BLOCK_TRIANGLES - 1) / MESHLET_BLOCK_TRIANGLES;
+
+    std::vector<Meshlets> blocks(nbBlocks);
+
+    ThreadPool::Singleton().parallelFor(nbBlocks, [&](size_t b) {
+        const size_t first = b * MESHLET_BLOCK_TRIANGLES;
+        const size_t count = std::min(MESHLET_BLOCK_TRIANGLES, nbTriangles - first);
+        Meshlets&    block = blocks[b];
+
+        buildBlock(indices, first, count, maxVertices, maxTriangles, block);
+
+        // Vertex offsets are local to the block until the concatenation
+        for (auto& meshlet : block.meshlets) {
+            const uint32_t* vertices  = &block.vertices[meshlet.vertexOffset];
+            const uint8_t*  triangles = &block.triangles[3 * (meshlet.triangleOffset - first)];
+            computeSphere(vertices, meshlet.vertexCount, positions, positionStride, meshlet.center, meshlet.radius);
+            computeCone(vertices, triangles, meshlet.triangleCount, positions, positionStride, meshlet.coneAxis, meshlet.coneCutoff);
+        }
+    });
+
+    Meshlets result;
+    size_t   nbMeshlets = 0, nbVertices = 0;
+    for (const auto& block : blocks) {
+        nbMeshlets += block.meshlets.size();
+        nbVertices += block.vertices.size();
+    }
+    result.meshlets.reserve(nbMeshlets);
+    result.vertices.reserve(nbVertices);
+    result.triangles.reserve(3 * nbTriangles);
+
+    for (auto& block : blocks) {
+        const uint32_t vertexOffset = static_cast<uint32_t>(result.vertices.size());
+        for (auto meshlet : block.meshlets) {
+            meshlet.vertexOffset += vertexOffset;
+            result.meshlets.push_back(meshlet);
+        }
+        result.vertices.insert(result.vertices.end(), block.vertices.begin(), block.vertices.end());
+        result.triangles.insert(result.triangles.end(), block.triangles.begin(), block.triangles.end());
+        block = Meshlets();
+    }
+
+    return result;
+}
+
+} // namespace mesh
+} // namespace tools
@@ -0,0 +1,71 @@
+/*
+ *
+ * Andrew Frost
+ * meshlets.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace tools {
+
+//////////////////////////////////////////////////////////////////////////
+// Meshlets                                                             //
+//////////////////////////////////////////////////////////////////////////
+// Split of an indexed triangle list in small clusters for culling      //
+// - Triangles are taken in index buffer order, so each meshlet covers  //
+//   a contiguous range of the index buffer and is a drawIndexed range  //
+// - meshletVertices holds the vertices of each meshlet, and            //
+//   meshletTriangles three uint8 indices into them per triangle        //
+// - Each meshlet has a bounding sphere and a normal cone               //
+//////////////////////////////////////////////////////////////////////////
+
+namespace mesh {
+
+// Limits fitting the mesh shading recommendations
+static const uint32_t MESHLET_MAX_VERTICES  = 64;
+static const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Matches the std430 layout of the meshlet buffer, 48 bytes
+struct Meshlet
+{
+    uint32_t vertexOffset;   // first vertex in meshletVertices
+    uint32_t triangleOffset; // first triangle in the index buffer, and in meshletTriangles / 3
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+
+    float center[3]; // bounding sphere
+    float radius;
+
+    // The meshlet is back-facing when seen from 'eye' if
+    // dot(center - eye, coneAxis) >= coneCutoff * length(center - eye) + radius
+    float coneAxis[3];
+    float coneCutoff; // 1 when the cone is too wide to be culled
+};
+
+struct Meshlets
+{
+    std::vector<Meshlet>  meshlets;
+    std::vector<uint32_t> vertices;  // mesh vertex indices
+    std::vector<uint8_t>  triangles; // local indices, 3 per triangle
+};
+
+//-------------------------------------------------------------------------
+// Build the meshlets and their bounds on the thread pool. positionStride
+// is the distance in bytes between two positions.
+//
+Meshlets buildMeshlets(
+    const uint32_t* indices,
+    size_t          nbIndices,
+    const float*    positions,
+    size_t          positionStride,
+    uint32_t        maxVertices  = MESHLET_MAX_VERTICES,
+    uint32_t        maxTriangles = MESHLET_MAX_TRIANGLES);
+
+} // namespace mesh
+} // namespace tools
@@ -0,0 +1,322 @@
+/*
+ *
+ * Andrew Frost
+ * meshoptimize.cpp
+ * 2020
+ *
+ */
+
+#include "meshoptimize.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace tools {
+namespace mesh {
+
+//////////////////////////////////////////////////////////////////////////
+// FIFO Cache                                                           //
+//////////////////////////////////////////////////////////////////////////
+// A vertex is in the cache while fewer than cacheSize vertices were    //
+// loaded after it, using per vertex timestamps                         //
+//////////////////////////////////////////////////////////////////////////
+
+class FifoCache
+{
+public:
+    FifoCache(size_t nbVertices, uint32_t cacheSize)
+        : m_timestamps(nbVertices, 0)
+        , m_time(cacheSize + 1)
+        , m_cacheSize(cacheSize)
+    {
+    }
+
+    // Returns true on a cache miss
+    bool load(uint32_t vertex)
+    {
+        if (m_time - m_timestamps[vertex] <= m_cacheSize)
+            return false;
+        m_timestamps[vertex] = m_time++;
+        return true;
+    }
+
+    // Age of the vertex in the cache
+    uint32_t age(uint32_t vertex) const { return m_time - m_timestamps[vertex]; }
+
+    void flush() { m_time += m_cacheSize + 1; }
+
+private:
+    std::vector<uint32_t> m_timestamps;
+    uint32_t              m_time;
+    uint32_t              m_cacheSize;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Mesh Optimization                                                    //
+//////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// Count the cache misses of the index buffer
+//
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t nbIndices, size_t nbVertices, uint32_t cacheSize)
+{
+    VertexCacheStats stats;
+    if (nbIndices < 3)
+        return stats;
+
+    FifoCache            cache(nbVertices, cacheSize);
+    std::vector<uint8_t> referenced(nbVertices, 0);
+    size_t               nbMisses     = 0;
+    size_t               nbReferenced = 0;
+
+    for (size_t i = 0; i < nbIndices; ++i) {
+        const uint32_t vertex = indices[i];
+        nbMisses += cache.load(vertex) ? 1 : 0;
+        if (!referenced[vertex]) {
+            referenced[vertex] = 1;
+            nbReferenced++;
+        }
+    }
+
+    stats.acmr = static_cast<float>(nbMisses) / static_cast<float>(nbIndices / 3);
+    stats.atvr = static_cast<float>(nbMisses) / static_cast<float>(nbReferenced);
+    return stats;
+}
+
+//-------------------------------------------------------------------------
+// Fan around a vertex, then continue with the oldest vertex that stays in
+// the cache once fanned, or a dead-end vertex when there are none
+//
+void tipsify(const uint32_t* indices, size_t nbIndices, size_t nbVertices,
+    std::vector<uint32_t>& triangleOrder, std::vector<uint32_t>& clusters, uint32_t cacheSize)
+{
+    const size_t nbTriangles = nbIndices / 3;
+
+    triangleOrder.clear();
+    clusters.clear();
+    if (nbTriangles == 0)
+        return;
+
+    triangleOrder.reserve(nbTriangles);
+
+    // Triangles using each vertex
+    std::vector<uint32_t> offsets(nbVertices + 1, 0);
+    std::vector<uint32_t> adjacency(nbTriangles * 3);
+    for (size_t i = 0; i < nbTriangles * 3; ++i)
+        offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < nbVertices; ++v)
+        offsets[v + 1] += offsets[v];
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < nbTriangles * 3; ++i)
+            adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // Triangles left to emit for each vertex
+    std::vector<uint32_t> live(nbVertices);
+    for (size_t v = 0; v < nbVertices; ++v)
+        live[v] = offsets[v + 1] - offsets[v];
+
+    FifoCache             cache(nbVertices, cacheSize);
+    std::vector<uint8_t>  emitted(nbTriangles, 0);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    uint32_t              cursor = 0;
+
+    auto skipDeadEnd = [&]() {
+        while (!deadEnd.empty()) {
+            const uint32_t vertex = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[vertex] > 0)
+                return vertex;
+        }
+        while (cursor < nbVertices) {
+            if (live[cursor] > 0)
+                return cursor;
+            cursor++;
+        }
+        return ~0u;
+    };
+
+    uint32_t fan = skipDeadEnd();
+    clusters.push_back(0);
+
+    while (fan != ~0u) {
+        candidates.clear();
+
+        for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+            const uint32_t triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+
+            for (size_t k = 0; k < 3; ++k) {
+                const uint32_t vertex = indices[3 * triangle + k];
+                deadEnd.push_back(vertex);
+                candidates.push_back(vertex);
+                live[vertex]--;
+                cache.load(vertex);
+            }
+            emitted[triangle] = 1;
+            triangleOrder.push_back(triangle);
+        }
+
+        // Next fanning vertex
+        uint32_t next     = ~0u;
+        int64_t  priority = -1;
+        for (uint32_t vertex : candidates) {
+            if (live[vertex] == 0)
+                continue;
+
+            int64_t p = 0;
+            if (cache.age(vertex) + 2 * live[vertex] <= cacheSize)
+                p = cache.age(vertex);
+            if (p > priority) {
+                priority = p;
+                next     = vertex;
+            }
+        }
+
+        if (next == ~0u) {
+            next = skipDeadEnd();
+            if (next != ~0u)
+                clusters.push_back(static_cast<uint32_t>(triangleOrder.size()));
+        }
+
+        fan = next;
+    }
+}
+
+//-------------------------------------------------------------------------
+// Fast triangle reordering (Sander et al. 2007), keeps the clusters
+// contiguous so the cache efficiency is only lowered by the threshold
+//
+void optimizeOverdraw(const uint32_t* indices, size_t nbIndices, size_t nbVertices,
+    const float* positions, size_t positionStride, std::vector<uint32_t>& triangleOrder,
+    const std::vector<uint32_t>& clusters, float threshold, uint32_t cacheSize)
+{
+    const size_t nbTriangles = triangleOrder.size();
+    if (nbTriangles == 0 || nbIndices < 3)
+        return;
+
+    auto position = [&](uint32_t vertex) {
+        return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + vertex * positionStride);
+    };
+
+    // Splitting the clusters where the cache is still efficient
+    std::vector<uint32_t> starts;
+    FifoCache             cache(nbVertices, cacheSize);
+
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        const size_t begin = clusters[c];
+        const size_t end   = c + 1 < clusters.size() ? clusters[c + 1] : nbTriangles;
+
+        cache.flush();
+        size_t clusterMisses = 0;
+        for (size_t t = begin; t < end; ++t) {
+            const uint32_t* triangle = &indices[3 * triangleOrder[t]];
+            clusterMisses += (cache.load(triangle[0]) ? 1 : 0) + (cache.load(triangle[1]) ? 1 : 0) + (cache.load(triangle[2]) ? 1 : 0);
+        }
+
+        const float maxAcmr = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - begin);
+
+        // Each cluster starts with an empty cache as it can be drawn after any other
+        starts.push_back(static_cast<uint32_t>(begin));
+        cache.flush();
+        size_t runningMisses = 0;
+        for (size_t t = begin; t < end; ++t) {
+            const uint32_t* triangle = &indices[3 * triangleOrder[t]];
+            runningMisses += (cache.load(triangle[0]) ? 1 : 0) + (cache.load(triangle[1]) ? 1 : 0) + (cache.load(triangle[2]) ? 1 : 0);
+            if (t + 1 < end && static_cast<float>(runningMisses) <= maxAcmr * static_cast<float>(t + 1 - starts.back())) {
+                starts.push_back(static_cast<uint32_t>(t + 1));
+                cache.flush();
+                runningMisses = 0;
+            }
+        }
+    }
+
+    // Area weighted centroid and normal of each cluster
+    struct Cluster
+    {
+        float    centroid[3];
+        float    normal[3];
+        float    sortKey;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    std::vector<Cluster> sorted(starts.size());
+    float                meshCentroid[3] = {0.f, 0.f, 0.f};
+    float                meshArea        = 0.f;
+
+    for (size_t c = 0; c < starts.size(); ++c) {
+        Cluster& cluster = sorted[c];
+        cluster          = {};
+        cluster.begin    = starts[c];
+        cluster.end      = c + 1 < starts.size() ? starts[c + 1] : static_cast<uint32_t>(nbTriangles);
+
+        float area = 0.f;
+        for (uint32_t t = cluster.begin; t < cluster.end; ++t) {
+            const uint32_t* triangle = &indices[3 * triangleOrder[t]];
+            const float*    p0       = position(triangle[0]);
+            const float*    p1       = position(triangle[1]);
+            const float*    p2       = position(triangle[2]);
+
+            const float e0[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            const float e1[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            const float n[3]  = {e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0]};
+            const float a     = 0.5f * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for (size_t k = 0; k < 3; ++k) {
+                cluster.centroid[k] += a * (p0[k] + p1[k] + p2[k]) / 3.f;
+                cluster.normal[k] += n[k];
+            }
+            area += a;
+        }
+
+        for (size_t k = 0; k < 3; ++k)
+            meshCentroid[k] += cluster.centroid[k];
+        meshArea += area;
+
+        if (area > 0.f)
+            for (size_t k = 0; k < 3; ++k)
+                cluster.centroid[k] /= area;
+    }
+
+    if (meshArea > 0.f)
+        for (size_t k = 0; k < 3; ++k)
+            meshCentroid[k] /= meshArea;
+
+    // Clusters facing outward are drawn first, they occlude the others
+    for (auto& cluster : sorted) {
+        cluster.sortKey = 0.f;
+        for (size_t k = 0; k < 3; ++k)
+            cluster.sortKey += (cluster.centroid[k] - meshCentroid[k]) * cluster.normal[k];
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<uint32_t> order;
+    order.reserve(nbTriangles);
+    for (const auto& cluster : sorted)
+        order.insert(order.end(), triangleOrder.begin() + cluster.begin, triangleOrder.begin() + cluster.end);
+    triangleOrder.swap(order);
+}
+
+//-------------------------------------------------------------------------
+// New vertex indices in order of first reference
+//
+size_t optimizeVertexFetch(const uint32_t* indices, size_t nbIndices, size_t nbVertices, std::vector<uint32_t>& remap)
+{
+    remap.assign(nbVertices, ~0u);
+
+    uint32_t nbReferenced = 0;
+    for (size_t i = 0; i < nbIndices; ++i) {
+        if (remap[indices[i]] == ~0u)
+            remap[indices[i]] = nbReferenced++;
+    }
+
+    return nbReferenced;
+}
+
+} // namespace mesh
+} // namespace tools
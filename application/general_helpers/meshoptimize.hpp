@@ -0,0 +1,87 @@
+/*
+ *
+ * Andrew Frost
+ * meshoptimize.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace tools {
+
+//////////////////////////////////////////////////////////////////////////
+// Mesh Optimization                                                    //
+//////////////////////////////////////////////////////////////////////////
+// Reordering of indexed triangle lists, done once at import            //
+// - analyzeVertexCache : ACMR / ATVR of a FIFO post-transform cache    //
+// - tipsify            : triangle order for vertex cache locality      //
+// - optimizeOverdraw   : cluster order, front-most clusters first      //
+// - optimizeVertexFetch: vertex order of first use                     //
+//////////////////////////////////////////////////////////////////////////
+
+namespace mesh {
+
+// Cache size used by the reordering and the statistics
+static const uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats
+{
+    float acmr = 0.f;  // transformed vertices per triangle, 0.5 - 3
+    float atvr = 0.f;  // transformed vertices per referenced vertex, >= 1
+};
+
+//-------------------------------------------------------------------------
+// Simulate a FIFO post-transform cache on the index buffer
+//
+VertexCacheStats analyzeVertexCache(
+    const uint32_t* indices,
+    size_t          nbIndices,
+    size_t          nbVertices,
+    uint32_t        cacheSize = VERTEX_CACHE_SIZE);
+
+//-------------------------------------------------------------------------
+// Tipsify (Sander et al. 2007), fills the triangle order and the first
+// triangle of each cluster started after a cache flush
+//
+void tipsify(
+    const uint32_t*        indices,
+    size_t                 nbIndices,
+    size_t                 nbVertices,
+    std::vector<uint32_t>& triangleOrder,
+    std::vector<uint32_t>& clusters,
+    uint32_t               cacheSize = VERTEX_CACHE_SIZE);
+
+//-------------------------------------------------------------------------
+// Split the clusters where their ACMR stays under threshold times the ACMR
+// of the whole cluster, then sort them so clusters facing away from the
+// mesh center are drawn first. triangleOrder is reordered in place,
+// positionStride is the distance in bytes between two positions.
+//
+void optimizeOverdraw(
+    const uint32_t*              indices,
+    size_t                       nbIndices,
+    size_t                       nbVertices,
+    const float*                 positions,
+    size_t                       positionStride,
+    std::vector<uint32_t>&       triangleOrder,
+    const std::vector<uint32_t>& clusters,
+    float                        threshold = 1.05f,
+    uint32_t                     cacheSize = VERTEX_CACHE_SIZE);
+
+//-------------------------------------------------------------------------
+// Remap vertices in order of first use, returns the number of vertices
+// referenced. remap[old] is the new index or ~0u if unused.
+//
+size_t optimizeVertexFetch(
+    const uint32_t*        indices,
+    size_t                 nbIndices,
+    size_t                 nbVertices,
+    std::vector<uint32_t>& remap);
+
+} // namespace mesh
+} // namespace tools
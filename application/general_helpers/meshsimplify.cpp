@@ -0,0 +1,414 @@
+/*
+ *
+ * Andrew Frost
+ * meshsimplify.cpp
+ * 2020
+ *
+ */
+
+#include "meshsimplify.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace tools {
+namespace mesh {
+
+// Weight of the planes holding open borders in place, relative to the faces
+static const float SIMPLIFY_BORDER_WEIGHT = 2.f;
+
+//-------------------------------------------------------------------------
+// Quadric of the plane n.p + d = 0 with n normalized
+//
+static void addPlane(float* q, float nx, float ny, float nz, float d, float w)
+{
+    q[0] += w * nx * nx;
+    q[1] += w * ny * ny;
+    q[2] += w * nz * nz;
+    q[3] += w * nx * ny;
+    q[4] += w * nx * nz;
+    q[5] += w * ny * nz;
+    q[6] += w * nx * d;
+    q[7] += w * ny * d;
+    q[8] += w * nz * d;
+    q[9] += w * d * d;
+    q[10] += w;
+}
+
+//-------------------------------------------------------------------------
+// Positions are scaled to the unit cube to keep the quadrics precise
+//
+Simplifier::Simplifier(const uint32_t* indices, size_t nbIndices, const float* positions, size_t nbVertices,
+    size_t positionStride, const uint32_t* triangleGroups)
+    : m_indices(indices, indices + nbIndices - nbIndices % 3)
+    , m_nbVertices(nbVertices)
+{
+    const size_t nbTriangles = m_indices.size() / 3;
+    if (triangleGroups)
+        m_triangleGroups.assign(triangleGroups, triangleGroups + nbTriangles);
+    else
+        m_triangleGroups.assign(nbTriangles, 0);
+
+    m_positions.resize(3 * nbVertices);
+    float bmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float bmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (size_t v = 0; v < nbVertices; ++v) {
+        const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + v * positionStride);
+        for (int k = 0; k < 3; ++k) {
+            m_positions[3 * v + k] = p[k];
+            bmin[k]                = std::min(bmin[k], p[k]);
+            bmax[k]                = std::max(bmax[k], p[k]);
+        }
+    }
+
+    const float extent = std::max(bmax[0] - bmin[0], std::max(bmax[1] - bmin[1], bmax[2] - bmin[2]));
+    m_scale            = extent > 0.f ? extent : 1.f;
+    for (size_t v = 0; v < nbVertices; ++v)
+        for (int k = 0; k < 3; ++k)
+            m_positions[3 * v + k] = (m_positions[3 * v + k] - bmin[k]) / m_scale;
+
+    classifyVertices();
+    computeQuadrics();
+}
+
+//-------------------------------------------------------------------------
+// Position groups, open border edges and the kind of each vertex
+//
+void Simplifier::classifyVertices()
+{
+    const size_t nbTriangles = m_indices.size() / 3;
+
+    // Vertices with the same position, sorted by their bits
+    std::vector<uint32_t> order(m_nbVertices);
+    std::iota(order.begin(), order.end(), 0u);
+    auto bits = [this](uint32_t v, int k) {
+        uint32_t b;
+        memcpy(&b, &m_positions[3 * v + k], sizeof(uint32_t));
+        return b;
+    };
+    auto less = [&](uint32_t a, uint32_t b) {
+        for (int k = 0; k < 3; ++k) {
+            if (bits(a, k) != bits(b, k))
+                return bits(a, k) < bits(b, k);
+        }
+        return a < b;
+    };
+    std::sort(order.begin(), order.end(), less);
+
+    m_positionGroup.resize(m_nbVertices);
+    std::vector<uint32_t> groupSize(m_nbVertices, 0);
+    for (size_t i = 0; i < m_nbVertices;) {
+        size_t j = i + 1;
+        while (j < m_nbVertices && bits(order[i], 0) == bits(order[j], 0) && bits(order[i], 1) == bits(order[j], 1)
+               && bits(order[i], 2) == bits(order[j], 2))
+            j++;
+        for (size_t k = i; k < j; ++k)
+            m_positionGroup[order[k]] = order[i];
+        groupSize[order[i]] = static_cast<uint32_t>(j - i);
+        i                   = j;
+    }
+
+    // Directed edges between position groups, open when the reverse is missing
+    std::vector<uint64_t> edges;
+    edges.reserve(3 * nbTriangles);
+    for (size_t t = 0; t < nbTriangles; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            const uint64_t a = m_positionGroup[m_indices[3 * t + k]];
+            const uint64_t b = m_positionGroup[m_indices[3 * t + (k + 1) % 3]];
+            if (a != b)
+                edges.push_back(a << 32 | b);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    m_borderEdges.clear();
+    for (uint64_t edge : edges) {
+        const uint64_t reverse = (edge << 32) | (edge >> 32);
+        if (!std::binary_search(edges.begin(), edges.end(), reverse))
+            m_borderEdges.push_back(edge);
+    }
+
+    std::vector<uint32_t> nbBorderEdges(m_nbVertices, 0);
+    for (uint64_t edge : m_borderEdges) {
+        nbBorderEdges[edge >> 32]++;
+        nbBorderEdges[edge & 0xffffffff]++;
+    }
+
+    // Vertices between two groups of triangles
+    std::vector<uint32_t> vertexGroup(m_nbVertices, ~0u);
+    std::vector<uint8_t>  mixed(m_nbVertices, 0);
+    for (size_t t = 0; t < nbTriangles; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            const uint32_t g = m_positionGroup[m_indices[3 * t + k]];
+            if (vertexGroup[g] == ~0u)
+                vertexGroup[g] = m_triangleGroups[t];
+            else if (vertexGroup[g] != m_triangleGroups[t])
+                mixed[g] = 1;
+        }
+    }
+
+    m_kinds.resize(m_nbVertices);
+    for (size_t v = 0; v < m_nbVertices; ++v) {
+        const uint32_t g = m_positionGroup[v];
+        if (groupSize[g] > 1 || mixed[g])
+            m_kinds[v] = VertexKind::eLocked;
+        else if (nbBorderEdges[g] == 0)
+            m_kinds[v] = VertexKind::eManifold;
+        else if (nbBorderEdges[g] == 2)
+            m_kinds[v] = VertexKind::eBorder;
+        else
+            m_kinds[v] = VertexKind::eLocked;
+    }
+}
+
+//-------------------------------------------------------------------------
+// Area weighted face planes, and planes orthogonal to the open borders
+//
+void Simplifier::computeQuadrics()
+{
+    m_quadrics.assign(m_nbVertices, Quadric{});
+
+    const size_t nbTriangles = m_indices.size() / 3;
+    for (size_t t = 0; t < nbTriangles; ++t) {
+        const uint32_t* triangle = &m_indices[3 * t];
+        const float*    p0       = &m_positions[3 * triangle[0]];
+        const float*    p1       = &m_positions[3 * triangle[1]];
+        const float*    p2       = &m_positions[3 * triangle[2]];
+
+        const float e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        const float e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float       n[3]  = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.f)
+            continue;
+        for (int k = 0; k < 3; ++k)
+            n[k] /= length;
+
+        const float area = 0.5f * length;
+        const float d    = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+        for (int k = 0; k < 3; ++k)
+            addPlane(&m_quadrics[m_positionGroup[triangle[k]]].a00, n[0], n[1], n[2], d, area);
+
+        for (int k = 0; k < 3; ++k) {
+            const uint32_t a = triangle[k];
+            const uint32_t b = triangle[(k + 1) % 3];
+            if (!isBorderEdge(m_positionGroup[a], m_positionGroup[b]))
+                continue;
+
+            const float* pa   = &m_positions[3 * a];
+            const float* pb   = &m_positions[3 * b];
+            const float  e[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+            float        m[3] = { e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0] };
+
+            const float mLength = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+            if (mLength == 0.f)
+                continue;
+            for (int i = 0; i < 3; ++i)
+                m[i] /= mLength;
+
+            const float edgeLength2 = e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+            const float md          = -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]);
+            addPlane(&m_quadrics[m_positionGroup[a]].a00, m[0], m[1], m[2], md, SIMPLIFY_BORDER_WEIGHT * edgeLength2);
+            addPlane(&m_quadrics[m_positionGroup[b]].a00, m[0], m[1], m[2], md, SIMPLIFY_BORDER_WEIGHT * edgeLength2);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// Open edge in either direction between two position groups
+//
+bool Simplifier::isBorderEdge(uint32_t a, uint32_t b) const
+{
+    return std::binary_search(m_borderEdges.begin(), m_borderEdges.end(), uint64_t(a) << 32 | b)
+           || std::binary_search(m_borderEdges.begin(), m_borderEdges.end(), uint64_t(b) << 32 | a);
+}
+
+//-------------------------------------------------------------------------
+// True when moving u onto v turns one of the triangles of u around
+//
+bool Simplifier::hasTriangleFlip(uint32_t u, uint32_t v, const uint32_t* adjacency, uint32_t begin, uint32_t end) const
+{
+    const float* pv = &m_positions[3 * v];
+
+    for (uint32_t a = begin; a < end; ++a) {
+        const uint32_t* triangle = &m_indices[3 * adjacency[a]];
+        if (triangle[0] == v || triangle[1] == v || triangle[2] == v)
+            continue; // removed by the collapse
+
+        // Corners following u
+        const int    k  = triangle[0] == u ? 0 : (triangle[1] == u ? 1 : 2);
+        const float* pu = &m_positions[3 * u];
+        const float* pb = &m_positions[3 * triangle[(k + 1) % 3]];
+        const float* pc = &m_positions[3 * triangle[(k + 2) % 3]];
+
+        auto normal = [](const float* p0, const float* p1, const float* p2, float* n) {
+            const float e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            const float e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            n[0]              = e0[1] * e1[2] - e0[2] * e1[1];
+            n[1]              = e0[2] * e1[0] - e0[0] * e1[2];
+            n[2]              = e0[0] * e1[1] - e0[1] * e1[0];
+        };
+
+        float before[3], after[3];
+        normal(pu, pb, pc, before);
+        normal(pv, pb, pc, after);
+        if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.f)
+            return true;
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------
+// Squared distance error of the merged quadrics at v
+//
+float Simplifier::collapseCost(uint32_t u, uint32_t v) const
+{
+    const Quadric& qu = m_quadrics[m_positionGroup[u]];
+    const Quadric& qv = m_quadrics[m_positionGroup[v]];
+    const float*   p  = &m_positions[3 * v];
+
+    auto evaluate = [p](const Quadric& q) {
+        const float x = p[0], y = p[1], z = p[2];
+        return q.a00 * x * x + q.a11 * y * y + q.a22 * z * z + 2.f * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+               + 2.f * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+    };
+
+    const float w = qu.w + qv.w;
+    return w > 0.f ? std::fabs(evaluate(qu) + evaluate(qv)) / w : 0.f;
+}
+
+//-------------------------------------------------------------------------
+// Passes of independent collapses, cheapest first. A collapse locks the
+// ring of the removed vertex, so the costs and flip tests of the pass stay
+// valid for the other collapses.
+//
+size_t Simplifier::simplify(size_t targetIndexCount, float maxError)
+{
+    const float maxCost = maxError < FLT_MAX ? (maxError / m_scale) * (maxError / m_scale) : FLT_MAX;
+
+    struct Collapse
+    {
+        float    cost;
+        uint32_t u;
+        uint32_t v;
+    };
+
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> remap(m_nbVertices);
+    std::vector<uint8_t>  locked(m_nbVertices);
+
+    while (m_indices.size() > targetIndexCount) {
+        const size_t nbTriangles = m_indices.size() / 3;
+
+        // Triangles around each vertex
+        offsets.assign(m_nbVertices + 1, 0);
+        adjacency.resize(3 * nbTriangles);
+        for (uint32_t index : m_indices)
+            offsets[index + 1]++;
+        for (size_t v = 0; v < m_nbVertices; ++v)
+            offsets[v + 1] += offsets[v];
+        {
+            std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < m_indices.size(); ++i)
+                adjacency[cursor[m_indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        // Cheapest collapse of each vertex
+        collapses.clear();
+        for (uint32_t u = 0; u < m_nbVertices; ++u) {
+            if (m_kinds[u] == VertexKind::eLocked || offsets[u] == offsets[u + 1])
+                continue;
+
+            Collapse best = { FLT_MAX, u, ~0u };
+            for (uint32_t a = offsets[u]; a < offsets[u + 1]; ++a) {
+                const uint32_t* triangle = &m_indices[3 * adjacency[a]];
+                for (int k = 0; k < 3; ++k) {
+                    const uint32_t v = triangle[k];
+                    if (v == u || v == best.v)
+                        continue;
+                    if (m_kinds[u] == VertexKind::eBorder && !isBorderEdge(m_positionGroup[u], m_positionGroup[v]))
+                        continue;
+
+                    const float cost = collapseCost(u, v);
+                    if (cost < best.cost) {
+                        best.cost = cost;
+                        best.v    = v;
+                    }
+                }
+            }
+
+            if (best.v != ~0u && best.cost <= maxCost)
+                collapses.push_back(best);
+        }
+
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        // Independent collapses until the target is reached
+        std::iota(remap.begin(), remap.end(), 0u);
+        std::fill(locked.begin(), locked.end(), uint8_t(0));
+
+        const size_t toRemove = (m_indices.size() - targetIndexCount + 2) / 3;
+        size_t       removed  = 0;
+        size_t       applied  = 0;
+
+        for (const auto& collapse : collapses) {
+            if (removed >= toRemove)
+                break;
+            if (locked[collapse.u] || locked[collapse.v])
+                continue;
+            if (hasTriangleFlip(collapse.u, collapse.v, adjacency.data(), offsets[collapse.u], offsets[collapse.u + 1]))
+                continue;
+
+            remap[collapse.u] = collapse.v;
+
+            Quadric&       target = m_quadrics[m_positionGroup[collapse.v]];
+            const Quadric& source = m_quadrics[m_positionGroup[collapse.u]];
+            for (size_t i = 0; i < sizeof(Quadric) / sizeof(float); ++i)
+                (&target.a00)[i] += (&source.a00)[i];
+
+            locked[collapse.u] = 1;
+            locked[collapse.v] = 1;
+            for (uint32_t a = offsets[collapse.u]; a < offsets[collapse.u + 1]; ++a) {
+                const uint32_t* triangle = &m_indices[3 * adjacency[a]];
+                locked[triangle[0]] = locked[triangle[1]] = locked[triangle[2]] = 1;
+            }
+
+            m_error = std::max(m_error, std::sqrt(collapse.cost) * m_scale);
+            removed += m_kinds[collapse.u] == VertexKind::eBorder ? 1 : 2;
+            applied++;
+        }
+
+        if (applied == 0)
+            break;
+
+        // Dropping the triangles that became degenerate
+        size_t write = 0;
+        for (size_t t = 0; t < nbTriangles; ++t) {
+            const uint32_t a = remap[m_indices[3 * t + 0]];
+            const uint32_t b = remap[m_indices[3 * t + 1]];
+            const uint32_t c = remap[m_indices[3 * t + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+
+            m_indices[3 * write + 0] = a;
+            m_indices[3 * write + 1] = b;
+            m_indices[3 * write + 2] = c;
+            m_triangleGroups[write]  = m_triangleGroups[t];
+            write++;
+        }
+        m_indices.resize(3 * write);
+        m_triangleGroups.resize(write);
+    }
+
+    return m_indices.size();
+}
+
+} // namespace mesh
+} // namespace tools
@@ -0,0 +1,94 @@
+/*
+ *
+ * Andrew Frost
+ * meshsimplify.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <float.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace tools {
+
+//////////////////////////////////////////////////////////////////////////
+// Simplifier                                                           //
+//////////////////////////////////////////////////////////////////////////
+// Quadric error metric edge collapse (Garland and Heckbert 1997)       //
+// - Vertices collapse into one of their neighbors, so the simplified   //
+//   index lists reference the vertex buffer of the full mesh           //
+// - Attribute seams (vertices sharing a position) and vertices between //
+//   two triangle groups are kept, open borders only collapse along the //
+//   border                                                             //
+// - simplify() can be called with decreasing targets to build a chain  //
+//   of levels of detail, quadrics carry over from one to the next      //
+//////////////////////////////////////////////////////////////////////////
+
+namespace mesh {
+
+class Simplifier
+{
+public:
+    //-------------------------------------------------------------------------
+    // positionStride is the distance in bytes between two positions,
+    // triangleGroups (optional) holds a group per triangle, e.g. a material
+    //
+    Simplifier(const uint32_t* indices,
+               size_t          nbIndices,
+               const float*    positions,
+               size_t          nbVertices,
+               size_t          positionStride,
+               const uint32_t* triangleGroups = nullptr);
+
+    //-------------------------------------------------------------------------
+    // Collapse edges until at most targetIndexCount indices are left or no
+    // collapse is under maxError, returns the number of indices
+    //
+    size_t simplify(size_t targetIndexCount, float maxError = FLT_MAX);
+
+    const std::vector<uint32_t>& indices() const { return m_indices; }
+    const std::vector<uint32_t>& triangleGroups() const { return m_triangleGroups; }
+
+    // Largest collapse error so far, as a distance in position units
+    float error() const { return m_error; }
+
+private:
+    struct Quadric
+    {
+        float a00, a11, a22, a01, a02, a12;
+        float b0, b1, b2;
+        float c;
+        float w;
+    };
+
+    enum class VertexKind : uint8_t
+    {
+        eManifold,
+        eBorder,
+        eLocked
+    };
+
+    void  classifyVertices();
+    void  computeQuadrics();
+    bool  isBorderEdge(uint32_t a, uint32_t b) const;
+    bool  hasTriangleFlip(uint32_t u, uint32_t v, const uint32_t* adjacency, uint32_t begin, uint32_t end) const;
+    float collapseCost(uint32_t u, uint32_t v) const;
+
+    std::vector<uint32_t>   m_indices;
+    std::vector<uint32_t>   m_triangleGroups;
+    std::vector<float>      m_positions;      // scaled to the unit cube
+    std::vector<uint32_t>   m_positionGroup;  // first vertex with the same position
+    std::vector<VertexKind> m_kinds;
+    std::vector<Quadric>    m_quadrics;       // per position group
+    std::vector<uint64_t>   m_borderEdges;    // sorted (from << 32 | to) position groups
+    size_t                  m_nbVertices{ 0 };
+    float                   m_scale{ 1.f };
+    float                   m_error{ 0.f };
+};
+
+} // namespace mesh
+} // namespace tools
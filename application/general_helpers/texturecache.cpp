@@ -0,0 +1,457 @@
+/*
+ *
+ * Andrew Frost
+ * texturecache.cpp
+ * 2020
+ *
+ */
+
+#include "texturecache.hpp"
+#include "blockcompression.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+namespace tools {
+namespace texture {
+
+// Bumped when the layout or the mip filtering change, the entries are written again
+static const char     CACHE_MAGIC[4]     = { 'E', 'V', 'T', 'C' };
+static const uint32_t CACHE_VERSION      = 2;
+static const char*    CACHE_EXTENSION    = ".rgba";
+static const uint64_t CACHE_ALIGNMENT    = 16;
+static const uint32_t CACHE_FORMAT_RGBA8 = 0; // Otherwise 1 + the block format
+
+struct CacheHeader
+{
+    char     magic[4];
+    uint32_t version;
+    uint64_t sourceHash;   // Content of the source, checked when its time changed
+    uint64_t sourceSize;
+    int64_t  sourceTime;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t srgb;
+    uint32_t format;
+    uint32_t reserved;
+};
+static_assert(sizeof(CacheHeader) == 56, "texture cache header must be packed");
+
+struct CacheLevel
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Entry to write, its levels are produced in order
+struct TextureCache::Entry
+{
+    uint32_t                                width{ 0 };
+    uint32_t                                height{ 0 };
+    uint32_t                                levelCount{ 0 };
+    bool                                    srgb{ false };
+    uint32_t                                format{ CACHE_FORMAT_RGBA8 };
+    std::function<const uint8_t*(uint32_t)> level;
+};
+
+static inline uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+static inline uint64_t levelBytes(uint32_t format, uint32_t width, uint32_t height, uint32_t level)
+{
+    const uint64_t levelWidth  = std::max(1u, width >> level);
+    const uint64_t levelHeight = std::max(1u, height >> level);
+    if (format == CACHE_FORMAT_RGBA8)
+        return levelWidth * levelHeight * 4;
+    return ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockBytes(static_cast<BlockFormat>(format - 1));
+}
+
+//-------------------------------------------------------------------------
+// Size and time of the source, false when it cannot be accessed
+//
+static bool sourceStamp(const std::string& sourceFile, uint64_t& size, int64_t& time)
+{
+    std::error_code ec;
+    size = std::filesystem::file_size(sourceFile, ec);
+    if (ec)
+        return false;
+    const auto writeTime = std::filesystem::last_write_time(sourceFile, ec);
+    if (ec)
+        return false;
+
+    time = static_cast<int64_t>(writeTime.time_since_epoch().count());
+    return true;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint64_t hashFile(const std::string& filename, uint64_t& fileSize)
+{
+    MappedFile file;
+    fileSize = 0;
+    if (!file.open(filename))
+        return 0;
+
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < file.size(); ++i) {
+        hash ^= file.data()[i];
+        hash *= 1099511628211ull;
+    }
+    fileSize = file.size();
+    return hash;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// CachedTexture                                                         //
+///////////////////////////////////////////////////////////////////////////
+
+const uint8_t* CachedTexture::level(uint32_t level) const
+{
+    CacheLevel entry;
+    memcpy(&entry, m_file.data() + m_levelTable + level * sizeof(CacheLevel), sizeof(CacheLevel));
+    return m_file.data() + entry.offset;
+}
+
+size_t CachedTexture::levelSize(uint32_t level) const
+{
+    CacheLevel entry;
+    memcpy(&entry, m_file.data() + m_levelTable + level * sizeof(CacheLevel), sizeof(CacheLevel));
+    return static_cast<size_t>(entry.size);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// TextureCache                                                          //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// The cache is disabled when the directory cannot be created
+//
+void TextureCache::init(const std::string& directory, uint64_t maxSize)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (!std::filesystem::is_directory(directory, ec)) {
+        std::cerr << "Cannot create texture cache: " << directory << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_directory = directory;
+    m_maxSize   = maxSize;
+    trim();
+}
+
+//-------------------------------------------------------------------------
+// Named after the hash of the absolute source path
+//
+std::string TextureCache::entryName(const std::string& sourceFile, bool srgb, bool compressed) const
+{
+    std::error_code   ec;
+    const auto        absolute = std::filesystem::absolute(sourceFile, ec).lexically_normal();
+    const std::string path     = ec ? sourceFile : absolute.string();
+
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : path) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ull;
+    }
+
+    char name[40];
+    snprintf(name, sizeof(name), "%016llx%s%s", static_cast<unsigned long long>(hash), srgb ? "_srgb" : "",
+             compressed ? "_bc" : "");
+    return (std::filesystem::path(m_directory) / (std::string(name) + CACHE_EXTENSION)).string();
+}
+
+//-------------------------------------------------------------------------
+//
+//
+bool TextureCache::read(const std::string& sourceFile, bool srgb, CachedTexture& texture)
+{
+    return readEntry(sourceFile, srgb, false, texture);
+}
+
+bool TextureCache::readCompressed(const std::string& sourceFile, CachedTexture& texture)
+{
+    return readEntry(sourceFile, false, true, texture);
+}
+
+//-------------------------------------------------------------------------
+// The entry time is updated, so the entries read the least recently are
+// the ones removed. A source with a new time but the same size is hashed,
+// the entry is stamped again when its content did not change.
+//
+bool TextureCache::readEntry(const std::string& sourceFile, bool srgb, bool compressed, CachedTexture& texture)
+{
+    texture.close();
+    if (!isValid())
+        return false;
+
+    uint64_t sourceSize;
+    int64_t  sourceTime;
+    if (!sourceStamp(sourceFile, sourceSize, sourceTime))
+        return false;
+
+    const std::string name = entryName(sourceFile, srgb, compressed);
+
+    std::error_code ec;
+    std::filesystem::last_write_time(name, std::filesystem::file_time_type::clock::now(), ec);
+    if (ec || !texture.m_file.open(name))
+        return false;
+
+    CacheHeader header;
+    if (texture.m_file.size() < sizeof(CacheHeader)) {
+        texture.close();
+        return false;
+    }
+    memcpy(&header, texture.m_file.data(), sizeof(CacheHeader));
+
+    const uint32_t lastFormat = 1 + static_cast<uint32_t>(BlockFormat::eBC7);
+
+    bool valid = memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 && header.version == CACHE_VERSION &&
+                 header.sourceSize == sourceSize && (compressed || header.srgb == (srgb ? 1u : 0u)) &&
+                 (compressed ? header.format != CACHE_FORMAT_RGBA8 && header.format <= lastFormat
+                             : header.format == CACHE_FORMAT_RGBA8) &&
+                 header.levelCount > 0 && header.levelCount <= 32 &&
+                 sizeof(CacheHeader) + header.levelCount * sizeof(CacheLevel) <= texture.m_file.size();
+
+    for (uint32_t level = 0; valid && level < header.levelCount; ++level) {
+        CacheLevel entry;
+        memcpy(&entry, texture.m_file.data() + sizeof(CacheHeader) + level * sizeof(CacheLevel), sizeof(CacheLevel));
+        valid = entry.size == levelBytes(header.format, header.width, header.height, level)
+                && entry.offset + entry.size <= texture.m_file.size();
+    }
+
+    // The mapping is closed while the header is written, the file is shared
+    // for reading only. The entry is checked again once mapped, it may have
+    // been replaced in between.
+    if (valid && header.sourceTime != sourceTime) {
+        uint64_t hashedSize;
+        valid = hashFile(sourceFile, hashedSize) == header.sourceHash && hashedSize == sourceSize;
+        if (valid) {
+            const size_t fileSize = texture.m_file.size();
+            texture.m_file.close();
+
+            header.sourceTime = sourceTime;
+            std::fstream out(name, std::ios::binary | std::ios::in | std::ios::out);
+            if (out.is_open())
+                out.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+            out.close();
+
+            CacheHeader mapped;
+            valid = texture.m_file.open(name) && texture.m_file.size() == fileSize;
+            if (valid) {
+                memcpy(&mapped, texture.m_file.data(), sizeof(CacheHeader));
+                mapped.sourceTime = sourceTime;
+                valid = memcmp(&mapped, &header, sizeof(CacheHeader)) == 0;
+            }
+        }
+    }
+
+    if (!valid) {
+        texture.close();
+        return false;
+    }
+
+    texture.m_width       = header.width;
+    texture.m_height      = header.height;
+    texture.m_levelCount  = header.levelCount;
+    texture.m_compressed  = header.format != CACHE_FORMAT_RGBA8;
+    texture.m_blockFormat = texture.m_compressed ? static_cast<BlockFormat>(header.format - 1) : BlockFormat::eBC1;
+    texture.m_srgb        = header.srgb != 0;
+    texture.m_levelTable  = sizeof(CacheHeader);
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// Each level is filtered from the previous one
+//
+bool TextureCache::write(const std::string& sourceFile, bool srgb, const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+    if (!isValid() || !rgba)
+        return false;
+
+    const uint8_t*       data        = rgba;
+    uint32_t             levelWidth  = width;
+    uint32_t             levelHeight = height;
+    std::vector<uint8_t> level;
+
+    Entry entry;
+    entry.width      = width;
+    entry.height     = height;
+    entry.levelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+    entry.srgb       = srgb;
+    entry.format     = CACHE_FORMAT_RGBA8;
+    entry.level      = [&](uint32_t index) {
+        if (index > 0) {
+            uint32_t nextWidth, nextHeight;
+            level       = downsample(data, levelWidth, levelHeight, srgb, nextWidth, nextHeight);
+            data        = level.data();
+            levelWidth  = nextWidth;
+            levelHeight = nextHeight;
+        }
+        return data;
+    };
+    return writeEntry(sourceFile, entry);
+}
+
+bool TextureCache::writeCompressed(const std::string& sourceFile, const CompressedTexture& texture)
+{
+    if (!isValid() || texture.levels.empty())
+        return false;
+
+    Entry entry;
+    entry.width      = texture.width;
+    entry.height     = texture.height;
+    entry.levelCount = static_cast<uint32_t>(texture.levels.size());
+    entry.srgb       = texture.srgb;
+    entry.format     = 1 + static_cast<uint32_t>(texture.format);
+    entry.level      = [&texture](uint32_t index) { return texture.levels[index].data(); };
+    return writeEntry(sourceFile, entry);
+}
+
+//-------------------------------------------------------------------------
+// Written in a temporary file renamed once complete, the header last, so
+// an interrupted write or another thread writing the same entry never
+// leaves a partial entry
+//
+bool TextureCache::writeEntry(const std::string& sourceFile, const Entry& entry)
+{
+    uint64_t sourceSize;
+    int64_t  sourceTime;
+    if (!sourceStamp(sourceFile, sourceSize, sourceTime))
+        return false;
+
+    uint64_t       hashedSize;
+    const uint64_t hash = hashFile(sourceFile, hashedSize);
+    if (hash == 0 || hashedSize != sourceSize)
+        return false;
+
+    CacheHeader header = {};
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version    = CACHE_VERSION;
+    header.sourceHash = hash;
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    header.width      = entry.width;
+    header.height     = entry.height;
+    header.levelCount = entry.levelCount;
+    header.srgb       = entry.srgb ? 1 : 0;
+    header.format     = entry.format;
+
+    std::vector<CacheLevel> levels(entry.levelCount);
+    uint64_t                offset = sizeof(CacheHeader) + entry.levelCount * sizeof(CacheLevel);
+    for (uint32_t level = 0; level < entry.levelCount; ++level) {
+        offset               = alignOffset(offset, CACHE_ALIGNMENT);
+        levels[level].offset = offset;
+        levels[level].size   = levelBytes(entry.format, entry.width, entry.height, level);
+        offset += levels[level].size;
+    }
+
+    const std::string name     = entryName(sourceFile, entry.srgb && entry.format == CACHE_FORMAT_RGBA8,
+                                           entry.format != CACHE_FORMAT_RGBA8);
+    const std::string tempName = name + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+    std::ofstream out(tempName, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        return false;
+
+    auto writeAt = [&out](uint64_t position, const void* data, size_t size) {
+        out.seekp(static_cast<std::streamoff>(position));
+        out.write(reinterpret_cast<const char*>(data), size);
+    };
+
+    const CacheHeader invalid = {};
+    writeAt(0, &invalid, sizeof(CacheHeader));
+    writeAt(sizeof(CacheHeader), levels.data(), levels.size() * sizeof(CacheLevel));
+    for (uint32_t level = 0; level < entry.levelCount; ++level)
+        writeAt(levels[level].offset, entry.level(level), static_cast<size_t>(levels[level].size));
+    writeAt(0, &header, sizeof(CacheHeader));
+    out.close();
+
+    // an edited source replaces its entry
+    std::error_code ec;
+    uint64_t        replacedSize = std::filesystem::file_size(name, ec);
+    if (ec)
+        replacedSize = 0;
+
+    if (!out.fail())
+        std::filesystem::rename(tempName, name, ec);
+
+    if (out.fail() || ec) {
+        std::filesystem::remove(tempName, ec);
+        // the entry written by another thread is still valid
+        return std::filesystem::exists(name, ec);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_size = m_size + offset - std::min(m_size, replacedSize);
+    if (m_size > m_maxSize)
+        trim();
+    return true;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint64_t TextureCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_size;
+}
+
+//-------------------------------------------------------------------------
+// Sizes read from the directory, the oldest entries are removed until the
+// cache fits. Entries still mapped by a reader may fail to be removed.
+//
+void TextureCache::trim()
+{
+    struct Entry
+    {
+        std::filesystem::path           path;
+        std::filesystem::file_time_type time;
+        uint64_t                        size;
+    };
+
+    std::vector<Entry> entries;
+    std::error_code    ec;
+    m_size = 0;
+
+    for (const auto& file : std::filesystem::directory_iterator(m_directory, ec)) {
+        if (file.path().extension() != CACHE_EXTENSION)
+            continue;
+
+        Entry entry;
+        entry.path = file.path();
+        entry.time = file.last_write_time(ec);
+        entry.size = file.file_size(ec);
+        if (ec)
+            continue;
+
+        m_size += entry.size;
+        entries.push_back(entry);
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+
+    for (const auto& entry : entries) {
+        if (m_size <= m_maxSize)
+            break;
+        if (std::filesystem::remove(entry.path, ec))
+            m_size -= entry.size;
+    }
+}
+
+} // namespace texture
+} // namespace tools
@@ -0,0 +1,118 @@
+/*
+ *
+ * Andrew Frost
+ * texturecache.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string>
+
+#include "blockcompression.hpp"
+#include "mappedfile.hpp"
+
+namespace tools {
+
+//////////////////////////////////////////////////////////////////////////
+// Texture Cache                                                        //
+//////////////////////////////////////////////////////////////////////////
+// Decoded RGBA8 or block compressed textures with their full mip      //
+// chain, stored on disk                                                //
+// - One file per source image path, an edited image overwrites it      //
+// - The size and time of the source are checked on each read, its      //
+//   content is hashed only when they do not match the entry           //
+// - Flat layout: a header, the level table and the texels, read by     //
+//   mapping the file and copied as is to the staging memory            //
+// - The least recently used entries are removed when the cache grows   //
+//   over its size                                                      //
+// - Thread safe, the textures are loaded on the thread pool            //
+//////////////////////////////////////////////////////////////////////////
+
+namespace texture {
+
+//-------------------------------------------------------------------------
+// FNV-1a of the file content, 0 when it cannot be read
+//
+uint64_t hashFile(const std::string& filename, uint64_t& fileSize);
+
+// Texture mapped from a cache entry, level 0 first
+class CachedTexture
+{
+public:
+    bool isOpen() const { return m_file.isOpen(); }
+    void close() { m_file.close(); m_levelCount = 0; }
+
+    uint32_t       width() const { return m_width; }
+    uint32_t       height() const { return m_height; }
+    uint32_t       levelCount() const { return m_levelCount; }
+    bool           compressed() const { return m_compressed; }
+    BlockFormat    blockFormat() const { return m_blockFormat; }
+    bool           srgb() const { return m_srgb; }
+    const uint8_t* level(uint32_t level) const;
+    size_t         levelSize(uint32_t level) const;
+
+private:
+    friend class TextureCache;
+
+    MappedFile  m_file;
+    uint32_t    m_width{ 0 };
+    uint32_t    m_height{ 0 };
+    uint32_t    m_levelCount{ 0 };
+    bool        m_compressed{ false };
+    BlockFormat m_blockFormat{ BlockFormat::eBC1 };
+    bool        m_srgb{ false };
+    size_t      m_levelTable{ 0 }; // Offset of the level table in the file
+};
+
+class TextureCache
+{
+public:
+    static const uint64_t DEFAULT_MAX_SIZE = uint64_t(1024) * 1024 * 1024;
+
+    //-------------------------------------------------------------------------
+    // Creates the directory, the entries over 'maxSize' are removed
+    //
+    void init(const std::string& directory, uint64_t maxSize = DEFAULT_MAX_SIZE);
+
+    bool isValid() const { return !m_directory.empty(); }
+
+    //-------------------------------------------------------------------------
+    // False when the source image has no entry or it is invalid
+    //
+    bool read(const std::string& sourceFile, bool srgb, CachedTexture& texture);
+
+    //-------------------------------------------------------------------------
+    // Builds the levels of the decoded source image, filtered in linear space
+    // for sRGB data, and writes its entry. False if it cannot be written.
+    //
+    bool write(const std::string& sourceFile, bool srgb, const uint8_t* rgba, uint32_t width, uint32_t height);
+
+    //-------------------------------------------------------------------------
+    // Block compressed entry of the source image, its format and color space
+    // are read from the entry
+    //
+    bool readCompressed(const std::string& sourceFile, CachedTexture& texture);
+    bool writeCompressed(const std::string& sourceFile, const CompressedTexture& texture);
+
+    uint64_t size() const;
+
+private:
+    struct Entry;
+
+    bool        readEntry(const std::string& sourceFile, bool srgb, bool compressed, CachedTexture& texture);
+    bool        writeEntry(const std::string& sourceFile, const Entry& entry);
+    std::string entryName(const std::string& sourceFile, bool srgb, bool compressed) const;
+    void        trim();
+
+    std::string        m_directory;
+    uint64_t           m_maxSize{ DEFAULT_MAX_SIZE };
+    uint64_t           m_size{ 0 };  // Of all the entries
+    mutable std::mutex m_mutex;
+
+}; // class TextureCache
+
+} // namespace texture
+} // namespace tools
@@ -0,0 +1,198 @@
+/*
+ *
+ * Andrew Frost
+ * threadpool.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace tools {
+
+///////////////////////////////////////////////////////////////////////////
+// ThreadPool                                                            //
+///////////////////////////////////////////////////////////////////////////
+// Fixed set of worker threads consuming a FIFO of tasks                 //
+// - submit()      : run a task, returns a future of its result          //
+// - parallelFor() : run fn(i) for i in [0, count), the calling thread   //
+//                   takes part so it can be nested from a worker        //
+///////////////////////////////////////////////////////////////////////////
+
+class ThreadPool
+{
+public:
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    //-------------------------------------------------------------------------
+    // 0 threads uses all hardware threads
+    //
+    explicit ThreadPool(uint32_t nbThreads = 0)
+    {
+        if (nbThreads == 0)
+            nbThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        m_workers.reserve(nbThreads);
+        for (uint32_t i = 0; i < nbThreads; ++i)
+            m_workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+
+        for (auto& worker : m_workers)
+            worker.join();
+    }
+
+    //-------------------------------------------------------------------------
+    // Shared pool of the application
+    //
+    static ThreadPool& Singleton()
+    {
+        static ThreadPool threadPool;
+        return threadPool;
+    }
+
+    uint32_t size() const { return static_cast<uint32_t>(m_workers.size()); }
+
+    //-------------------------------------------------------------------------
+    // Queue a task
+    //
+    template <typename F>
+    auto submit(F&& task) -> std::future<decltype(task())>
+    {
+        using Result = decltype(task());
+
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.emplace([packaged] { (*packaged)(); });
+        }
+        m_condition.notify_one();
+
+        return result;
+    }
+
+    //-------------------------------------------------------------------------
+    // Calls fn(i) for all i in [0, count) and returns when all are done.
+    // Helpers that start after the work is consumed return immediately,
+    // so nesting never waits on a task stuck in the queue. The first
+    // exception thrown by fn stops the remaining indices and is rethrown
+    // once the helpers are done with fn.
+    //
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn)
+    {
+        if (count == 0)
+            return;
+
+        if (count == 1 || m_workers.empty()) {
+            for (size_t i = 0; i < count; ++i)
+                fn(i);
+            return;
+        }
+
+        struct Shared
+        {
+            std::atomic<size_t>                next{ 0 };
+            size_t                             count{ 0 };
+            uint32_t                           started{ 0 };
+            uint32_t                           finished{ 0 };
+            const std::function<void(size_t)>* fn{ nullptr };
+            std::exception_ptr                 error;
+            std::mutex                         mutex;
+            std::condition_variable            done;
+        };
+
+        auto shared   = std::make_shared<Shared>();
+        shared->count = count;
+        shared->fn    = &fn;
+
+        auto consume = [](Shared& state) {
+            try {
+                for (size_t i = state.next++; i < state.count; i = state.next++)
+                    (*state.fn)(i);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if (!state.error)
+                    state.error = std::current_exception();
+                state.next = state.count;
+            }
+        };
+
+        const size_t nbHelpers = std::min(count - 1, m_workers.size());
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (size_t h = 0; h < nbHelpers; ++h) {
+                m_tasks.emplace([shared, consume] {
+                    {
+                        std::lock_guard<std::mutex> lock(shared->mutex);
+                        if (shared->next >= shared->count)
+                            return;
+                        shared->started++;
+                    }
+                    consume(*shared);
+                    {
+                        std::lock_guard<std::mutex> lock(shared->mutex);
+                        shared->finished++;
+                    }
+                    shared->done.notify_one();
+                });
+            }
+        }
+        m_condition.notify_all();
+
+        consume(*shared);
+
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->done.wait(lock, [&] { return shared->started == shared->finished; });
+
+        if (shared->error)
+            std::rethrow_exception(shared->error);
+    }
+
+private:
+    void workerLoop()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+                if (m_stop && m_tasks.empty())
+                    return;
+                task = std::move(m_tasks.front());
+                m_tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread>          m_workers;
+    std::queue<std::function<void()>> m_tasks;
+    std::mutex                        m_mutex;
+    std::condition_variable           m_condition;
+    bool                              m_stop{ false };
+
+}; // class ThreadPool
+
+} // namespace tools
@@ -31,6 +31,9 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
 #ifdef _MSC_VER
 #  include <intrin.h>
 #  define __builtin_popcount __popcnt
@@ -46,6 +49,13 @@ namespace tools {
   Its primary use is within allocators that sub-allocate from fixed-size blocks.
 
   The implementation is based on [MakeID by Emil Persson](http://www.humus.name/3D/MakeID.h).
+  The free ranges are a sorted array, inserts and removals move the ranges after them,
+  and the sizes are 32 bits.
+
+  TRangeAllocator<GRANULARITY, RangeBackend::eTLSF> has the same interface with 64 bit
+  sizes (size_type), the free ranges are in two-level segregated fit bins:
+  allocations and frees are O(1), the only search is in the hash table of the
+  allocated ranges. A free must be of a whole allocated range.
 
   Example :
 
@@ -81,8 +91,14 @@ namespace tools {
   ~~~
 */
 
+enum class RangeBackend
+{
+    eSortedArray,  // MakeID
+    eTLSF,
+};
+
 // GRANULARITY must be power of two
-template <uint32_t GRANULARITY = 256>
+template <uint32_t GRANULARITY = 256, RangeBackend BACKEND = RangeBackend::eSortedArray>
 class TRangeAllocator
 {
 private:
@@ -90,6 +106,8 @@ private:
     uint32_t m_used;
 
 public:
+    using size_type = uint32_t;
+
     TRangeAllocator() {}
     TRangeAllocator(uint32_t size) { init(size); }
 
@@ -110,6 +128,9 @@ public:
 
     bool isEmpty() const { return m_used == 0; }
 
+    // bytes allocated, the aligned sizes returned by subAllocate
+    uint32_t usedSize() const { return m_used; }
+
     bool isAvailable(uint32_t size, uint32_t align) const
     {
         uint32_t alignRest = align - 1;
@@ -129,6 +150,23 @@ public:
         return isRangeAvailable(countReserved);
     }
 
+    // size of the largest free range, any allocation up to it succeeds when
+    // align <= GRANULARITY
+    uint32_t largestFreeRange() const
+    {
+        if (m_used >= m_size)
+        {
+            return 0;
+        }
+
+        uint32_t largest = 0;
+        for (uint32_t i = 0; i < m_Count; i++)
+        {
+            largest = std::max(largest, 1 + m_Ranges[i].m_Last - m_Ranges[i].m_First);
+        }
+        return largest * GRANULARITY;
+    }
+
     bool subAllocate(uint32_t size, uint32_t align, uint32_t& outOffset, uint32_t& outAligned, uint32_t& outSize)
     {
         uint32_t alignRest = align - 1;
@@ -544,4 +582,440 @@ public:
     }
 };
 
+//////////////////////////////////////////////////////////////////////////
+// Two-level segregated fit backend
+// - The first level is the power of two of the page count, the second
+//   level splits it in SL_COUNT linear bins. Bitmaps of the non empty
+//   bins give the first bin whose ranges all hold the count.
+// - Ranges, free or allocated, are nodes linked in address order, so a
+//   freed range merges with its free neighbors at once
+// - Allocated ranges are found from their offset in an open addressing
+//   hash table
+
+template <uint32_t GRANULARITY>
+class TRangeAllocator<GRANULARITY, RangeBackend::eTLSF>
+{
+public:
+    using size_type = uint64_t;
+
+    TRangeAllocator() { deinit(); }
+    TRangeAllocator(size_type size) { init(size); }
+
+    static size_type alignedSize(size_type size) { return (size + GRANULARITY - 1) & (~size_type(GRANULARITY - 1)); }
+
+    void init(size_type size)
+    {
+        assert(size % GRANULARITY == 0 && "managed total size must be aligned to GRANULARITY");
+
+        deinit();
+        m_size = size;
+        m_used = 0;
+        if (size)
+        {
+            insertFree(createNode(0, size / GRANULARITY, INVALID, INVALID));
+        }
+    }
+
+    void deinit()
+    {
+        m_nodes.clear();
+        m_unusedNodes.clear();
+        m_keys.clear();
+        m_values.clear();
+        m_tableCount = 0;
+        m_flBitmap = 0;
+        memset(m_slBitmaps, 0, sizeof(m_slBitmaps));
+        memset(m_bins, 0xff, sizeof(m_bins));
+        m_size = 0;
+        m_used = 0;
+    }
+
+    bool isEmpty() const { return m_used == 0; }
+
+    // bytes allocated, the aligned sizes returned by subAllocate
+    size_type usedSize() const { return m_used; }
+
+    bool isAvailable(size_type size, size_type align) const
+    {
+        return findFree(reservedPages(size, align)) != INVALID;
+    }
+
+    // size of the largest free range, any allocation up to it succeeds when
+    // align <= GRANULARITY
+    size_type largestFreeRange() const
+    {
+        if (!m_flBitmap)
+        {
+            return 0;
+        }
+
+        // the ranges of the last bin differ by less than its width
+        const uint32_t fl = bitScanReverse(m_flBitmap);
+        const uint32_t sl = bitScanReverse(m_slBitmaps[fl]);
+        size_type largest = 0;
+        for (uint32_t i = m_bins[fl][sl]; i != INVALID; i = m_nodes[i].nextFree)
+        {
+            largest = std::max(largest, m_nodes[i].count);
+        }
+        return largest * GRANULARITY;
+    }
+
+    bool subAllocate(size_type size, size_type align, size_type& outOffset, size_type& outAligned, size_type& outSize)
+    {
+        outOffset = 0;
+        outAligned = 0;
+        outSize = 0;
+
+        const uint32_t index = findFree(reservedPages(size, align));
+        if (index == INVALID)
+        {
+            return false;
+        }
+        removeFree(index);
+
+        // the pages before the aligned offset and after the size stay free
+        const size_type offset = m_nodes[index].first * GRANULARITY;
+        const size_type aligned = (offset + align - 1) / align * align;
+        const size_type skipFront = (aligned - offset) / GRANULARITY;
+        const size_type usedPages = (alignedSize(aligned + std::max(size, size_type(1))) - offset) / GRANULARITY - skipFront;
+
+        uint32_t used = index;
+        if (skipFront)
+        {
+            used = splitNode(index, skipFront);
+            insertFree(index);
+        }
+        if (m_nodes[used].count > usedPages)
+        {
+            insertFree(splitNode(used, usedPages));
+        }
+
+        Node& node = m_nodes[used];
+        node.free = false;
+        tableInsert(node.first, used);
+
+        outOffset = node.first * GRANULARITY;
+        outAligned = aligned;
+        outSize = node.count * GRANULARITY;
+        m_used += outSize;
+
+        assert((outAligned + size) <= (outOffset + outSize));
+        return true;
+    }
+
+    void subFree(size_type offset, size_type size)
+    {
+        assert(offset % GRANULARITY == 0);
+        assert(size % GRANULARITY == 0);
+
+        uint32_t index = tableRemove(offset / GRANULARITY);
+        assert(index != INVALID && "not an allocated range");
+        assert(m_nodes[index].count * GRANULARITY == size && "a free must be of a whole allocated range");
+        (void)size;
+
+        m_used -= m_nodes[index].count * GRANULARITY;
+
+        const uint32_t prev = m_nodes[index].prevPhys;
+        if (prev != INVALID && m_nodes[prev].free)
+        {
+            removeFree(prev);
+            mergeNext(prev);
+            index = prev;
+        }
+
+        const uint32_t next = m_nodes[index].nextPhys;
+        if (next != INVALID && m_nodes[next].free)
+        {
+            removeFree(next);
+            mergeNext(index);
+        }
+
+        insertFree(index);
+    }
+
+private:
+    static const uint32_t INVALID = ~0u;
+    static const uint32_t SL_LOG2 = 4;
+    static const uint32_t SL_COUNT = 1 << SL_LOG2;
+    static const uint32_t FL_COUNT = 64 - SL_LOG2 + 1;
+
+    struct Node
+    {
+        size_type first;     // in pages
+        size_type count;
+        uint32_t  prevPhys;  // neighbors in address order
+        uint32_t  nextPhys;
+        uint32_t  prevFree;  // in the bin, free nodes only
+        uint32_t  nextFree;
+        bool      free;
+    };
+
+    size_type m_size = 0;
+    size_type m_used = 0;
+
+    std::vector<Node>     m_nodes;
+    std::vector<uint32_t> m_unusedNodes;
+
+    uint64_t m_flBitmap = 0;
+    uint32_t m_slBitmaps[FL_COUNT] = {};
+    uint32_t m_bins[FL_COUNT][SL_COUNT];
+
+    // allocated ranges by first page, ~0 for the empty entries
+    std::vector<size_type> m_keys;
+    std::vector<uint32_t>  m_values;
+    size_t                 m_tableCount = 0;
+
+    static uint32_t bitScanForward(uint64_t mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, mask);
+        return index;
+#else
+        return __builtin_ctzll(mask);
+#endif
+    }
+
+    static uint32_t bitScanReverse(uint64_t mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, mask);
+        return index;
+#else
+        return 63 - __builtin_clzll(mask);
+#endif
+    }
+
+    static size_type reservedPages(size_type size, size_type align)
+    {
+        // an offset at GRANULARITY is aligned, otherwise the worst case padding
+        const size_type padding = (align > GRANULARITY || GRANULARITY % align != 0) ? align - 1 : 0;
+        return std::max(alignedSize(size + padding) / GRANULARITY, size_type(1));
+    }
+
+    // bin of a range of 'count' pages
+    static void mapping(size_type count, uint32_t& fl, uint32_t& sl)
+    {
+        if (count < SL_COUNT)
+        {
+            fl = 0;
+            sl = uint32_t(count);
+        }
+        else
+        {
+            const uint32_t log = bitScanReverse(count);
+            fl = log - SL_LOG2 + 1;
+            sl = uint32_t(count >> (log - SL_LOG2)) ^ SL_COUNT;
+        }
+    }
+
+    // first range of a bin whose ranges all hold 'count' pages
+    uint32_t findFree(size_type count) const
+    {
+        // rounded up to the next bin, unless it is the first of its bin
+        if (count >= SL_COUNT)
+        {
+            const size_type round = (size_type(1) << (bitScanReverse(count) - SL_LOG2)) - 1;
+            if (count + round < count)
+            {
+                return INVALID;
+            }
+            count += round;
+        }
+
+        uint32_t fl, sl;
+        mapping(count, fl, sl);
+        if (fl >= FL_COUNT)
+        {
+            return INVALID;
+        }
+
+        uint32_t slMap = m_slBitmaps[fl] & (~0u << sl);
+        if (!slMap)
+        {
+            const uint64_t flMap = fl + 1 < 64 ? m_flBitmap & (~uint64_t(0) << (fl + 1)) : 0;
+            if (!flMap)
+            {
+                return INVALID;
+            }
+            fl = bitScanForward(flMap);
+            slMap = m_slBitmaps[fl];
+        }
+        sl = bitScanForward(slMap);
+        return m_bins[fl][sl];
+    }
+
+    void insertFree(uint32_t index)
+    {
+        Node& node = m_nodes[index];
+        uint32_t fl, sl;
+        mapping(node.count, fl, sl);
+
+        node.free = true;
+        node.prevFree = INVALID;
+        node.nextFree = m_bins[fl][sl];
+        if (node.nextFree != INVALID)
+        {
+            m_nodes[node.nextFree].prevFree = index;
+        }
+        m_bins[fl][sl] = index;
+        m_slBitmaps[fl] |= 1u << sl;
+        m_flBitmap |= uint64_t(1) << fl;
+    }
+
+    void removeFree(uint32_t index)
+    {
+        Node& node = m_nodes[index];
+        uint32_t fl, sl;
+        mapping(node.count, fl, sl);
+
+        if (node.prevFree != INVALID)
+        {
+            m_nodes[node.prevFree].nextFree = node.nextFree;
+        }
+        else
+        {
+            m_bins[fl][sl] = node.nextFree;
+        }
+        if (node.nextFree != INVALID)
+        {
+            m_nodes[node.nextFree].prevFree = node.prevFree;
+        }
+
+        if (m_bins[fl][sl] == INVALID)
+        {
+            m_slBitmaps[fl] &= ~(1u << sl);
+            if (!m_slBitmaps[fl])
+            {
+                m_flBitmap &= ~(uint64_t(1) << fl);
+            }
+        }
+        node.free = false;
+    }
+
+    uint32_t createNode(size_type first, size_type count, uint32_t prevPhys, uint32_t nextPhys)
+    {
+        uint32_t index;
+        if (!m_unusedNodes.empty())
+        {
+            index = m_unusedNodes.back();
+            m_unusedNodes.pop_back();
+        }
+        else
+        {
+            index = uint32_t(m_nodes.size());
+            m_nodes.emplace_back();
+        }
+
+        Node& node = m_nodes[index];
+        node.first = first;
+        node.count = count;
+        node.prevPhys = prevPhys;
+        node.nextPhys = nextPhys;
+        node.prevFree = INVALID;
+        node.nextFree = INVALID;
+        node.free = false;
+        return index;
+    }
+
+    // the node keeps its first 'count' pages, returns the node of the others
+    uint32_t splitNode(uint32_t index, size_type count)
+    {
+        const Node     node = m_nodes[index];
+        const uint32_t rest = createNode(node.first + count, node.count - count, index, node.nextPhys);
+        if (node.nextPhys != INVALID)
+        {
+            m_nodes[node.nextPhys].prevPhys = rest;
+        }
+        m_nodes[index].count = count;
+        m_nodes[index].nextPhys = rest;
+        return rest;
+    }
+
+    // the next node is added to the node, and becomes unused
+    void mergeNext(uint32_t index)
+    {
+        const uint32_t next = m_nodes[index].nextPhys;
+        const Node     nextNode = m_nodes[next];
+        m_nodes[index].count += nextNode.count;
+        m_nodes[index].nextPhys = nextNode.nextPhys;
+        if (nextNode.nextPhys != INVALID)
+        {
+            m_nodes[nextNode.nextPhys].prevPhys = index;
+        }
+        m_unusedNodes.push_back(next);
+    }
+
+    size_t tableSlot(size_type key) const
+    {
+        return size_t((key * 0x9E3779B97F4A7C15ull) >> 32) & (m_keys.size() - 1);
+    }
+
+    void tableInsert(size_type key, uint32_t value)
+    {
+        // at most half full
+        if ((m_tableCount + 1) * 2 > m_keys.size())
+        {
+            std::vector<size_type> keys(std::max(m_keys.size() * 2, size_t(16)), ~size_type(0));
+            std::vector<uint32_t>  values(keys.size());
+            keys.swap(m_keys);
+            values.swap(m_values);
+            m_tableCount = 0;
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                if (keys[i] != ~size_type(0))
+                {
+                    tableInsert(keys[i], values[i]);
+                }
+            }
+        }
+
+        size_t slot = tableSlot(key);
+        while (m_keys[slot] != ~size_type(0))
+        {
+            slot = (slot + 1) & (m_keys.size() - 1);
+        }
+        m_keys[slot] = key;
+        m_values[slot] = value;
+        m_tableCount++;
+    }
+
+    uint32_t tableRemove(size_type key)
+    {
+        if (m_keys.empty())
+        {
+            return INVALID;
+        }
+
+        const size_t mask = m_keys.size() - 1;
+        size_t slot = tableSlot(key);
+        while (m_keys[slot] != key)
+        {
+            if (m_keys[slot] == ~size_type(0))
+            {
+                return INVALID;
+            }
+            slot = (slot + 1) & mask;
+        }
+        const uint32_t value = m_values[slot];
+
+        // the following entries of the cluster are shifted back into the hole
+        size_t hole = slot;
+        for (size_t next = (slot + 1) & mask; m_keys[next] != ~size_type(0); next = (next + 1) & mask)
+        {
+            const size_t home = tableSlot(m_keys[next]);
+            if (((next - home) & mask) >= ((next - hole) & mask))
+            {
+                m_keys[hole] = m_keys[next];
+                m_values[hole] = m_values[next];
+                hole = next;
+            }
+        }
+        m_keys[hole] = ~size_type(0);
+        m_tableCount--;
+        return value;
+    }
+};
+
 }  // namespace nvh
@@ -2,6 +2,12 @@
 
 
 C:/VulkanSDK/1.2.135.0/Bin/glslc.exe frag_shader.frag -o frag_shader.frag.spv
+C:/VulkanSDK/1.2.135.0/Bin/spirv-val.exe --target-env vulkan1.0 --scalar-block-layout frag_shader.frag.spv
 C:/VulkanSDK/1.2.135.0/Bin/glslc.exe vert_shader.vert -o vert_shader.vert.spv
+C:/VulkanSDK/1.2.135.0/Bin/spirv-val.exe --target-env vulkan1.0 --scalar-block-layout vert_shader.vert.spv
+C:/VulkanSDK/1.2.135.0/Bin/glslc.exe -DCOMPACT_VERTEX vert_shader.vert -o vert_shader_compact.vert.spv
+C:/VulkanSDK/1.2.135.0/Bin/spirv-val.exe --target-env vulkan1.0 --scalar-block-layout vert_shader_compact.vert.spv
 C:/VulkanSDK/1.2.135.0/Bin/glslc.exe post.frag -o post.frag.spv 
-C:/VulkanSDK/1.2.135.0/Bin/glslc.exe passthrough.vert -o passthrough.vert.spv 
\ No newline at end of file
+C:/VulkanSDK/1.2.135.0/Bin/glslc.exe passthrough.vert -o passthrough.vert.spv
+C:/VulkanSDK/1.2.135.0/Bin/glslc.exe mipmaps.comp -o mipmaps.comp.spv
+C:/VulkanSDK/1.2.135.0/Bin/spirv-val.exe --target-env vulkan1.0 mipmaps.comp.spv
@@ -13,6 +13,12 @@ layout(push_constant) uniform shaderInformation
   uint  instanceId;
   float lightIntensity;
   int   lightType;
+  vec2  uvOffset;
+  vec4  posOffset;
+  vec4  posScale;
+  vec2  uvScale;
+  int   primitiveOffset;  // first triangle of the LOD drawn
+  uint  feedbackOffset;   // region of the frame in the texture feedback
 }
 pushC;
 
@@ -30,9 +36,13 @@ layout(binding = 1, scalar) buffer MatColorBufferObject { WaveFrontMaterial m[];
 layout(binding = 2, scalar) buffer ScnDesc { sceneDesc i[]; } scnDesc;
 layout(binding = 3) uniform sampler2D[] textureSamplers;
 layout(binding = 4, scalar) buffer MatIndex { int i[]; } matIdx[];
+layout(binding = 5) buffer TextureFeedback { uint lod[]; } feedback;
 
 // clang-format on
 
+// Levels sampled are written relative to the resident ones, see TextureStreamer
+#define FEEDBACK_LOD_OFFSET 16
+
 
 void main()
 {
@@ -40,7 +50,7 @@ void main()
   int objId = scnDesc.i[pushC.instanceId].objId;
 
   // Material of the object
-  int               matIndex = matIdx[nonuniformEXT(objId)].i[gl_PrimitiveID];
+  int               matIndex = matIdx[nonuniformEXT(objId)].i[pushC.primitiveOffset + gl_PrimitiveID];
   WaveFrontMaterial mat      = materials[nonuniformEXT(objId)].m[matIndex];
 
   vec3 N = normalize(fragNormal);
@@ -65,10 +75,25 @@ void main()
   vec3 diffuse = computeDiffuse(mat, L, N);
   if(mat.textureId >= 0)
   {
-    int  txtOffset  = scnDesc.i[pushC.instanceId].txtOffset;
-    uint txtId      = txtOffset + mat.textureId;
-    vec3 diffuseTxt = texture(textureSamplers[nonuniformEXT(txtId)], fragTexCoord).xyz;
+    int  txtOffset = scnDesc.i[pushC.instanceId].txtOffset;
+    uint txtId     = txtOffset + mat.textureId;
+
+    // Textures packed in an atlas repeat inside their rectangle, the gradients
+    // are taken before wrapping the coordinates
+    vec2 uv   = fragTexCoord;
+    vec2 dUVx = dFdx(fragTexCoord) * mat.uvScale;
+    vec2 dUVy = dFdy(fragTexCoord) * mat.uvScale;
+    if(mat.uvScale != vec2(1.0))
+      uv = mat.uvOffset + fract(uv) * mat.uvScale;
+
+    vec3 diffuseTxt = textureGrad(textureSamplers[nonuniformEXT(txtId)], uv, dUVx, dUVy).xyz;
     diffuse *= diffuseTxt;
+
+    // Level for the texture streaming, written by one fragment in 16. Queried
+    // before wrapping, the jump of fract() at the tile edges is not a level
+    float lod = textureQueryLod(textureSamplers[nonuniformEXT(txtId)], mat.uvOffset + fragTexCoord * mat.uvScale).y;
+    if(((uint(gl_FragCoord.x) | uint(gl_FragCoord.y)) & 3) == 0)
+      atomicMin(feedback.lod[pushC.feedbackOffset + txtId], uint(clamp(floor(lod) + FEEDBACK_LOD_OFFSET, 0.0, 31.0)));
   }
 
   // Specular
@@ -9,7 +9,7 @@
 layout(binding = 2, set = 0, scalar) buffer ScnDesc { sceneDesc i[]; } scnDesc;
 // clang-format on
 
-layout(binding = 0) uniform UniformBufferObject
+layout(set = 1, binding = 0) uniform UniformBufferObject
 {
   mat4 view;
   mat4 proj;
@@ -23,13 +23,26 @@ layout(push_constant) uniform shaderInformation
   uint  instanceId;
   float lightIntensity;
   int   lightType;
+  vec2  uvOffset;   // bounds of the compact vertex attributes
+  vec4  posOffset;
+  vec4  posScale;
+  vec2  uvScale;
+  int   primitiveOffset;  // first triangle of the LOD drawn
+  uint  feedbackOffset;   // region of the frame in the texture feedback
 }
 pushC;
 
+#ifdef COMPACT_VERTEX
+// Quantized attributes in [0, 1] and octahedral normal
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 3) in vec2 inTexCoord;
+#else
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec3 inColor;
 layout(location = 3) in vec2 inTexCoord;
+#endif
 
 
 //layout(location = 0) flat out int matIndex;
@@ -44,17 +57,37 @@ out gl_PerVertex
 };
 
 
+#ifdef COMPACT_VERTEX
+vec3 decodeOctahedral(vec2 e)
+{
+  vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if(v.z < 0.0)
+    v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+  return normalize(v);
+}
+#endif
+
 void main()
 {
+#ifdef COMPACT_VERTEX
+  vec3 position = pushC.posOffset.xyz + inPosition.xyz * pushC.posScale.xyz;
+  vec3 normal   = decodeOctahedral(inNormal);
+  vec2 texCoord = pushC.uvOffset + inTexCoord * pushC.uvScale;
+#else
+  vec3 position = inPosition;
+  vec3 normal   = inNormal;
+  vec2 texCoord = inTexCoord;
+#endif
+
   mat4 objMatrix   = scnDesc.i[pushC.instanceId].transfo;
   mat4 objMatrixIT = scnDesc.i[pushC.instanceId].transfoIT;
 
   vec3 origin = vec3(ubo.viewI * vec4(0, 0, 0, 1));
 
-  worldPos     = vec3(objMatrix * vec4(inPosition, 1.0));
+  worldPos     = vec3(objMatrix * vec4(position, 1.0));
   viewDir      = vec3(worldPos - origin);
-  fragTexCoord = inTexCoord;
-  fragNormal   = vec3(objMatrixIT * vec4(inNormal, 0.0));
+  fragTexCoord = texCoord;
+  fragNormal   = vec3(objMatrixIT * vec4(normal, 0.0));
   //  matIndex     = inMatID;
 
   gl_Position = ubo.proj * ubo.view * vec4(worldPos, 1.0);
@@ -18,6 +18,8 @@ struct WaveFrontMaterial
   float dissolve;  // 1 == opaque; 0 == fully transparent
   int   illum;     // illumination model (see http://www.fileformat.info/format/material/)
   int   textureId;
+  vec2  uvScale;   // rectangle of the texture in an atlas page
+  vec2  uvOffset;
 };
 
 struct sceneDesc
@@ -11,10 +11,20 @@
 #include "stb_image.h"
 #include "examplevulkan.hpp"
 
+#include <fstream>
+
 ///////////////////////////////////////////////////////////////////////////
 // ExampleVulkan                                                         //
 ///////////////////////////////////////////////////////////////////////////
 
+//-------------------------------------------------------------------------
+// Texture files are named relative to the media folder in the OBJ materials
+//
+static std::string texturePath(const std::string& name)
+{
+    return "../media/textures/" + name;
+}
+
 //-------------------------------------------------------------------------
 // Initialize vk variables to do all buffer and image allocations
 //
@@ -25,6 +35,30 @@ void ExampleVulkan::setupVulkan(const app::ContextCreateInfo& info, GLFWwindow*
 #if _DEBUG
     m_debug.setup(m_device, m_instance);
 #endif
+
+    // mip chains are blitted without the compute shader
+    if (m_physicalDevice.getFeatures().shaderStorageImageArrayDynamicIndexing) {
+        try {
+            m_mipmapGenerator.init(m_device, m_allocator, "shaders/mipmaps.comp.spv");
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << ", mipmaps are generated by blits" << std::endl;
+            m_mipmapGenerator.deinit();
+        }
+    }
+    else {
+        std::cerr << "no dynamic indexing of storage images, mipmaps are generated by blits" << std::endl;
+    }
+
+    // camera matrices, room for the other data written every frame
+    m_uploadRing.init(m_physicalDevice, m_allocator.getAllocator(), 64 * 1024, static_cast<uint32_t>(m_fences.size()));
+#if _DEBUG
+    m_debug.setObjectName(m_uploadRing.getBuffer(), "uploadRing");
+#endif
+
+    m_textureCache.init("../media/cache/textures");
+    m_textureStreamer.init(m_device, m_physicalDevice, m_allocator, m_uploadEngine,
+                           static_cast<uint32_t>(m_fences.size()), &m_textureCache);
 }
 
 //-------------------------------------------------------------------------
@@ -32,25 +66,40 @@ void ExampleVulkan::setupVulkan(const app::ContextCreateInfo& info, GLFWwindow*
 //
 void ExampleVulkan::destroyResources()
 {
+    for (auto& load : m_asyncLoads)
+        destroyAsyncLoad(*load, true);
+    m_asyncLoads.clear();
+    m_textureStreamer.deinit();
+    releaseMipmapBatches();
+    m_mipmapGenerator.deinit();
+
     m_device.destroy(m_graphicsPipeline);
     m_device.destroy(m_pipelineLayout);
     m_device.destroy(m_descriptorPool);
     m_device.destroy(m_descriptorSetLayout);
-    m_allocator.destroy(m_cameraMat);
+    m_device.destroy(m_frameDescriptorPool);
+    m_device.destroy(m_frameDescriptorSetLayout);
+    m_uploadRing.deinit();
     m_allocator.destroy(m_sceneDesc);
 
     for (auto& model : m_objModel)
-    {
-        m_allocator.destroy(model.vertexBuffer);
-        m_allocator.destroy(model.indexBuffer);
-        m_allocator.destroy(model.matColorBuffer);
-        m_allocator.destroy(model.matIndexBuffer);
-    }
+        destroyModelBuffers(model);
 
     for (auto& texture : m_textures)
     {
         m_allocator.destroy(texture);
     }
+    m_textures.clear();
+
+    for (auto& retired : m_retiredTextures)
+        m_allocator.destroy(retired.texture);
+    m_retiredTextures.clear();
+    for (auto& retired : m_retiredBuffers)
+        m_allocator.destroy(retired.buffer);
+    m_retiredBuffers.clear();
+    m_sceneDescSets = 0;
+    m_frameTextureSlots.assign(m_frameTextureSlots.size(), {});
+    m_textureRegistry.clear();
 
     // Post 
     m_device.destroy(m_postPipeline);
@@ -64,6 +113,17 @@ void ExampleVulkan::destroyResources()
     m_device.destroy(m_offscreenFramebuffer);
 }
 
+//-------------------------------------------------------------------------
+// The fence of the frame has signaled, the space of its previous use in
+// the upload ring is reclaimed and its descriptor set can be written
+//
+void ExampleVulkan::prepareFrame()
+{
+    VulkanBackend::prepareFrame();
+    m_uploadRing.beginFrame(getCurrentFrame());
+    writeFrameDescriptors(getCurrentFrame());
+}
+
 //-------------------------------------------------------------------------
 // called when resizing of the window
 //
@@ -81,131 +141,1115 @@ void ExampleVulkan::loadModel(const std::string& filename, glm::mat4 transform)
     ObjLoader loader;
     loader.loadModel(filename);
 
-    // convert srgb to linear
-    for (auto& m : loader.m_materials) {
-        m.ambient  = glm::pow(m.ambient, glm::vec3(2.2f));
-        m.diffuse  = glm::pow(m.diffuse, glm::vec3(2.2f));
-        m.specular = glm::pow(m.specular, glm::vec3(2.2f));
-    }
-
     ObjInstance instance = {};
     instance.objIndex    = static_cast<uint32_t>(m_objModel.size());
     instance.transform   = transform;
     instance.transformIT = glm::inverseTranspose(transform);
-    instance.txtOffset   = static_cast<uint32_t>(m_textures.size());
-
-    ObjModel model = {};
-    model.nIndices  = static_cast<uint32_t>(loader.m_indices.size());
-    model.nVertices = static_cast<uint32_t>(loader.m_vertices.size());
 
     // create buffers on device and copy vertices, indices and materials
     app::CommandPool cmdBufferGet(m_device, m_graphicsQueueIdx);
     vk::CommandBuffer commandBuffer = cmdBufferGet.createBuffer();
-    model.vertexBuffer   = m_allocator.createBuffer(commandBuffer, loader.m_vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    model.indexBuffer    = m_allocator.createBuffer(commandBuffer, loader.m_indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-    model.matColorBuffer = m_allocator.createBuffer(commandBuffer, loader.m_materials, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-    model.matIndexBuffer = m_allocator.createBuffer(commandBuffer, loader.m_matIndx, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-    // creates all textures found
-    createTextureImages(commandBuffer, loader.m_textures);
+
+    ObjModel                 model = {};
+    std::vector<uint32_t>           slots;
+    std::vector<TextureAtlas::Page> pages;
+    std::vector<std::string>        textures = acquireTextures(loader, model, slots, pages);
+    uploadModel(commandBuffer, *m_allocator.getStaging(), filename, loader, model);
+
+    // creates the textures not registered yet
+    createTextureImages(commandBuffer, textures, pages, slots);
+    cmdBufferGet.submitAndWait(commandBuffer);
+    m_allocator.finalizeAndReleaseStaging();
+    releaseMipmapBatches();
+
+    setModelNames(model, instance.objIndex);
+
+    m_objModel.emplace_back(model);
+    m_objInstance.emplace_back(instance);
+}
+
+//-------------------------------------------------------------------------
+// Loading several OBJ files, parsed in parallel and uploaded with a single
+// submission. The models recorded before the first error, of parsing or
+// of recording, are still added to the scene.
+//
+void ExampleVulkan::loadModels(const std::vector<std::pair<std::string, glm::mat4>>& models)
+{
+    // files are parsed by batches as wide as the pool and each loader is released
+    // once recorded, only one batch of parsed models is alive next to the staging
+    const size_t batchSize = tools::ThreadPool::Singleton().size() + 1;
+
+    // all uploads are recorded in the same command buffer
+    app::CommandPool cmdBufferGet(m_device, m_graphicsQueueIdx);
+    vk::CommandBuffer commandBuffer = cmdBufferGet.createBuffer();
+
+    std::vector<ObjModel>    newModels;
+    std::vector<ObjInstance> newInstances;
+    std::exception_ptr       error;
+
+    // resources of the model whose recording failed, released once the
+    // commands recorded before the error are done
+    ObjModel                        failedModel;
+    std::vector<uint32_t>           failedSlots;
+    std::vector<std::string>        failedTextures;
+    std::vector<TextureAtlas::Page> failedPages;
+
+    newModels.reserve(models.size());
+    newInstances.reserve(models.size());
+
+    for (size_t first = 0; first < models.size() && !error; first += batchSize) {
+        const size_t                    count = std::min(batchSize, models.size() - first);
+        std::vector<ObjLoader>          loaders(count);
+        std::vector<std::exception_ptr> errors(count);
+
+        // exceptions must not escape a worker, the first one is thrown once the
+        // files before it are uploaded
+        tools::ThreadPool::Singleton().parallelFor(count, [&](size_t i) {
+            try {
+                loaders[i].loadModel(models[first + i].first);
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+
+        for (size_t i = 0; i < count; ++i) {
+            if (errors[i]) {
+                error = errors[i];
+                break;
+            }
+
+            const auto& file = models[first + i];
+
+            ObjInstance instance;
+            instance.objIndex    = static_cast<uint32_t>(m_objModel.size() + newModels.size());
+            instance.transform   = file.second;
+            instance.transformIT = glm::inverseTranspose(file.second);
+
+            ObjModel                        model;
+            std::vector<uint32_t>           slots;
+            std::vector<TextureAtlas::Page> pages;
+            std::vector<std::string>        textures;
+            try {
+                textures = acquireTextures(loaders[i], model, slots, pages);
+                uploadModel(commandBuffer, *m_allocator.getStaging(), file.first, loaders[i], model);
+                createTextureImages(commandBuffer, textures, pages, slots);
+            }
+            catch (...) {
+                error          = std::current_exception();
+                failedModel    = model;
+                failedSlots    = slots;
+                failedTextures = textures;
+                failedPages    = pages;
+                break;
+            }
+
+            loaders[i] = ObjLoader();
+
+            newModels.emplace_back(model);
+            newInstances.emplace_back(instance);
+        }
+    }
+
+    // the models recorded before an error are still added, their resources
+    // are already created
     cmdBufferGet.submitAndWait(commandBuffer);
     m_allocator.finalizeAndReleaseStaging();
+    releaseMipmapBatches();
+
+    if (error) {
+        destroyModelBuffers(failedModel);
+        uploadOrphanTextures(models[newModels.size()].first, failedTextures, failedPages, failedSlots,
+                             m_textureRegistry.abandon(failedModel.textures, failedSlots));
+    }
+
+    for (size_t i = 0; i < newModels.size(); ++i) {
+        setModelNames(newModels[i], newInstances[i].objIndex);
+
+        m_objModel.emplace_back(newModels[i]);
+        m_objInstance.emplace_back(newInstances[i]);
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+//-------------------------------------------------------------------------
+// Parsing and upload recording on the thread pool, the upload is submitted
+// and the model added to the scene by 'updateAsyncLoads'
+//
+void ExampleVulkan::loadModelAsync(const std::string& filename, glm::mat4 transform)
+{
+    auto load       = std::make_unique<AsyncLoad>();
+    load->filename  = filename;
+    load->transform = transform;
+    load->commandPool.init(m_device, m_graphicsQueueIdx);
+    load->staging.init(m_device, m_physicalDevice, m_allocator.getAllocator());
+
+    try {
+        load->fence = m_device.createFence({});
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create model upload fence!");
+    }
+
+    AsyncLoad* job = load.get();
+    job->recorded  = tools::ThreadPool::Singleton().submit([this, job]() {
+        ObjLoader loader;
+        loader.loadModel(job->filename);
+
+        vk::CommandBuffer               commandBuffer = job->commandPool.createBuffer();
+        std::vector<TextureAtlas::Page> pages;
+        std::vector<std::string>        textures = acquireTextures(loader, job->model, job->textureSlots, pages);
+        job->textures = textures;
+        job->pages    = pages;
+        uploadModel(commandBuffer, job->staging, job->filename, loader, job->model);
+
+        job->dummyTexture = textures.empty() && pages.empty();
+        job->images       = uploadTextureImages(commandBuffer, job->staging, textures, pages, true, job->mipmapBatch);
+
+        commandBuffer.end();
+        job->commandBuffer = commandBuffer;
+    });
+
+    m_asyncLoads.emplace_back(std::move(load));
+}
+
+//-------------------------------------------------------------------------
+// Called once per frame before 'prepareFrame': submits the recorded uploads
+// and publishes the models whose upload is complete
+//
+void ExampleVulkan::updateAsyncLoads()
+{
+    const size_t firstModel    = m_objModel.size();
+    const size_t firstInstance = m_objInstance.size();
+    bool         published     = false;
 
+    for (size_t i = 0; i < m_asyncLoads.size();) {
+        AsyncLoad& load = *m_asyncLoads[i];
+
+        if (!load.submitted) {
+            if (load.recorded.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                i++;
+                continue;
+            }
+
+            try {
+                load.recorded.get();
+            }
+            catch (const std::exception& e) {
+                std::cerr << "failed to load " << load.filename << ": " << e.what() << std::endl;
+                uploadOrphanTextures(load.filename, load.textures, load.pages, load.textureSlots,
+                                     destroyAsyncLoad(load, true));
+                m_asyncLoads.erase(m_asyncLoads.begin() + i);
+                continue;
+            }
+
+            vk::SubmitInfo submitInfo     = {};
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers    = &load.commandBuffer;
+
+            try {
+                m_graphicsQueue.submit(submitInfo, load.fence);
+            }
+            catch (vk::SystemError err) {
+                throw std::runtime_error("failed to submit model upload!");
+            }
+            load.submitted = true;
+            load.staging.finalizeResources(load.fence);
+        }
+
+        if (m_device.getFenceStatus(load.fence) != vk::Result::eSuccess) {
+            i++;
+            continue;
+        }
+
+        // Upload complete, adding the model and its instance to the scene
+        ObjInstance instance = {};
+        instance.objIndex    = static_cast<uint32_t>(m_objModel.size());
+        instance.transform   = load.transform;
+        instance.transformIT = glm::inverseTranspose(load.transform);
+
+        // the dummy keeps its slot until the scene is destroyed
+        if (load.dummyTexture && m_textures.empty()) {
+            load.textureSlots.assign(1, m_textureRegistry.acquire(TextureRegistry::DUMMY).index);
+        }
+        else if (load.dummyTexture) {
+            for (auto& image : load.images)
+                m_allocator.destroy(image.image);
+            load.images.clear();
+        }
+        createTextures(load.images, load.textureSlots);
+
+        setModelNames(load.model, instance.objIndex);
+
+        m_objModel.emplace_back(load.model);
+        m_objInstance.emplace_back(instance);
+
+        destroyAsyncLoad(load, false);
+        m_asyncLoads.erase(m_asyncLoads.begin() + i);
+        published = true;
+    }
+
+    if (published && m_descriptorSetLayout)
+        updateSceneResources(firstModel, firstInstance);
+}
+
+//-------------------------------------------------------------------------
+// Called once per frame before 'prepareFrame': the textures whose streamed
+// levels changed replace the previous ones. The sets of the frames in flight
+// still show the previous ones, destroyed once each set is written again.
+//
+void ExampleVulkan::updateTextureStreaming()
+{
+    std::vector<TextureStreamer::Update> updates = m_textureStreamer.update(m_textureBudget);
+    if (updates.empty())
+        return;
+
+    const uint32_t allSets = (1u << m_descriptorSets.size()) - 1;
+
+    std::vector<ImageUpload> images;
+    std::vector<uint32_t>    slots;
+    for (auto& update : updates) {
+        m_retiredTextures.push_back({ m_textures[update.slot], allSets });
+        images.push_back({ update.image, update.info });
+        slots.push_back(update.slot);
+    }
+    createTextures(images, slots);
+}
+
+//-------------------------------------------------------------------------
+// Called once per frame after the uploads of the frame are recorded, the
+// bytes of the frame are the ones requested since the previous call
+//
+void ExampleVulkan::updateStagingTelemetry()
+{
+    StagingTelemetry& telemetry = m_stagingTelemetry;
+
+    m_allocator.getStaging()->getStats(telemetry.allocator);
+    m_textureStreamer.staging().getStats(telemetry.streamer);
+
+    // the staging of a load is used by its thread until submitted
+    telemetry.asyncLoads = telemetry.retired;
+    for (const auto& load : m_asyncLoads) {
+        if (!load->submitted)
+            continue;
+
+        app::StagingStats stats;
+        load->staging.getStats(stats);
+        telemetry.asyncLoads.add(stats);
+    }
+
+    const uint64_t totalBytes = telemetry.allocator.bytes + telemetry.streamer.bytes + telemetry.asyncLoads.bytes;
+    const vk::DeviceSize frameBytes = totalBytes - telemetry.totalBytes;
+
+    telemetry.frameBytes[telemetry.frame] = frameBytes;
+    telemetry.frame          = (telemetry.frame + 1) % StagingTelemetry::FRAMES;
+    telemetry.frames++;
+    telemetry.totalBytes     = totalBytes;
+    telemetry.peakFrameBytes = std::max(telemetry.peakFrameBytes, frameBytes);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+static void writeStagingStats(std::ostream& out, const char* name, const app::StagingStats& stats, bool last)
+{
+    out << "    \"" << name << "\": {\n"
+        << "      \"bytes\": " << stats.bytes << ",\n"
+        << "      \"allocations\": " << stats.allocations << ",\n"
+        << "      \"batches\": " << stats.batches << ",\n"
+        << "      \"lastBatchBytes\": " << stats.lastBatchBytes << ",\n"
+        << "      \"peakBatchBytes\": " << stats.peakBatchBytes << ",\n"
+        << "      \"allocatedSize\": " << stats.allocatedSize << ",\n"
+        << "      \"peakAllocatedSize\": " << stats.peakAllocatedSize << ",\n"
+        << "      \"usedSize\": " << stats.usedSize << ",\n"
+        << "      \"peakUsedSize\": " << stats.peakUsedSize << ",\n"
+        << "      \"blockCount\": " << stats.blockCount << ",\n"
+        << "      \"peakBlockCount\": " << stats.peakBlockCount << ",\n"
+        << "      \"releasedBatches\": " << stats.releasedBatches << ",\n"
+        << "      \"lastLatencyMs\": " << stats.lastLatency << ",\n"
+        << "      \"averageLatencyMs\": " << stats.averageLatency() << ",\n"
+        << "      \"maxLatencyMs\": " << stats.maxLatency << ",\n";
+
+    out << "      \"histogram\": [";
+    for (uint32_t i = 0; i < app::StagingStats::HISTOGRAM_BINS; i++)
+        out << (i ? ", " : "") << stats.histogram[i];
+    out << "],\n";
+
+    out << "      \"blocks\": [";
+    for (size_t i = 0; i < stats.blocks.size(); i++) {
+        const auto& block = stats.blocks[i];
+        out << (i ? ",\n" : "\n") << "        { \"size\": " << block.size << ", \"used\": " << block.used
+            << ", \"largestFree\": " << block.largestFree << ", \"fragmentation\": " << block.fragmentation << " }";
+    }
+    out << (stats.blocks.empty() ? "]\n" : "\n      ]\n");
+
+    out << (last ? "    }\n" : "    },\n");
+}
+
+//-------------------------------------------------------------------------
+// Histogram bin i counts the allocations of [2^(i+8), 2^(i+9)) bytes, the
+// frame bytes are the oldest first
+//
+bool ExampleVulkan::writeStagingTelemetry(const std::string& filename) const
+{
+    std::ofstream out(filename, std::ios::trunc);
+    if (!out.is_open())
+        return false;
+
+    const StagingTelemetry& telemetry = m_stagingTelemetry;
+    const uint32_t          count     = static_cast<uint32_t>(std::min<uint64_t>(telemetry.frames, StagingTelemetry::FRAMES));
+
+    out << "{\n"
+        << "  \"defaultStagingBlockSize\": " << APP_DEFAULT_STAGING_BLOCKSIZE << ",\n"
+        << "  \"frames\": " << telemetry.frames << ",\n"
+        << "  \"totalBytes\": " << telemetry.totalBytes << ",\n"
+        << "  \"peakFrameBytes\": " << telemetry.peakFrameBytes << ",\n"
+        << "  \"frameBytes\": [";
+    for (uint32_t i = 0; i < count; i++)
+        out << (i ? ", " : "")
+            << telemetry.frameBytes[(telemetry.frame + StagingTelemetry::FRAMES - count + i) % StagingTelemetry::FRAMES];
+    out << "],\n"
+        << "  \"managers\": {\n";
+    writeStagingStats(out, "allocator", telemetry.allocator, false);
+    writeStagingStats(out, "streamer", telemetry.streamer, false);
+    writeStagingStats(out, "asyncLoads", telemetry.asyncLoads, true);
+    out << "  }\n"
+        << "}\n";
+
+    return out.good();
+}
+
+//-------------------------------------------------------------------------
+// Release the loading resources, and the uploaded ones when the model was
+// not published. Returns the slots owned by the load that other models
+// still reference, their textures were not uploaded.
+//
+std::vector<uint32_t> ExampleVulkan::destroyAsyncLoad(AsyncLoad& load, bool destroyUploads)
+{
+    std::vector<uint32_t> orphans;
+
+    if (load.recorded.valid()) {
+        try {
+            load.recorded.get();
+        }
+        catch (const std::exception&) {
+        }
+    }
+    if (load.submitted)
+        while (m_device.waitForFences(load.fence, VK_TRUE, 10000) == vk::Result::eTimeout) {}
+
+    if (destroyUploads) {
+        destroyModelBuffers(load.model);
+        for (auto& image : load.images)
+            m_allocator.destroy(image.image);
+        orphans = m_textureRegistry.abandon(load.model.textures, load.textureSlots);
+    }
+
+    m_mipmapGenerator.destroy(load.mipmapBatch);
+    if (load.submitted)
+        load.staging.releaseResources();
+    load.staging.deinit();
+
+    app::StagingStats stats;
+    load.staging.getStats(stats);
+    m_stagingTelemetry.retired.add(stats);
+
+    load.commandPool.deinit();
+    m_device.destroy(load.fence);
+    load.fence = nullptr;
+
+    return orphans;
+}
+
+//-------------------------------------------------------------------------
+// Buffers of a model, the ones not created yet are empty
+//
+void ExampleVulkan::destroyModelBuffers(ObjModel& model)
+{
+    m_allocator.destroy(model.vertexBuffer);
+    m_allocator.destroy(model.indexBuffer);
+    m_allocator.destroy(model.matColorBuffer);
+    m_allocator.destroy(model.matIndexBuffer);
+    m_allocator.destroy(model.meshletBuffer);
+    m_allocator.destroy(model.meshletVertexBuffer);
+    m_allocator.destroy(model.meshletTriangleBuffer);
+}
+
+//-------------------------------------------------------------------------
+// The render thread takes over the uploads of a failed load for the slots
+// other models share, they would stay on the loading texture otherwise.
+// 'ownedSlots' are the slots of 'ownedTextures', then of 'ownedPages'.
+//
+void ExampleVulkan::uploadOrphanTextures(const std::string& filename, const std::vector<std::string>& ownedTextures,
+                                         const std::vector<TextureAtlas::Page>& ownedPages,
+                                         const std::vector<uint32_t>& ownedSlots, const std::vector<uint32_t>& orphans)
+{
+    auto isOrphan = [&](uint32_t slot) { return std::find(orphans.begin(), orphans.end(), slot) != orphans.end(); };
+
+    std::vector<std::string>        textures;
+    std::vector<TextureAtlas::Page> pages;
+    std::vector<uint32_t>           slots;
+    for (size_t i = 0; i < ownedTextures.size() && i < ownedSlots.size(); ++i) {
+        if (isOrphan(ownedSlots[i])) {
+            textures.push_back(ownedTextures[i]);
+            slots.push_back(ownedSlots[i]);
+        }
+    }
+    for (const auto& page : ownedPages) {
+        if (isOrphan(page.slot)) {
+            pages.push_back(page);
+            slots.push_back(page.slot);
+        }
+    }
+    if (slots.empty())
+        return;
+
+    try {
+        app::CommandPool  cmdBufferGet(m_device, m_graphicsQueueIdx);
+        vk::CommandBuffer commandBuffer = cmdBufferGet.createBuffer();
+        createTextureImages(commandBuffer, textures, pages, slots);
+        cmdBufferGet.submitAndWait(commandBuffer);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "failed to upload the shared textures of " << filename << ": " << e.what() << std::endl;
+    }
+    m_allocator.finalizeAndReleaseStaging();
+    releaseMipmapBatches();
+}
+
+//-------------------------------------------------------------------------
+// The instances from 'firstInstance' are written by the next frame in the
+// spare space of the scene description, which the frames in flight do not
+// read. When it is full, a larger one is created and written whole: the
+// sets of the frames in flight keep the previous one until they are
+// written again, binding 2 is updated after bind. Nothing is waited for.
+// The models from 'firstModel' are added to the arrays.
+//
+void ExampleVulkan::updateSceneResources(size_t firstModel, size_t firstInstance)
+{
+    if (m_objInstance.size() > m_sceneDescCapacity) {
+        m_retiredBuffers.push_back({ m_sceneDesc, (1u << m_descriptorSets.size()) - 1 });
+        createSceneDescriptionBuffer();
+        m_sceneDescSets = (1u << m_descriptorSets.size()) - 1;
+    }
+    else {
+        m_sceneDescDirty = std::min(m_sceneDescDirty, firstInstance);
+    }
+
+    updateModelDescriptors(firstModel);
+}
+
+//-------------------------------------------------------------------------
+// Recorded before the render pass: the instances added since the previous
+// frame are written in the scene description, in the command buffer of
+// the frame that draws them first
+//
+void ExampleVulkan::cmdUpdateSceneDescription(const vk::CommandBuffer& cmdBuffer)
+{
+    if (m_sceneDescDirty >= m_objInstance.size())
+        return;
+
+    // at most 65536 bytes by update, the instances are multiple of 4 bytes
+    const size_t         instancesByUpdate = 65536 / sizeof(ObjInstance);
+    const vk::DeviceSize offset            = m_sceneDescDirty * sizeof(ObjInstance);
+    const vk::DeviceSize size              = (m_objInstance.size() - m_sceneDescDirty) * sizeof(ObjInstance);
+    for (size_t first = m_sceneDescDirty; first < m_objInstance.size(); first += instancesByUpdate) {
+        const size_t count = std::min(instancesByUpdate, m_objInstance.size() - first);
+        cmdBuffer.updateBuffer(m_sceneDesc.buffer, first * sizeof(ObjInstance), count * sizeof(ObjInstance),
+                               m_objInstance.data() + first);
+    }
+    m_sceneDescDirty = m_objInstance.size();
+
+    vk::BufferMemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead,
+        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_sceneDesc.buffer, offset, size);
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader,
+        vk::DependencyFlags(), nullptr, barrier, nullptr);
+}
+
+//-------------------------------------------------------------------------
+// Create the device buffers of the model and record their upload through
+// the staging manager
+//
+void ExampleVulkan::uploadModel(const vk::CommandBuffer& cmdBuffer, app::StagingMemoryManager& staging,
+                                const std::string& filename, ObjLoader& loader, ObjModel& model)
+{
+    // post-transform vertex cache efficiency, before and after the reordering
+    if (loader.m_optimizeMesh) {
+        std::cout << filename << ": ACMR " << loader.m_vertexCacheBefore.acmr << " -> " << loader.m_vertexCacheAfter.acmr
+                  << ", ATVR " << loader.m_vertexCacheBefore.atvr << " -> " << loader.m_vertexCacheAfter.atvr << std::endl;
+    }
+    for (size_t i = 1; i < loader.m_lods.size(); ++i) {
+        std::cout << filename << ": LOD " << i << ", " << loader.m_lods[i].nbIndices / 3 << " triangles, error "
+                  << loader.m_lods[i].error << std::endl;
+    }
+
+    // convert srgb to linear
+    for (auto& m : loader.m_materials) {
+        m.ambient  = glm::pow(m.ambient, glm::vec3(2.2f));
+        m.diffuse  = glm::pow(m.diffuse, glm::vec3(2.2f));
+        m.specular = glm::pow(m.specular, glm::vec3(2.2f));
+    }
+
+    // vertices and indices may be mapped straight from the binary cache
+    ObjArray<VertexObj> vertices   = loader.getVertices();
+    ObjArray<uint32_t>  indices    = loader.getIndices();
+    ObjArray<uint32_t>  matIndices = loader.getMatIndices();
+
+    model.nIndices  = loader.m_lods[0].nbIndices;
+    model.nVertices = static_cast<uint32_t>(vertices.count);
+    model.lods      = loader.m_lods;
+    model.indexType = model.nVertices < 65536 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+
+    // bounding sphere for the LOD selection
+    if (vertices.count > 0) {
+        glm::vec3 posMin = vertices.data[0].pos, posMax = vertices.data[0].pos;
+        for (size_t i = 1; i < vertices.count; ++i) {
+            posMin = glm::min(posMin, vertices.data[i].pos);
+            posMax = glm::max(posMax, vertices.data[i].pos);
+        }
+        model.center = (posMin + posMax) * 0.5f;
+        for (size_t i = 0; i < vertices.count; ++i)
+            model.radius = std::max(model.radius, glm::length(vertices.data[i].pos - model.center));
+    }
+
+    if (m_vertexLayout == VertexLayout::eFloat32) {
+        model.vertexBuffer = m_allocator.createBuffer(cmdBuffer, staging, vertices.sizeBytes(), vertices.data, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    }
+    else {
+        std::vector<uint8_t> packed = packVertices(m_vertexLayout, vertices.data, vertices.count, model.decode);
+        model.vertexBuffer = m_allocator.createBuffer(cmdBuffer, staging, packed, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    }
+
+    if (model.indexType == vk::IndexType::eUint16) {
+        std::vector<uint16_t> indices16(indices.count);
+        std::transform(indices.data, indices.data + indices.count, indices16.begin(),
+                       [](uint32_t index) { return static_cast<uint16_t>(index); });
+        model.indexBuffer = m_allocator.createBuffer(cmdBuffer, staging, indices16, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    }
+    else {
+        model.indexBuffer = m_allocator.createBuffer(cmdBuffer, staging, indices.sizeBytes(), indices.data, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    }
+
+    model.matColorBuffer = m_allocator.createBuffer(cmdBuffer, staging, loader.m_materials, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    model.matIndexBuffer = m_allocator.createBuffer(cmdBuffer, staging, matIndices.sizeBytes(), matIndices.data, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    // meshlets over the final index order of the full detail, built on the thread pool
+    if (m_buildMeshlets && model.nIndices > 0) {
+        tools::mesh::Meshlets meshlets = tools::mesh::buildMeshlets(indices.data, model.nIndices, &vertices.data[0].pos.x, sizeof(VertexObj));
+
+        model.nMeshlets             = static_cast<uint32_t>(meshlets.meshlets.size());
+        model.meshletBuffer         = m_allocator.createBuffer(cmdBuffer, staging, meshlets.meshlets, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        model.meshletVertexBuffer   = m_allocator.createBuffer(cmdBuffer, staging, meshlets.vertices, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        model.meshletTriangleBuffer = m_allocator.createBuffer(cmdBuffer, staging, meshlets.triangles, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    }
+}
+
+//-------------------------------------------------------------------------
+// Debug names of the model buffers
+//
+void ExampleVulkan::setModelNames(const ObjModel& model, uint32_t objIndex)
+{
 #if _DEBUG
-    std::string objNb = std::to_string(instance.objIndex);
+    std::string objNb = std::to_string(objIndex);
     m_debug.setObjectName(model.vertexBuffer.buffer, (std::string("vertex_" + objNb).c_str()));
     m_debug.setObjectName(model.indexBuffer.buffer, (std::string("index_" + objNb).c_str()));
     m_debug.setObjectName(model.matColorBuffer.buffer, (std::string("mat_" + objNb).c_str()));
     m_debug.setObjectName(model.matIndexBuffer.buffer, (std::string("matIdx_" + objNb).c_str()));
+    if (model.nMeshlets > 0) {
+        m_debug.setObjectName(model.meshletBuffer.buffer, (std::string("meshlet_" + objNb).c_str()));
+        m_debug.setObjectName(model.meshletVertexBuffer.buffer, (std::string("meshletVertex_" + objNb).c_str()));
+        m_debug.setObjectName(model.meshletTriangleBuffer.buffer, (std::string("meshletTriangle_" + objNb).c_str()));
+    }
 #endif
-
-    m_objModel.emplace_back(model);
-    m_objInstance.emplace_back(instance);
 }
 
 //-------------------------------------------------------------------------
-// Create textures and samplers
+// Create textures and samplers in their registry slots
 //
 void ExampleVulkan::createTextureImages(const vk::CommandBuffer& cmdBuffer, 
-                                        const std::vector<std::string>& textures)
+                                        const std::vector<std::string>& textures,
+                                        const std::vector<TextureAtlas::Page>& pages,
+                                        const std::vector<uint32_t>& slots)
 {
-    vk::SamplerCreateInfo samplerCreateInfo = {};
-    samplerCreateInfo.magFilter  = vk::Filter::eLinear;
-    samplerCreateInfo.minFilter  = vk::Filter::eLinear;
-    samplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
-    samplerCreateInfo.maxLod     = FLT_MAX;
+    // the dummy keeps its slot until the scene is destroyed
+    std::vector<uint32_t> imageSlots = slots;
+    const bool            needDummy  = textures.empty() && pages.empty() && m_textures.empty();
+    if (needDummy)
+        imageSlots.push_back(m_textureRegistry.acquire(TextureRegistry::DUMMY).index);
+
+    app::MipmapGenerator::Batch mipmapBatch;
+    createTextures(uploadTextureImages(cmdBuffer, *m_allocator.getStaging(), textures, pages, needDummy, mipmapBatch),
+                   imageSlots);
+    m_mipmapBatches.push_back(mipmapBatch);
+}
+
+//-------------------------------------------------------------------------
+// Slots of the model textures in the registry, the material texture ids
+// and UV rectangles are remapped to them. Returns the textures to upload,
+// one per new slot, and the new atlas pages whose slots follow.
+//
+std::vector<std::string> ExampleVulkan::acquireTextures(ObjLoader& loader, ObjModel& model, std::vector<uint32_t>& slots,
+                                                        std::vector<TextureAtlas::Page>& pages)
+{
+    std::vector<std::string>           textures;
+    std::vector<TextureRegistry::Slot> modelSlots(loader.m_textures.size());
+
+    // the small textures are packed, only their header is read
+    std::vector<TextureAtlas::Tile> tiles;
+    std::vector<size_t>             tileTextures;
+
+    for (size_t i = 0; i < loader.m_textures.size(); ++i) {
+        const std::string path = texturePath(loader.m_textures[i]);
+
+        TextureAtlas::Tile tile;
+        if (m_atlasTextures && TextureAtlas::isTile(path, tile.width, tile.height)) {
+            tile.file = path;
+            tiles.push_back(tile);
+            tileTextures.push_back(i);
+            continue;
+        }
+
+        TextureRegistry::Slot slot = m_textureRegistry.acquire(path);
+        modelSlots[i] = slot;
+
+        if (slot.owner) {
+            textures.push_back(loader.m_textures[i]);
+            slots.push_back(slot.index);
+        }
+    }
+
+    // the tiles already registered keep their slot, the page holds the others
+    size_t tileIndex = 0;
+    for (auto& page : TextureAtlas::pack(tiles)) {
+        std::vector<std::string>                files;
+        std::vector<TextureRegistry::Placement> placements;
+        for (const auto& tile : page.tiles) {
+            files.push_back(tile.file);
+            placements.push_back(TextureAtlas::placement(page, tile));
+        }
+
+        const std::string pageKey = "atlas:" + std::to_string(m_atlasPages++);
+        std::vector<TextureRegistry::Slot> tileSlots = m_textureRegistry.acquireTiles(files, placements, pageKey);
+
+        TextureAtlas::Page newPage = page;
+        newPage.tiles.clear();
+        for (size_t i = 0; i < tileSlots.size(); ++i) {
+            modelSlots[tileTextures[tileIndex++]] = tileSlots[i];
+            if (tileSlots[i].owner) {
+                newPage.slot = tileSlots[i].index;
+                newPage.tiles.push_back(page.tiles[i]);
+            }
+        }
+        if (!newPage.tiles.empty())
+            pages.push_back(newPage);
+    }
+    for (const auto& page : pages)
+        slots.push_back(page.slot);
+
+    for (auto& m : loader.m_materials) {
+        if (m.textureID >= 0) {
+            const TextureRegistry::Slot& slot = modelSlots[m.textureID];
+            m.textureID = static_cast<int>(slot.index);
+            m.uvScale   = slot.placement.scale;
+            m.uvOffset  = slot.placement.offset;
+        }
+    }
+
+    model.textures.clear();
+    for (const auto& slot : modelSlots)
+        model.textures.push_back(slot.index);
+    return textures;
+}
+
+//-------------------------------------------------------------------------
+// Once the command buffers given to 'createTextureImages' completed
+//
+void ExampleVulkan::releaseMipmapBatches()
+{
+    for (auto& batch : m_mipmapBatches)
+        m_mipmapGenerator.destroy(batch);
+    m_mipmapBatches.clear();
+}
+
+//-------------------------------------------------------------------------
+// Decode the texture files and record their upload, with a dummy texture
+// when there are none and one is needed for the pipeline layout
+//
+std::vector<ExampleVulkan::ImageUpload> ExampleVulkan::uploadTextureImages(const vk::CommandBuffer& cmdBuffer,
+                                                                           app::StagingMemoryManager& staging,
+                                                                           const std::vector<std::string>& textures,
+                                                                           const std::vector<TextureAtlas::Page>& pages,
+                                                                           bool needDummy,
+                                                                           app::MipmapGenerator::Batch& mipmapBatch)
+{
+    std::vector<ImageUpload> images;
 
     vk::Format format = vk::Format::eR8G8B8A8Srgb;
 
     // if no textures are present, create a dummy one to accomodate the pipeline layout
-    if (textures.empty() && m_textures.empty()) {
-        app::TextureVma texture;
-
-        glm::u8vec4*   color      = new glm::u8vec4(255, 255, 255, 255);
+    if (textures.empty() && pages.empty() && needDummy) {
+        glm::u8vec4    color      = glm::u8vec4(255, 255, 255, 255);
         vk::DeviceSize bufferSize = sizeof(glm::u8vec4);
         vk::Extent2D   imgSize    = vk::Extent2D(1, 1);
         
         vk::ImageCreateInfo imageCreateInfo = app::image::create2DInfo(imgSize, format);
 
-        // Creating the dummy texture
-        app::ImageVma image = m_allocator.createImage(cmdBuffer, bufferSize, reinterpret_cast<stbi_uc*>(color), imageCreateInfo);
-        vk::ImageViewCreateInfo imageViewCreateInfo = app::image::makeImageViewCreateInfo(image.image, imageCreateInfo);
-        texture = m_allocator.createTexture(image, imageViewCreateInfo, samplerCreateInfo);
-
-        // The image format must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-        app::image::cmdBarrierImageLayout(cmdBuffer, texture.image, vk::ImageLayout::eUndefined,
-                                          vk::ImageLayout::eShaderReadOnlyOptimal);
-        m_textures.push_back(texture);
+        // Creating the dummy texture, in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+        app::ImageVma image = m_allocator.createImage(cmdBuffer, staging, bufferSize, &color, imageCreateInfo);
+        images.push_back({ image, imageCreateInfo });
+        return images;
     }
-    else {
-        // Uploading all images
-        for (const auto& texture : textures) {
-            std::stringstream ss;
-            int texWidth, texHeight, texChannels;
-            ss << "../media/textures/" << texture;
 
-            stbi_uc* pixels =
-                stbi_load(ss.str().c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+    struct DecodedTexture
+    {
+        std::string                       path;
+        stbi_uc*                          pixels{ nullptr };
+        int                               width{ 1 };
+        int                               height{ 1 };
+        tools::texture::CompressedTexture compressed; // Levels are empty when not compressed
+        tools::texture::CachedTexture     cached;     // Full mip chain, closed when not in the cache
+        std::vector<std::vector<uint8_t>> tail;       // Levels from 'firstLevel' when streamed
+        uint32_t                          firstLevel{ 0 };
+        bool                              warm{ false }; // Read as is from the cache or KTX2, not decoded
+    };
+
+    // Block compression is done once, the blocks are kept in the texture cache, or
+    // as KTX2 next to the image when it is disabled. Otherwise the decoded mip
+    // chains are cached.
+    const bool compress = m_compressTextures && m_physicalDevice.getFeatures().textureCompressionBC;
+    const bool cache    = m_cacheTextures && m_textureCache.isValid();
+    const bool srgb     = format == vk::Format::eR8G8B8A8Srgb;
+
+    // Decoding on the thread pool by batches, so only a few decoded images are
+    // alive at once. Each batch is recorded in order once decoded.
+    tools::ThreadPool& threadPool = tools::ThreadPool::Singleton();
+    const size_t       batchSize  = threadPool.size() + 1;
+
+    // Copies of all the images recorded together, the pixels are copied in the
+    // staging memory as they are added so the decoded images can be freed
+    app::ImageUploadBatch uploadBatch(staging);
+
+    // cold and warm loads of the textures, reported once recorded
+    const auto startTime = std::chrono::steady_clock::now();
+    uint32_t   warmCount = 0;
+
+    std::vector<DecodedTexture>              decoded;
+    std::vector<app::MipmapGenerator::Image> mipmapImages;
+    std::vector<app::MipmapGenerator::Image> blitImages;   // Mip chains not supported by the generator
+    images.reserve(textures.size() + pages.size());
+
+    for (size_t first = 0; first < textures.size(); first += batchSize) {
+        const size_t count = std::min(batchSize, textures.size() - first);
+        decoded.assign(count, DecodedTexture());
+
+        threadPool.parallelFor(count, [&](size_t i) {
+            DecodedTexture&   texture   = decoded[i];
+            const std::string path      = texturePath(textures[first + i]);
+            const std::string cacheName = path + ".ktx2";
+            texture.path = path;
+
+            if (compress) {
+                texture.warm = cache ? m_textureCache.readCompressed(path, texture.cached)
+                                     : tools::texture::readKtx2(cacheName, path, texture.compressed);
+            }
+            else {
+                texture.warm = cache && m_textureCache.read(path, srgb, texture.cached);
+            }
+            if (texture.warm)
+                return;
+
+            int texChannels;
+            texture.pixels = stbi_load(path.c_str(), &texture.width, &texture.height, &texChannels, STBI_rgb_alpha);
+
+            // the entry just written is uploaded like a cached one, its levels are not kept in memory
+            if (cache && !compress && texture.pixels) {
+                if (m_textureCache.write(path, srgb, texture.pixels, texture.width, texture.height)
+                    && m_textureCache.read(path, srgb, texture.cached)) {
+                    stbi_image_free(texture.pixels);
+                    texture.pixels = nullptr;
+                    return;
+                }
+            }
+
+            if (compress && texture.pixels) {
+                const uint32_t width  = static_cast<uint32_t>(texture.width);
+                const uint32_t height = static_cast<uint32_t>(texture.height);
+                const auto blockFormat = tools::texture::chooseBlockFormat(texture.pixels, width, height);
+
+                texture.compressed = tools::texture::compressTexture(texture.pixels, width, height, blockFormat, true);
+                if (cache)
+                    m_textureCache.writeCompressed(path, texture.compressed);
+                else
+                    tools::texture::writeKtx2(cacheName, path, texture.compressed);
+
+                stbi_image_free(texture.pixels);
+                texture.pixels = nullptr;
+            }
+
+            // only the small levels of a streamed texture are kept
+            if (m_streamTextures && texture.pixels) {
+                TextureStreamer::Source source;
+                source.format = format;
+                source.width  = static_cast<uint32_t>(texture.width);
+                source.height = static_cast<uint32_t>(texture.height);
+                source.levels = app::image::mipLevels(vk::Extent2D(source.width, source.height));
+
+                texture.firstLevel = TextureStreamer::tailLevel(source.width, source.height, source.levels);
+                if (texture.firstLevel > 0) {
+                    texture.tail = TextureStreamer::buildLevels(texture.pixels, source, texture.firstLevel, source.levels);
+                    stbi_image_free(texture.pixels);
+                    texture.pixels = nullptr;
+                }
+            }
+        });
+
+        // Uploading the images
+        for (auto& texture : decoded) {
+            warmCount += texture.warm ? 1 : 0;
+
+            if (texture.cached.isOpen()) {
+                const auto&      cached       = texture.cached;
+                const vk::Format cachedFormat = cached.compressed()
+                    ? static_cast<vk::Format>(tools::texture::vkFormatOf(cached.blockFormat(), cached.srgb())) : format;
+                const uint32_t   levels       = cached.levelCount();
+                const uint32_t   firstLevel   = m_streamTextures ? TextureStreamer::tailLevel(cached.width(), cached.height(), levels) : 0;
+                const auto       levelSize    = vk::Extent2D(std::max(1u, cached.width() >> firstLevel),
+                                                             std::max(1u, cached.height() >> firstLevel));
+
+                std::vector<LevelData> cachedLevels;
+                for (uint32_t level = firstLevel; level < levels; ++level)
+                    cachedLevels.push_back({ cached.level(level), cached.levelSize(level) });
+
+                ImageUpload upload = uploadImageLevels(uploadBatch, cachedFormat, levelSize, cachedLevels);
+                if (firstLevel > 0) {
+                    upload.stream     = { texture.path, cachedFormat, cached.compressed(), cached.width(), cached.height(), levels };
+                    upload.firstLevel = firstLevel;
+                }
+                images.push_back(upload);
+                texture.cached.close();
+                continue;
+            }
+
+            if (!texture.compressed.levels.empty()) {
+                const auto&      compressed = texture.compressed;
+                const vk::Format bcFormat   = static_cast<vk::Format>(tools::texture::vkFormatOf(compressed));
+                const uint32_t   levels     = static_cast<uint32_t>(compressed.levels.size());
+                const uint32_t   firstLevel = m_streamTextures ? TextureStreamer::tailLevel(compressed.width, compressed.height, levels) : 0;
+                const auto       levelSize  = vk::Extent2D(std::max(1u, compressed.width >> firstLevel),
+                                                           std::max(1u, compressed.height >> firstLevel));
+
+                ImageUpload upload = uploadImageLevels(uploadBatch, bcFormat, levelSize,
+                                                       levelData(compressed.levels, firstLevel));
+                if (firstLevel > 0) {
+                    upload.stream     = { texture.path, bcFormat, true, compressed.width, compressed.height, levels };
+                    upload.firstLevel = firstLevel;
+                }
+                images.push_back(upload);
+                texture.compressed = tools::texture::CompressedTexture();
+                continue;
+            }
+
+            if (!texture.tail.empty()) {
+                const uint32_t levels    = static_cast<uint32_t>(texture.firstLevel + texture.tail.size());
+                const auto     levelSize = vk::Extent2D(std::max(1, texture.width >> texture.firstLevel),
+                                                        std::max(1, texture.height >> texture.firstLevel));
+
+                ImageUpload upload = uploadImageLevels(uploadBatch, format, levelSize, levelData(texture.tail, 0));
+                upload.stream     = { texture.path, format, false, static_cast<uint32_t>(texture.width),
+                                      static_cast<uint32_t>(texture.height), levels };
+                upload.firstLevel = texture.firstLevel;
+                images.push_back(upload);
+                texture.tail.clear();
+                continue;
+            }
 
             // Handle failure
-            if (!pixels)
-            {
-                texWidth = texHeight = 1;
-                texChannels = 4;
-                glm::u8vec4* color = new glm::u8vec4(255, 0, 255, 255);
-                pixels = reinterpret_cast<stbi_uc*>(color);
+            const glm::u8vec4 errorColor = glm::u8vec4(255, 0, 255, 255);
+            const void*       pixels     = texture.pixels;
+            if (!pixels) {
+                texture.width = texture.height = 1;
+                pixels = &errorColor;
             }
 
-            vk::DeviceSize bufferSize = static_cast<uint64_t>(texWidth) * texHeight * sizeof(glm::u8vec4);
-            auto imageSize = vk::Extent2D(texWidth, texHeight);
+            vk::DeviceSize bufferSize = static_cast<uint64_t>(texture.width) * texture.height * sizeof(glm::u8vec4);
+            auto imageSize = vk::Extent2D(texture.width, texture.height);
             auto imageCreateInfo = app::image::create2DInfo(imageSize, format, vk::ImageUsageFlagBits::eSampled, true);
 
-            app::ImageVma image = m_allocator.createImage(cmdBuffer, bufferSize, pixels, imageCreateInfo);
-            app::image::generateMipmaps(cmdBuffer, image.image, format, imageSize, imageCreateInfo.mipLevels);
-            
-            vk::ImageViewCreateInfo imageViewCreateInfo = app::image::makeImageViewCreateInfo(image.image, imageCreateInfo);
+            const bool computeMipmaps = m_mipmapGenerator.isValid() && app::MipmapGenerator::supports(imageCreateInfo);
+            if (computeMipmaps)
+                app::MipmapGenerator::prepareImageInfo(imageCreateInfo);
 
-            app::TextureVma texture = m_allocator.createTexture(image, imageViewCreateInfo, samplerCreateInfo);
+            // the image stays in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL until its mip chain is generated
+            app::ImageVma image = m_allocator.createImage(uploadBatch, imageCreateInfo, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            uploadBatch.addCopy(image.image, 0, imageCreateInfo.extent, bufferSize, pixels);
 
-            m_textures.push_back(texture);
+            if (computeMipmaps)
+                mipmapImages.push_back({ image.image, format, imageSize, imageCreateInfo.mipLevels });
+            else
+                blitImages.push_back({ image.image, format, imageSize, imageCreateInfo.mipLevels });
+
+            stbi_image_free(texture.pixels);
+            texture.pixels = nullptr;
+            
+            images.push_back({ image, imageCreateInfo });
         }
     }
+
+    // Atlas pages, built from their decoded tiles
+    for (const auto& page : pages) {
+        std::vector<stbi_uc*> tilePixels(page.tiles.size(), nullptr);
+        threadPool.parallelFor(page.tiles.size(), [&](size_t i) {
+            const TextureAtlas::Tile& tile = page.tiles[i];
+            int width, height, texChannels;
+            tilePixels[i] = stbi_load(tile.file.c_str(), &width, &height, &texChannels, STBI_rgb_alpha);
+            if (tilePixels[i] && (static_cast<uint32_t>(width) != tile.width || static_cast<uint32_t>(height) != tile.height)) {
+                stbi_image_free(tilePixels[i]);
+                tilePixels[i] = nullptr;
+            }
+        });
+
+        std::vector<std::vector<uint8_t>> levels = TextureAtlas::buildPage(
+            page, std::vector<const uint8_t*>(tilePixels.begin(), tilePixels.end()), format == vk::Format::eR8G8B8A8Srgb);
+        for (auto pixels : tilePixels)
+            stbi_image_free(pixels);
+
+        images.push_back(uploadImageLevels(uploadBatch, format, vk::Extent2D(page.width, page.height), levelData(levels, 0)));
+    }
+
+    uploadBatch.cmdFlush(cmdBuffer);
+
+    if (!textures.empty()) {
+        const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << "Textures: " << textures.size() << " loaded in " << elapsed << " ms, " << warmCount << " warm from the "
+                  << (compress && !cache ? "KTX2 files" : "cache") << ", " << textures.size() - warmCount << " cold decoded ("
+                  << (warmCount == textures.size() ? "warm" : warmCount > 0 ? "partial" : "cold") << ")" << std::endl;
+    }
+
+    // Mip chains of all the images at once
+    mipmapBatch = m_mipmapGenerator.cmdGenerate(cmdBuffer, mipmapImages);
+    for (const auto& image : blitImages) {
+        app::image::generateMipmaps(cmdBuffer, image.image, image.format, image.size, image.mipLevels, 1,
+                                    vk::ImageLayout::eTransferDstOptimal);
+    }
+
+    return images;
 }
 
 //-------------------------------------------------------------------------
-// Describing the layout pushed when rendering
+// Levels [firstLevel, end) of a mip chain held in memory
 //
-void ExampleVulkan::createDescriptorSetLayout()
+std::vector<ExampleVulkan::LevelData> ExampleVulkan::levelData(const std::vector<std::vector<uint8_t>>& levels,
+                                                               uint32_t firstLevel)
+{
+    std::vector<LevelData> data;
+    for (size_t level = firstLevel; level < levels.size(); ++level)
+        data.push_back({ levels[level].data(), levels[level].size() });
+    return data;
+}
+
+//-------------------------------------------------------------------------
+// Copy of precomputed levels, block compressed, cached, streamed or of an
+// atlas page, 'size' is the size of the first one
+//
+ExampleVulkan::ImageUpload ExampleVulkan::uploadImageLevels(app::ImageUploadBatch& batch, vk::Format format,
+                                                            vk::Extent2D size, const std::vector<LevelData>& levels)
 {
-    uint32_t nTextures = static_cast<uint32_t>(m_textures.size());
-    uint32_t nObjects  = static_cast<uint32_t>(m_objModel.size());
+    const uint32_t mipLevels = static_cast<uint32_t>(levels.size());
 
-    // Camera matrices (binding = 0)
-    vk::DescriptorSetLayoutBinding bindingCamera = {};
-    bindingCamera.binding         = 0;
-    bindingCamera.descriptorType  = vk::DescriptorType::eUniformBuffer;
-    bindingCamera.descriptorCount = 1;
-    bindingCamera.stageFlags      = vk::ShaderStageFlagBits::eVertex;
-    m_descSetLayoutBind.addBinding(bindingCamera);
+    vk::ImageCreateInfo imageCreateInfo = app::image::create2DInfo(size, format);
+    imageCreateInfo.mipLevels = mipLevels;
+
+    app::ImageVma image = m_allocator.createImage(batch, imageCreateInfo);
+
+    for (uint32_t level = 0; level < mipLevels; ++level) {
+        vk::Extent3D extent(std::max(1u, size.width >> level), std::max(1u, size.height >> level), 1);
+        batch.addCopy(image.image, level, extent, levels[level].size, levels[level].data);
+    }
+
+    return { image, imageCreateInfo };
+}
+
+//-------------------------------------------------------------------------
+// Views and samplers of the uploaded images, on the render thread as the
+// samplers are shared. The slots reserved by other loads stay empty.
+//
+void ExampleVulkan::createTextures(const std::vector<ImageUpload>& images, const std::vector<uint32_t>& slots)
+{
+    m_textures.resize(std::max<size_t>(m_textures.size(), m_textureRegistry.size()));
+
+    vk::SamplerCreateInfo samplerCreateInfo = {};
+    samplerCreateInfo.magFilter  = vk::Filter::eLinear;
+    samplerCreateInfo.minFilter  = vk::Filter::eLinear;
+    samplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
+    samplerCreateInfo.maxLod     = FLT_MAX;
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        const ImageUpload&      upload              = images[i];
+        vk::ImageViewCreateInfo imageViewCreateInfo = app::image::makeImageViewCreateInfo(upload.image.image, upload.info);
+
+        // images with extended usage also have the storage usage, not supported by sRGB
+        vk::ImageViewUsageCreateInfo usageCreateInfo(vk::ImageUsageFlagBits::eSampled);
+        if (upload.info.flags & vk::ImageCreateFlagBits::eExtendedUsage)
+            imageViewCreateInfo.pNext = &usageCreateInfo;
+
+        app::TextureVma texture = m_allocator.createTexture(upload.image, imageViewCreateInfo, samplerCreateInfo);
+
+        m_textures[slots[i]] = texture;
+
+        if (!upload.stream.file.empty())
+            m_textureStreamer.add(slots[i], upload.stream, upload.firstLevel, upload.image.image);
+    }
+
+    if (!m_descriptorSets.empty())
+        updateTextureDescriptors(std::vector<uint32_t>(slots.begin(), slots.begin() + images.size()));
+}
+
+//-------------------------------------------------------------------------
+// Describing the layout pushed when rendering. The arrays of models and
+// textures have a fixed capacity and are updated after being bound, so
+// adding a model only writes its descriptors.
+//
+void ExampleVulkan::createDescriptorSetLayout()
+{
+    vk::PhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+    vk::PhysicalDeviceFeatures2                     features         = {};
+    features.pNext = &indexingFeatures;
+    m_physicalDevice.getFeatures2(&features);
+
+    if (!indexingFeatures.descriptorBindingPartiallyBound
+        || !indexingFeatures.descriptorBindingUpdateUnusedWhilePending
+        || !indexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+        || !indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind)
+        throw std::runtime_error("failed to create descriptor set layout, update after bind is not supported!");
+
+    // the texture feedback (binding 5) is written with atomics by the fragment shader
+    if (!features.features.fragmentStoresAndAtomics)
+        throw std::runtime_error("failed to create descriptor set layout, fragment stores and atomics are not supported!");
+
+    // the fragment stage also reads the scene description and the feedback buffers
+    vk::PhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = {};
+    vk::PhysicalDeviceProperties2                     properties         = {};
+    properties.pNext = &indexingProperties;
+    m_physicalDevice.getProperties2(&properties);
+
+    const uint32_t maxStorageBuffers = std::min(indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+                                                indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers);
+    const uint32_t maxSampledImages  = std::min(indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                                indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages);
+    if (maxStorageBuffers < 4 || maxSampledImages < 1)
+        throw std::runtime_error("failed to create descriptor set layout, too few update after bind descriptors!");
+
+    // the scene description and the feedback are not in the arrays
+    m_maxObjects  = std::min(uint32_t(MAX_OBJECTS), (maxStorageBuffers - 2) / 2);
+    m_maxTextures = std::min(uint32_t(MAX_TEXTURES), maxSampledImages);
+
+    uint32_t nTextures = m_maxTextures;
+    uint32_t nObjects  = m_maxObjects;
+
+    m_descSetLayoutBind.clear();
 
     // Materials (binding = 1)
     vk::DescriptorSetLayoutBinding bindingMat = {};
@@ -241,9 +1285,56 @@ void ExampleVulkan::createDescriptorSetLayout()
     bindingMaterial.stageFlags      = vk::ShaderStageFlagBits::eFragment;
     m_descSetLayoutBind.addBinding(bindingMaterial);
 
-    m_descriptorSetLayout = m_descSetLayoutBind.createLayout(m_device);
-    m_descriptorPool      = m_descSetLayoutBind.createPool(m_device, 1);
-    m_descriptorSet       = app::util::allocateDescriptorSet(m_device, m_descriptorPool, m_descriptorSetLayout);
+    // Texture levels sampled, all the frames (binding = 5). Dynamic buffers
+    // are not allowed with update after bind, the frame offset is pushed.
+    vk::DescriptorSetLayoutBinding bindingFeedback = {};
+    bindingFeedback.binding         = 5;
+    bindingFeedback.descriptorType  = vk::DescriptorType::eStorageBuffer;
+    bindingFeedback.descriptorCount = 1;
+    bindingFeedback.stageFlags      = vk::ShaderStageFlagBits::eFragment;
+    m_descSetLayoutBind.addBinding(bindingFeedback);
+
+    // The elements not used by the frames in flight can be written, the others
+    // are never read before being written. The arrays are not variable-count:
+    // only the highest binding of a set can be, there are three of them and
+    // the layout is already sized from the update after bind limits.
+    const vk::DescriptorBindingFlags arrayFlags = vk::DescriptorBindingFlagBits::eUpdateAfterBind
+                                                | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending
+                                                | vk::DescriptorBindingFlagBits::ePartiallyBound;
+    m_descSetLayoutBind.setBindingFlags(1, arrayFlags);
+    m_descSetLayoutBind.setBindingFlags(3, arrayFlags);
+    m_descSetLayoutBind.setBindingFlags(4, arrayFlags);
+
+    // The scene description is replaced by a larger one while the frames in
+    // flight still read the previous one, see 'updateSceneResources'
+    m_descSetLayoutBind.setBindingFlags(2, vk::DescriptorBindingFlagBits::eUpdateAfterBind);
+
+    m_descriptorSetLayout = m_descSetLayoutBind.createLayout(m_device,
+                                                             vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool);
+
+    // One set per frame in flight: the texture slots replaced while a frame is
+    // pending are written in its set once its fence has signaled
+    const uint32_t nbSets = static_cast<uint32_t>(m_fences.size());
+    if (nbSets > 32)
+        throw std::runtime_error("failed to create descriptor sets, too many frames in flight!");
+    m_descriptorPool = m_descSetLayoutBind.createPool(m_device, nbSets, vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind);
+    app::util::allocateDescriptorSets(m_device, m_descriptorPool, m_descriptorSetLayout, nbSets, m_descriptorSets);
+    m_frameTextureSlots.assign(nbSets, {});
+    m_loadingSlots.clear();
+
+    // Camera matrices, at the offset of the frame in the upload ring (set = 1, binding = 0)
+    vk::DescriptorSetLayoutBinding bindingCamera = {};
+    bindingCamera.binding         = 0;
+    bindingCamera.descriptorType  = vk::DescriptorType::eUniformBufferDynamic;
+    bindingCamera.descriptorCount = 1;
+    bindingCamera.stageFlags      = vk::ShaderStageFlagBits::eVertex;
+
+    m_frameDescSetLayoutBind.clear();
+    m_frameDescSetLayoutBind.addBinding(bindingCamera);
+
+    m_frameDescriptorSetLayout = m_frameDescSetLayoutBind.createLayout(m_device);
+    m_frameDescriptorPool      = m_frameDescSetLayoutBind.createPool(m_device, 1);
+    m_frameDescriptorSet       = app::util::allocateDescriptorSet(m_device, m_frameDescriptorPool, m_frameDescriptorSetLayout);
 }
 
 //-------------------------------------------------------------------------
@@ -256,10 +1347,10 @@ void ExampleVulkan::createGraphicsPipeline()
                                                  0, sizeof(ObjPushConstant) };
 
     // Create Pipeline Layout
-    vk::DescriptorSetLayout descriptorSetLayout(m_descriptorSetLayout);
+    std::array<vk::DescriptorSetLayout, 2> descriptorSetLayouts = { m_descriptorSetLayout, m_frameDescriptorSetLayout };
     vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
-    pipelineLayoutCreateInfo.setLayoutCount = 1;
-    pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+    pipelineLayoutCreateInfo.pSetLayouts = descriptorSetLayouts.data();
     pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
     pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRanges;
 
@@ -273,15 +1364,11 @@ void ExampleVulkan::createGraphicsPipeline()
     // Create the Pipeline
     app::GraphicsPipelineGeneratorCombined pipelineGenerator(m_device, m_pipelineLayout, m_offscreenRenderPass);
     pipelineGenerator.depthStencilState.depthTestEnable =  true;
-    pipelineGenerator.addShader(app::util::readFile("shaders/vert_shader.vert.spv"), vk::ShaderStageFlagBits::eVertex);
+    pipelineGenerator.addShader(app::util::readFile(vertexShader(m_vertexLayout)), vk::ShaderStageFlagBits::eVertex);
     pipelineGenerator.addShader(app::util::readFile("shaders/frag_shader.frag.spv"), vk::ShaderStageFlagBits::eFragment);
     pipelineGenerator.multisampleState.rasterizationSamples  = m_sampleCount;
-    pipelineGenerator.addBindingDescription({0, sizeof(VertexObj)});
-    pipelineGenerator.addAttributeDescriptions(std::vector<vk::VertexInputAttributeDescription> {
-        {0, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, pos)},
-        { 1, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, nrm) },
-        { 2, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, color) },
-        { 3, 0, vk::Format::eR32G32Sfloat, offsetof(VertexObj, texCoord) }});
+    pipelineGenerator.addBindingDescription({0, vertexStride(m_vertexLayout)});
+    pipelineGenerator.addAttributeDescriptions(vertexAttributes(m_vertexLayout));
 
     m_graphicsPipeline = pipelineGenerator.createPipeline();
 
@@ -290,19 +1377,6 @@ void ExampleVulkan::createGraphicsPipeline()
 #endif
 }
 
-//-------------------------------------------------------------------------
-// Creating the uniform buffer holding the camera matrices
-// - Buffer is host visible
-//
-void ExampleVulkan::createUniformBuffer()
-{
-    m_cameraMat = m_allocator.createBuffer(sizeof(CameraMatrices), vk::BufferUsageFlagBits::eUniformBuffer,
-        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-#if _DEBUG
-    m_debug.setObjectName(m_cameraMat.buffer, "cameraMatBuffer");
-#endif
-}
-
 //-------------------------------------------------------------------------
 // Create a storage buffer containing the description of the scene elements
 // - Which geometry is used by which instance
@@ -311,12 +1385,12 @@ void ExampleVulkan::createUniformBuffer()
 //
 void ExampleVulkan::createSceneDescriptionBuffer()
 {
-    app::CommandPool commandGen(m_device, m_graphicsQueueIdx);
-    auto commandBuffer = commandGen.createBuffer();
-
-    m_sceneDesc = m_allocator.createBuffer(commandBuffer, m_objInstance, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-    commandGen.submitAndWait(commandBuffer);
-    m_allocator.finalizeAndReleaseStaging();
+    // spare room for the models loaded later, all the instances are written
+    // by the next frame, see 'cmdUpdateSceneDescription'
+    m_sceneDescCapacity = std::max(size_t(MIN_SCENE_INSTANCES), m_objInstance.size() * 2);
+    m_sceneDesc = m_allocator.createBuffer(m_sceneDescCapacity * sizeof(ObjInstance),
+                                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_sceneDescDirty = 0;
 
 #if _DEBUG
     m_debug.setObjectName(m_sceneDesc.buffer, "sceneDescBuffer");
@@ -324,50 +1398,193 @@ void ExampleVulkan::createSceneDescriptionBuffer()
 }
 
 //-------------------------------------------------------------------------
-// Setting up the buffers in the descriptor set
+// Setting up the buffers in the descriptor set, and the models and textures
+// loaded before it was created
 //
 void ExampleVulkan::updateDescriptorSet()
 {
     std::vector<vk::WriteDescriptorSet> writes;
 
-    // Camera Matrices
+    // Camera Matrices, the offset of the frame is dynamic
     vk::DescriptorBufferInfo cameraBufferInfo = {};
-    cameraBufferInfo.buffer = m_cameraMat.buffer;
+    cameraBufferInfo.buffer = m_uploadRing.getBuffer();
     cameraBufferInfo.offset = 0;
-    cameraBufferInfo.range  = VK_WHOLE_SIZE;
-    writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descriptorSet, 0, &cameraBufferInfo));
+    cameraBufferInfo.range  = sizeof(CameraMatrices);
+    writes.emplace_back(m_frameDescSetLayoutBind.makeWrite(m_frameDescriptorSet, 0, &cameraBufferInfo));
     
     // Scene Description
     vk::DescriptorBufferInfo SceneBufferInfo = {};
     SceneBufferInfo.buffer = m_sceneDesc.buffer;
     SceneBufferInfo.offset = 0;
     SceneBufferInfo.range  = VK_WHOLE_SIZE;
-    writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descriptorSet, 2, &SceneBufferInfo));
+    writes.emplace_back(m_descSetLayoutBind.makeWrite(vk::DescriptorSet(), 2, &SceneBufferInfo));
+
+    // Texture feedback of all the frames, sized for all the slots
+    m_textureStreamer.prepareFeedback(m_maxTextures);
+    vk::DescriptorBufferInfo feedbackBufferInfo = m_textureStreamer.feedbackDescriptor();
+    writes.emplace_back(m_descSetLayoutBind.makeWrite(vk::DescriptorSet(), 5, &feedbackBufferInfo));
+
+    // writing the information, the camera in its own set
+    m_device.updateDescriptorSets(writes[0], nullptr);
+    writeAllSets(std::vector<vk::WriteDescriptorSet>(writes.begin() + 1, writes.end()));
+
+    updateModelDescriptors(0);
+
+    std::vector<uint32_t> slots;
+    for (uint32_t slot = 0; slot < m_textures.size(); ++slot) {
+        if (m_textures[slot].descriptor.imageView)
+            slots.push_back(slot);
+    }
+    updateTextureDescriptors(slots);
+}
+
+//-------------------------------------------------------------------------
+// Material buffers of the models from 'firstModel', 1 buffer per Obj. Their
+// elements are not used by the frames in flight.
+//
+void ExampleVulkan::updateModelDescriptors(size_t firstModel)
+{
+    if (m_objModel.size() > m_maxObjects)
+        throw std::runtime_error("failed to update descriptor set, too many models!");
+    if (firstModel >= m_objModel.size())
+        return;
 
-    // All material buffers, 1 buffer per Obj
     std::vector<vk::DescriptorBufferInfo> materialBuffersInfo;
     std::vector<vk::DescriptorBufferInfo> materialBuffersIdxInfo;
 
-    for (size_t i = 0; i < m_objModel.size(); ++i) {
+    for (size_t i = firstModel; i < m_objModel.size(); ++i) {
         materialBuffersInfo.push_back({ m_objModel[i].matColorBuffer.buffer, 0, VK_WHOLE_SIZE });
         materialBuffersIdxInfo.push_back({ m_objModel[i].matIndexBuffer.buffer, 0, VK_WHOLE_SIZE });
     }
-    writes.emplace_back(m_descSetLayoutBind.makeWriteArray(m_descriptorSet, 1, materialBuffersInfo.data()));
-    writes.emplace_back(m_descSetLayoutBind.makeWriteArray(m_descriptorSet, 4, materialBuffersIdxInfo.data()));
 
-    // All texture samplers
-    std::vector<vk::DescriptorImageInfo> textureImageInfo;
-    for (size_t i = 0; i < m_textures.size(); ++i) {
-        textureImageInfo.push_back(m_textures[i].descriptor);
+    std::vector<vk::WriteDescriptorSet> writes = {
+        m_descSetLayoutBind.makeWrite(vk::DescriptorSet(), 1, materialBuffersInfo.data(), static_cast<uint32_t>(firstModel)),
+        m_descSetLayoutBind.makeWrite(vk::DescriptorSet(), 4, materialBuffersIdxInfo.data(), static_cast<uint32_t>(firstModel))
+    };
+    for (auto& write : writes)
+        write.descriptorCount = static_cast<uint32_t>(materialBuffersInfo.size());
+
+    writeAllSets(writes);
+}
+
+//-------------------------------------------------------------------------
+// Samplers of the textures created in 'slots'. The slots still loading show
+// the first texture uploaded, as the models published may share them. The
+// slots are written in the set of each frame when it begins, as the frames
+// in flight may use them.
+//
+void ExampleVulkan::updateTextureDescriptors(const std::vector<uint32_t>& slots)
+{
+    if (m_textures.size() > m_maxTextures)
+        throw std::runtime_error("failed to update descriptor set, too many textures!");
+
+    uint32_t loadingSlot = 0;
+    while (loadingSlot < m_textures.size() && !m_textures[loadingSlot].descriptor.imageView)
+        loadingSlot++;
+
+    // a new first texture replaces the one shown by the slots still loading
+    m_loadingSlots.resize(m_textures.size(), false);
+    if (std::find(slots.begin(), slots.end(), loadingSlot) != slots.end())
+        m_loadingSlots.assign(m_textures.size(), false);
+
+    std::vector<uint32_t> changed;
+    for (uint32_t slot : slots) {
+        changed.push_back(slot);
+        m_loadingSlots[slot] = false;
+    }
+
+    for (uint32_t slot = 0; loadingSlot < m_textures.size() && slot < m_textures.size(); ++slot) {
+        if (m_textures[slot].descriptor.imageView || m_loadingSlots[slot])
+            continue;
+        changed.push_back(slot);
+        m_loadingSlots[slot] = true;
     }
-    writes.emplace_back(m_descSetLayoutBind.makeWriteArray(m_descriptorSet, 3, textureImageInfo.data()));
 
-    // writing the information
-    m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    for (auto& frameSlots : m_frameTextureSlots)
+        frameSlots.insert(frameSlots.end(), changed.begin(), changed.end());
 }
 
 //-------------------------------------------------------------------------
-// Called at each frame to update the camera matrix
+// Called by 'prepareFrame' once the set of 'frame' is no longer used: the
+// texture slots and the scene description changed since its previous use
+// are written, and the textures and buffers they replaced are destroyed
+// when no other set shows them
+//
+void ExampleVulkan::writeFrameDescriptors(uint32_t frame)
+{
+    if (frame >= m_descriptorSets.size())
+        return;
+
+    std::vector<uint32_t>& slots = m_frameTextureSlots[frame];
+    std::sort(slots.begin(), slots.end());
+    slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+
+    uint32_t loadingSlot = 0;
+    while (loadingSlot < m_textures.size() && !m_textures[loadingSlot].descriptor.imageView)
+        loadingSlot++;
+
+    std::vector<vk::WriteDescriptorSet> writes;
+    for (uint32_t slot : slots) {
+        if (m_textures[slot].descriptor.imageView)
+            writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descriptorSets[frame], 3, &m_textures[slot].descriptor, slot));
+        else if (m_loadingSlots[slot] && loadingSlot < m_textures.size())
+            writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descriptorSets[frame], 3, &m_textures[loadingSlot].descriptor, slot));
+    }
+    slots.clear();
+
+    vk::DescriptorBufferInfo sceneBufferInfo(m_sceneDesc.buffer, 0, VK_WHOLE_SIZE);
+    if (m_sceneDescSets & (1u << frame)) {
+        writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descriptorSets[frame], 2, &sceneBufferInfo));
+        m_sceneDescSets &= ~(1u << frame);
+    }
+
+    if (!writes.empty())
+        m_device.updateDescriptorSets(writes, nullptr);
+
+    for (size_t i = 0; i < m_retiredTextures.size();) {
+        RetiredTexture& retired = m_retiredTextures[i];
+        retired.sets &= ~(1u << frame);
+        if (retired.sets) {
+            i++;
+            continue;
+        }
+        m_allocator.destroy(retired.texture);
+        retired = m_retiredTextures.back();
+        m_retiredTextures.pop_back();
+    }
+
+    for (size_t i = 0; i < m_retiredBuffers.size();) {
+        RetiredBuffer& retired = m_retiredBuffers[i];
+        retired.sets &= ~(1u << frame);
+        if (retired.sets) {
+            i++;
+            continue;
+        }
+        m_allocator.destroy(retired.buffer);
+        retired = m_retiredBuffers.back();
+        m_retiredBuffers.pop_back();
+    }
+}
+
+//-------------------------------------------------------------------------
+// The writes are made in the set of each frame, only for the elements and
+// bindings not used by the frames in flight
+//
+void ExampleVulkan::writeAllSets(const std::vector<vk::WriteDescriptorSet>& writes)
+{
+    std::vector<vk::WriteDescriptorSet> setWrites;
+    for (vk::DescriptorSet set : m_descriptorSets) {
+        for (vk::WriteDescriptorSet write : writes) {
+            write.dstSet = set;
+            setWrites.push_back(write);
+        }
+    }
+    m_device.updateDescriptorSets(setWrites, nullptr);
+}
+
+//-------------------------------------------------------------------------
+// Called at each frame after 'prepareFrame', the camera matrices are
+// written in the space of the frame
 //
 void ExampleVulkan::updateUniformBuffer()
 {
@@ -378,11 +1595,11 @@ void ExampleVulkan::updateUniformBuffer()
     ubo.proj = glm::perspective(glm::radians(65.0f), aspectRatio, 0.1f, 1000.0f);
     ubo.proj[1][1] *= -1;  // Inverting Y for Vulkan
     ubo.viewInverse = glm::inverse(ubo.view);
+    m_cameraMatrices = ubo;
 
-    void* data;
-    vmaMapMemory(m_allocator.getAllocator(), m_cameraMat.allocation, &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vmaUnmapMemory(m_allocator.getAllocator(), m_cameraMat.allocation);
+    app::UploadRing::Allocation camera = m_uploadRing.allocate(sizeof(CameraMatrices));
+    memcpy(camera.data, &ubo, sizeof(ubo));
+    m_cameraOffset = static_cast<uint32_t>(camera.offset);
 }
 
 //-------------------------------------------------------------------------
@@ -410,12 +1627,37 @@ void ExampleVulkan::rasterize(const vk::CommandBuffer& cmdBuffer)
 
     // Drawing all traingles
     cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_graphicsPipeline);
-    cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout, 0, { m_descriptorSet }, {});
+    cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout, 0,
+                                 { m_descriptorSets[getCurrentFrame()], m_frameDescriptorSet }, { m_cameraOffset });
+    m_pushConstant.feedbackOffset = m_textureStreamer.feedbackOffset(getCurrentFrame()) / sizeof(uint32_t);
+
+    // Pixels per unit of length at distance 1 along the view direction
+    const glm::vec3 eye        = glm::vec3(m_cameraMatrices.viewInverse[3]);
+    const float     pixelScale = std::fabs(m_cameraMatrices.proj[1][1]) * 0.5f * static_cast<float>(m_size.height);
 
     for (int i = 0; i < m_objInstance.size(); ++i) {
         auto& instance = m_objInstance[i];
         auto& model = m_objModel[instance.objIndex];
+
+        // Coarsest LOD with a projected error under m_lodPixelError, measured
+        // at the closest point of the bounding sphere
+        const glm::vec3 center   = glm::vec3(instance.transform * glm::vec4(model.center, 1.f));
+        const float     scale    = std::max(glm::length(glm::vec3(instance.transform[0])),
+                                            std::max(glm::length(glm::vec3(instance.transform[1])),
+                                                     glm::length(glm::vec3(instance.transform[2]))));
+        const float     distance = std::max(glm::length(center - eye) - model.radius * scale, 0.1f);
+
+        size_t lod = 0;
+        while (lod + 1 < model.lods.size()
+               && model.lods[lod + 1].error * scale / distance * pixelScale <= m_lodPixelError)
+            lod++;
+
         m_pushConstant.instanceId = i; // which instance to draw
+        m_pushConstant.uvOffset   = model.decode.uvOffset;
+        m_pushConstant.uvScale    = model.decode.uvScale;
+        m_pushConstant.posOffset  = glm::vec4(model.decode.posOffset, 0.f);
+        m_pushConstant.posScale   = glm::vec4(model.decode.posScale, 0.f);
+        m_pushConstant.primitiveOffset = static_cast<int>(model.lods[lod].firstIndex / 3);
 
         cmdBuffer.pushConstants<ObjPushConstant>(m_pipelineLayout,
                                                  vk::ShaderStageFlagBits::eVertex
@@ -423,8 +1665,8 @@ void ExampleVulkan::rasterize(const vk::CommandBuffer& cmdBuffer)
                                                  0, m_pushConstant);
 
         cmdBuffer.bindVertexBuffers(0, 1, &vk::Buffer(model.vertexBuffer.buffer), &offset);
-        cmdBuffer.bindIndexBuffer(model.indexBuffer.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(model.nIndices, 1, 0, 0, 0);
+        cmdBuffer.bindIndexBuffer(model.indexBuffer.buffer, 0, model.indexType);
+        cmdBuffer.drawIndexed(model.lods[lod].nbIndices, 1, model.lods[lod].firstIndex, 0, 0);
     }
 }
 
@@ -8,13 +8,22 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
 #include <sstream>
+#include <utility>
 #include "vulkan/vulkan.hpp"
 
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_inverse.hpp"
 
 #include "../external/obj_loader.h"
+#include "vertexlayout.hpp"
+#include "textureatlas.hpp"
+#include "textureregistry.hpp"
+#include "texturestreamer.hpp"
 
 #include "../vk_helpers/utilities.hpp"
 #include "../vk_helpers/renderpass.hpp"
@@ -22,12 +31,18 @@
 
 #include "../vk_helpers/pipeline.hpp"
 #include "../general_helpers/manipulator.h"
+#include "../general_helpers/meshlets.hpp"
+#include "../general_helpers/ktx2.hpp"
+#include "../general_helpers/texturecache.hpp"
+#include "../general_helpers/threadpool.hpp"
 #include "../vk_helpers/commands.hpp"
 
 #include "../vk_helpers/vulkanbackend.hpp"
 #include "../vk_helpers/debug.hpp"
 #include "../vk_helpers/descriptorsets.hpp"
 #include "../vk_helpers/allocator.hpp"
+#include "../vk_helpers/mipmapgenerator.hpp"
+#include "../vk_helpers/uploadring.hpp"
 
  ///////////////////////////////////////////////////////////////////////////
  // Example Vulkan                                                        //
@@ -49,19 +64,35 @@ public:
 
     void onResize(int /*w*/, int /*h*/) override;
 
+    void prepareFrame() override;
+
     void loadModel(const std::string& filename, glm::mat4 transform = glm::mat4(1));
 
+    void loadModels(const std::vector<std::pair<std::string, glm::mat4>>& models);
+
+    void loadModelAsync(const std::string& filename, glm::mat4 transform = glm::mat4(1));
+
+    void updateAsyncLoads();
+
+    void updateTextureStreaming();
+
+    void updateStagingTelemetry();
+
+    bool writeStagingTelemetry(const std::string& filename) const;
+
     void createTextureImages(const vk::CommandBuffer& cmdBuffer,
-                             const std::vector<std::string>& textures);
+                             const std::vector<std::string>& textures,
+                             const std::vector<TextureAtlas::Page>& pages,
+                             const std::vector<uint32_t>& slots);
 
     void createDescriptorSetLayout();
 
     void createGraphicsPipeline();
 
-    void createUniformBuffer();
-
     void createSceneDescriptionBuffer();
 
+    void cmdUpdateSceneDescription(const vk::CommandBuffer& cmdBuffer);
+
     void updateDescriptorSet();
 
     void updateUniformBuffer();
@@ -89,19 +120,35 @@ public:
     // The OBJ model
     struct ObjModel
     {
-        uint32_t       nIndices{ 0 };
+        uint32_t       nIndices{ 0 };  // Indices of the full detail level
         uint32_t       nVertices{ 0 };
+        vk::IndexType  indexType{ vk::IndexType::eUint32 }; // 16 bits when nVertices < 65536
+        VertexDecode   decode;         // Bounds of the quantized vertex attributes
         app::BufferVma vertexBuffer;   // Device buffer of all vertex
-        app::BufferVma indexBuffer;    // Device buffer of all indices forming triangles
+        app::BufferVma indexBuffer;    // Device buffer of all indices forming triangles, all LODs
         app::BufferVma matColorBuffer; // Device buffer of array of wavefront material
         app::BufferVma matIndexBuffer; // Device buffer of array of Wavefront material
+
+        // Levels of detail in the index buffer, selected against the bounding sphere
+        std::vector<ObjLod> lods;
+        glm::vec3           center{ 0.f };
+        float               radius{ 0.f };
+
+        // Optional split in meshlets, see 'tools::mesh::Meshlet'
+        uint32_t       nMeshlets{ 0 };
+        app::BufferVma meshletBuffer;         // Device buffer of the meshlets and their bounds
+        app::BufferVma meshletVertexBuffer;   // Device buffer of the vertex indices of each meshlet
+        app::BufferVma meshletTriangleBuffer; // Device buffer of the uint8 local indices of each meshlet
+
+        // Registry slots referenced by the materials, their texture ids are slots
+        std::vector<uint32_t> textures;
     };
 
     // Instance of the OBJ
     struct ObjInstance
     {
         uint32_t  objIndex{ 0 };    // Reference to the 'm_objModel'
-        uint32_t  txtOffset{ 0 };   // Offset in 'm_textures'
+        uint32_t  txtOffset{ 0 };   // Offset of the material texture ids, 0 as they are registry slots
         glm::mat4 transform{ 1 };   // Position of the instance
         glm::mat4 transformIT{ 1 }; // Inverse Transpose
     };
@@ -113,9 +160,148 @@ public:
         int       instanceId{ 0 };                  // To retrieve the transformation matrix
         float     lightIntensity{ 100.f };
         int       lightType{ 0 };                   // 0: point, 1: infinite
+        glm::vec2 uvOffset{ 0.f };                  // Decoding of the model vertices
+        glm::vec4 posOffset{ 0.f };
+        glm::vec4 posScale{ 1.f };
+        glm::vec2 uvScale{ 1.f };
+        int       primitiveOffset{ 0 };           // First triangle of the LOD in the material indices
+        uint32_t  feedbackOffset{ 0 };            // Region of the frame in the texture feedback, in texture slots
     };
     ObjPushConstant m_pushConstant;
 
+    // Texture image uploaded, waiting for its view and sampler
+    struct ImageUpload
+    {
+        app::ImageVma           image;
+        vk::ImageCreateInfo     info;
+        TextureStreamer::Source stream;        // File empty when all levels are uploaded
+        uint32_t                firstLevel{ 0 }; // Level of the texture in level 0 of the image
+    };
+
+    // Model parsed and recorded on the thread pool, with its own command pool,
+    // staging memory and fence as they are not shared between threads
+    struct AsyncLoad
+    {
+        std::string                 filename;
+        glm::mat4                   transform{ 1 };
+        std::future<void>           recorded;          // Parsing and recording of the upload
+        bool                        submitted{ false };
+        app::CommandPool            commandPool;
+        vk::CommandBuffer           commandBuffer;
+        vk::Fence                   fence;             // Signaled when the upload is complete
+        app::StagingMemoryManagerVma staging;
+        ObjModel                    model;
+        std::vector<ImageUpload>    images;
+        std::vector<uint32_t>       textureSlots;      // Registry slot of each image, the atlas pages last
+        std::vector<std::string>    textures;          // Files and pages uploaded in the owned slots
+        std::vector<TextureAtlas::Page> pages;
+        app::MipmapGenerator::Batch mipmapBatch;
+        bool                        dummyTexture{ false }; // Only needed when the scene has no texture
+    };
+
+    std::vector<std::string> acquireTextures(ObjLoader& loader, ObjModel& model, std::vector<uint32_t>& slots,
+                                             std::vector<TextureAtlas::Page>& pages);
+
+    void uploadModel(const vk::CommandBuffer& cmdBuffer, app::StagingMemoryManager& staging,
+                     const std::string& filename, ObjLoader& loader, ObjModel& model);
+
+    std::vector<ImageUpload> uploadTextureImages(const vk::CommandBuffer& cmdBuffer, app::StagingMemoryManager& staging,
+                                                 const std::vector<std::string>& textures,
+                                                 const std::vector<TextureAtlas::Page>& pages, bool needDummy,
+                                                 app::MipmapGenerator::Batch& mipmapBatch);
+
+    // Texels of a level, in memory or mapped from the texture cache
+    struct LevelData
+    {
+        const void*    data;
+        vk::DeviceSize size;
+    };
+
+    static std::vector<LevelData> levelData(const std::vector<std::vector<uint8_t>>& levels, uint32_t firstLevel);
+
+    ImageUpload uploadImageLevels(app::ImageUploadBatch& batch, vk::Format format, vk::Extent2D size,
+                                  const std::vector<LevelData>& levels);
+
+    void createTextures(const std::vector<ImageUpload>& images, const std::vector<uint32_t>& slots);
+
+    void releaseMipmapBatches();
+
+    void setModelNames(const ObjModel& model, uint32_t objIndex);
+
+    std::vector<uint32_t> destroyAsyncLoad(AsyncLoad& load, bool destroyUploads);
+
+    void destroyModelBuffers(ObjModel& model);
+
+    void uploadOrphanTextures(const std::string& filename, const std::vector<std::string>& ownedTextures,
+                              const std::vector<TextureAtlas::Page>& ownedPages, const std::vector<uint32_t>& ownedSlots,
+                              const std::vector<uint32_t>& orphans);
+
+    void updateSceneResources(size_t firstModel, size_t firstInstance);
+
+    void updateModelDescriptors(size_t firstModel);
+
+    void updateTextureDescriptors(const std::vector<uint32_t>& slots);
+
+    void writeFrameDescriptors(uint32_t frame);
+
+    void writeAllSets(const std::vector<vk::WriteDescriptorSet>& writes);
+
+    // Models being loaded, added to the scene by 'updateAsyncLoads'
+    std::vector<std::unique_ptr<AsyncLoad>> m_asyncLoads;
+
+    // Format of the vertex buffers, set before loading the models
+    VertexLayout                 m_vertexLayout{ VertexLayout::eFloat32 };
+
+    // Block compressed textures, cached as KTX2 next to the images. Set before
+    // loading the models, ignored when the device has no BC support.
+    bool                         m_compressTextures{ true };
+
+    // Decoded mip chains of the textures not compressed, cached in media/cache so
+    // the next runs neither decode the images nor generate their mips. Set before
+    // loading the models.
+    bool                         m_cacheTextures{ true };
+
+    // Small textures packed in atlas pages, see 'TextureAtlas'. Set before loading
+    // the models.
+    bool                         m_atlasTextures{ true };
+    std::atomic<uint32_t>        m_atlasPages{ 0 }; // Pages created, naming them in the registry
+
+    // Textures uploaded with their small levels only, the finer ones are streamed
+    // in by the levels sampled. Set before loading the models.
+    bool                         m_streamTextures{ true };
+
+    // Device memory of the streamed textures, their small levels always fit
+    vk::DeviceSize               m_textureBudget{ vk::DeviceSize(256) * 1024 * 1024 };
+
+    // Staging memory of the uploads by manager, sampled once per frame by
+    // 'updateStagingTelemetry'. The async loads are counted once submitted,
+    // with the loads already destroyed.
+    struct StagingTelemetry
+    {
+        static const uint32_t FRAMES = 120;
+
+        app::StagingStats allocator;
+        app::StagingStats streamer;
+        app::StagingStats asyncLoads;
+        app::StagingStats retired;                // Async loads destroyed
+
+        vk::DeviceSize    frameBytes[FRAMES] = {}; // Bytes requested by frame, a ring from 'frame'
+        uint32_t          frame{ 0 };
+        uint64_t          frames{ 0 };
+        uint64_t          totalBytes{ 0 };
+        vk::DeviceSize    peakFrameBytes{ 0 };
+    };
+    StagingTelemetry             m_stagingTelemetry;
+
+    // Split the models in meshlets for culling, set before loading the models
+    bool                         m_buildMeshlets{ true };
+
+    // Largest projected error of the LOD drawn, in pixels
+    float                        m_lodPixelError{ 1.f };
+
+    // Camera of the frame, set by 'updateUniformBuffer'
+    CameraMatrices               m_cameraMatrices;
+
     // Array of objects and instances in the scene
     std::vector<ObjModel>        m_objModel;
     std::vector<ObjInstance>     m_objInstance;
@@ -126,15 +312,60 @@ public:
     app::DescriptorSetBindings   m_descSetLayoutBind;
     vk::DescriptorPool           m_descriptorPool;
     vk::DescriptorSetLayout      m_descriptorSetLayout;
-    vk::DescriptorSet            m_descriptorSet;
+    std::vector<vk::DescriptorSet> m_descriptorSets; // By frame in flight, see 'writeFrameDescriptors'
+
+    // Data written every frame, in the upload ring (set = 1)
+    app::DescriptorSetBindings   m_frameDescSetLayoutBind;
+    vk::DescriptorPool           m_frameDescriptorPool;
+    vk::DescriptorSetLayout      m_frameDescriptorSetLayout;
+    vk::DescriptorSet            m_frameDescriptorSet;
+    app::UploadRing              m_uploadRing;
+    uint32_t                     m_cameraOffset{ 0 }; // Camera matrices of the frame in the ring
+
+    // Capacity of the arrays of bindings 1, 3 and 4, written as the models and
+    // textures are added. Lowered to the device limits.
+    static const uint32_t        MAX_OBJECTS  = 1024;
+    static const uint32_t        MAX_TEXTURES = 4096;
+    uint32_t                     m_maxObjects{ 0 };
+    uint32_t                     m_maxTextures{ 0 };
+    std::vector<bool>            m_loadingSlots; // Texture slots showing the first texture until uploaded
+
+    // Texture slots to write in the set of each frame when it begins, and the
+    // textures they replace with the sets that still show them (bit per set)
+    struct RetiredTexture
+    {
+        app::TextureVma texture;
+        uint32_t        sets{ 0 };
+    };
+    std::vector<std::vector<uint32_t>> m_frameTextureSlots;
+    std::vector<RetiredTexture>        m_retiredTextures;
 
-    app::BufferVma               m_cameraMat;  // Device-Host of the camera matrices
-    app::BufferVma               m_sceneDesc;  // Device buffer of the OBJ instances
-    std::vector<app::TextureVma> m_textures;   // vector of all textures of the scene
+    // Device buffer of the OBJ instances, with room for more instances. The
+    // instances from 'm_sceneDescDirty' are written by the next frame, the
+    // sets of 'm_sceneDescSets' (bit per set) still show a replaced buffer.
+    struct RetiredBuffer
+    {
+        app::BufferVma buffer;
+        uint32_t       sets{ 0 };
+    };
+    static const size_t          MIN_SCENE_INSTANCES = 64;
+    app::BufferVma               m_sceneDesc;
+    size_t                       m_sceneDescCapacity{ 0 };
+    size_t                       m_sceneDescDirty{ 0 };
+    uint32_t                     m_sceneDescSets{ 0 };
+    std::vector<RetiredBuffer>   m_retiredBuffers;
+    std::vector<app::TextureVma> m_textures;   // textures of the scene by registry slot, empty until uploaded
+    TextureRegistry              m_textureRegistry;
+    tools::texture::TextureCache m_textureCache;
+    TextureStreamer              m_textureStreamer;
     
     app::Allocator               m_allocator;
+    app::MipmapGenerator         m_mipmapGenerator;
     app::debug::DebugUtil        m_debug;
 
+    // Descriptors and views of the mip generations, released once the uploads completed
+    std::vector<app::MipmapGenerator::Batch> m_mipmapBatches;
+
 ///////////////////////////////////////////////////////////////////////////
 // Post-processing                                                       //
 ///////////////////////////////////////////////////////////////////////////
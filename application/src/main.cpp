@@ -57,6 +57,85 @@ static void renderUI()
     ImGui::SliderFloat("Test Slider", &value, 0, 100);
 }
 
+//-------------------------------------------------------------------------
+// Staging memory of a manager, see 'app::StagingStats'
+//
+static void renderStagingStats(const char* name, const app::StagingStats& stats)
+{
+    if (!ImGui::TreeNode(name))
+        return;
+
+    ImGui::Text("Uploaded %.1f MB, %llu allocation(s) in %llu batch(es)", stats.bytes / 1048576.0,
+                static_cast<unsigned long long>(stats.allocations), static_cast<unsigned long long>(stats.batches));
+    ImGui::Text("Batch %.1f KB, peak %.1f KB", stats.lastBatchBytes / 1024.0, stats.peakBatchBytes / 1024.0);
+    ImGui::Text("Blocks %u, peak %u", stats.blockCount, stats.peakBlockCount);
+    ImGui::Text("Allocated %.1f MB, peak %.1f MB", stats.allocatedSize / 1048576.0, stats.peakAllocatedSize / 1048576.0);
+    ImGui::Text("Used %.1f MB, peak %.1f MB", stats.usedSize / 1048576.0, stats.peakUsedSize / 1048576.0);
+    ImGui::Text("Latency %.2f ms, average %.2f ms, max %.2f ms", stats.lastLatency, stats.averageLatency(),
+                stats.maxLatency);
+
+    // bins of powers of two from 512 B
+    auto histogram = [](void* data, int i) { return static_cast<float>(static_cast<app::StagingStats*>(data)->histogram[i]); };
+    ImGui::PlotHistogram("Sizes", histogram, const_cast<app::StagingStats*>(&stats), app::StagingStats::HISTOGRAM_BINS, 0,
+                         "512 B .. 128 MB", 0.f, FLT_MAX, ImVec2(0, 40));
+
+    if (!stats.blocks.empty()) {
+        ImGui::Columns(4, "blocks");
+        ImGui::Text("Block");
+        ImGui::NextColumn();
+        ImGui::Text("Used");
+        ImGui::NextColumn();
+        ImGui::Text("Largest free");
+        ImGui::NextColumn();
+        ImGui::Text("Fragmentation");
+        ImGui::NextColumn();
+        ImGui::Separator();
+        for (const auto& block : stats.blocks) {
+            ImGui::Text("%.1f MB", block.size / 1048576.0);
+            ImGui::NextColumn();
+            ImGui::Text("%.1f MB", block.used / 1048576.0);
+            ImGui::NextColumn();
+            ImGui::Text("%.1f MB", block.largestFree / 1048576.0);
+            ImGui::NextColumn();
+            ImGui::Text("%.2f", block.fragmentation);
+            ImGui::NextColumn();
+        }
+        ImGui::Columns(1);
+    }
+
+    ImGui::TreePop();
+}
+
+//-------------------------------------------------------------------------
+// Staging telemetry, the bytes of the last frames oldest first
+//
+static void renderStagingUI(const ExampleVulkan& vkExample)
+{
+    using Telemetry = ExampleVulkan::StagingTelemetry;
+
+    if (!ImGui::CollapsingHeader("Staging memory"))
+        return;
+
+    const Telemetry& telemetry = vkExample.m_stagingTelemetry;
+    ImGui::Text("Frame %.1f KB, peak %.1f KB",
+                telemetry.frameBytes[(telemetry.frame + Telemetry::FRAMES - 1) % Telemetry::FRAMES] / 1024.0,
+                telemetry.peakFrameBytes / 1024.0);
+
+    auto frameBytes = [](void* data, int i) {
+        const Telemetry& telemetry = *static_cast<Telemetry*>(data);
+        return static_cast<float>(telemetry.frameBytes[(telemetry.frame + i) % Telemetry::FRAMES] / 1024.0);
+    };
+    ImGui::PlotHistogram("KB / frame", frameBytes, const_cast<Telemetry*>(&telemetry), Telemetry::FRAMES, 0, nullptr,
+                         0.f, FLT_MAX, ImVec2(0, 60));
+
+    renderStagingStats("Allocator", telemetry.allocator);
+    renderStagingStats("Texture streamer", telemetry.streamer);
+    renderStagingStats("Async loads", telemetry.asyncLoads);
+
+    if (ImGui::Button("Dump JSON") && !vkExample.writeStagingTelemetry("staging_telemetry.json"))
+        std::cerr << "failed to write staging_telemetry.json" << std::endl;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // Application                                                           //
 ///////////////////////////////////////////////////////////////////////////
@@ -92,6 +171,7 @@ void application()
     contextInfo.addDeviceExtension(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
     contextInfo.addDeviceExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
     contextInfo.addDeviceExtension(VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME);
+    contextInfo.addDeviceExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
 
     // Vulkan
     ExampleVulkan vkExample;
@@ -100,11 +180,16 @@ void application()
     // Imgui 
     vkExample.initGUI(window);
 
-    vkExample.loadModel("../media/scenes/cube_multi.obj");
+    // the startup scene is parsed in parallel and uploaded with a single submission
+    vkExample.loadModels({ { "../media/scenes/cube_multi.obj", glm::mat4(1) },
+                           { "../media/scenes/plane.obj", glm::translate(glm::vec3(0.0f, -1.0f, 0.0f)) } });
+
+    // parsed and uploaded on the thread pool, added by 'updateAsyncLoads' while the frames are presented
+    vkExample.loadModelAsync("../media/scenes/Medieval_building.obj", glm::translate(glm::vec3(0.0f, -1.0f, -4.0f)));
+
     vkExample.createOffscreenRender();
     vkExample.createDescriptorSetLayout();
     vkExample.createGraphicsPipeline();
-    vkExample.createUniformBuffer();
     vkExample.createSceneDescriptionBuffer();
     vkExample.updateDescriptorSet();
 
@@ -128,8 +213,14 @@ void application()
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
-        // update camera buffer
-        vkExample.updateUniformBuffer();
+        // add the models loaded in the background
+        vkExample.updateAsyncLoads();
+
+        // swap the textures whose streamed levels changed
+        vkExample.updateTextureStreaming();
+
+        // bytes staged by the frame, the uploads above included
+        vkExample.updateStagingTelemetry();
 
         // Show UI window
         {
@@ -137,6 +228,13 @@ void application()
             
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                  1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+
+            if (!vkExample.m_asyncLoads.empty())
+                ImGui::Text("Loading %d model(s)", static_cast<int>(vkExample.m_asyncLoads.size()));
+            if (vkExample.m_streamTextures)
+                ImGui::Text("Streamed textures %.1f / %.1f MB", vkExample.m_textureStreamer.residentBytes() / 1048576.0,
+                            vkExample.m_textureBudget / 1048576.0);
+            renderStagingUI(vkExample);
             
             renderUI();
             
@@ -146,6 +244,9 @@ void application()
         // Start rendering the scene
         vkExample.prepareFrame();
 
+        // update camera buffer, in the space of the frame
+        vkExample.updateUniformBuffer();
+
         // Start command buffer of this frame
         auto                     currentFrame = vkExample.getCurrentFrame();
         const vk::CommandBuffer& cmdBuffer    = vkExample.getCommandBuffers()[currentFrame];
@@ -166,10 +267,14 @@ void application()
         offscreenRenderPassBeginInfo.framebuffer     = vkExample.m_offscreenFramebuffer;
         offscreenRenderPassBeginInfo.renderArea      = vk::Rect2D({}, vkExample.getSize());
 
-        // Rendering the scene
+        // Rendering the scene, with the instances added since the previous frame
+        // and the texture levels sampled read back
+        vkExample.cmdUpdateSceneDescription(cmdBuffer);
+        vkExample.m_textureStreamer.cmdBeginFrame(cmdBuffer, currentFrame);
         cmdBuffer.beginRenderPass(offscreenRenderPassBeginInfo, vk::SubpassContents::eInline);
         vkExample.rasterize(cmdBuffer);
         cmdBuffer.endRenderPass();
+        vkExample.m_textureStreamer.cmdEndFrame(cmdBuffer, currentFrame);
 
         // 2nd Render Pass : tone mapper, UI
         vk::RenderPassBeginInfo postRenderPassBeginInfo = {};
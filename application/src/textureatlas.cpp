@@ -0,0 +1,150 @@
+/*
+ *
+ * Andrew Frost
+ * textureatlas.cpp
+ * 2020
+ *
+ */
+
+#include "textureatlas.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+#include "stb_image.h"
+#include "../general_helpers/blockcompression.hpp"
+
+// The implementation in imgui_draw.cpp is static
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "../external/imgui/imstb_rectpack.h"
+
+///////////////////////////////////////////////////////////////////////////
+// TextureAtlas                                                          //
+///////////////////////////////////////////////////////////////////////////
+
+static const uint32_t ALIGNMENT = 1 << (TextureAtlas::PAGE_LEVELS - 1);
+
+static inline uint32_t alignSize(uint32_t size)
+{
+    return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+bool TextureAtlas::isTile(const std::string& file, uint32_t& width, uint32_t& height)
+{
+    int w, h, channels;
+    if (!stbi_info(file.c_str(), &w, &h, &channels))
+        return false;
+
+    width  = static_cast<uint32_t>(w);
+    height = static_cast<uint32_t>(h);
+    return width <= MAX_TILE_SIZE && height <= MAX_TILE_SIZE;
+}
+
+//-------------------------------------------------------------------------
+// The rectangles of the tiles with their padding have sizes multiple of
+// the alignment, and the packer places them on multiples of it
+//
+std::vector<TextureAtlas::Page> TextureAtlas::pack(const std::vector<Tile>& tiles)
+{
+    std::vector<Page> pages;
+
+    std::vector<stbrp_rect> rects(tiles.size());
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        rects[i]    = {};
+        rects[i].id = static_cast<int>(i);
+        rects[i].w  = static_cast<stbrp_coord>(alignSize(tiles[i].width + 2 * PADDING));
+        rects[i].h  = static_cast<stbrp_coord>(alignSize(tiles[i].height + 2 * PADDING));
+    }
+
+    std::vector<stbrp_node> nodes(PAGE_SIZE / ALIGNMENT);
+    while (!rects.empty()) {
+        stbrp_context context;
+        stbrp_init_target(&context, PAGE_SIZE, PAGE_SIZE, nodes.data(), static_cast<int>(nodes.size()));
+        stbrp_pack_rects(&context, rects.data(), static_cast<int>(rects.size()));
+
+        Page page;
+        std::vector<stbrp_rect> remaining;
+        for (const auto& rect : rects) {
+            if (!rect.was_packed) {
+                remaining.push_back(rect);
+                continue;
+            }
+
+            Tile tile = tiles[rect.id];
+            tile.x    = rect.x + PADDING;
+            tile.y    = rect.y + PADDING;
+            page.tiles.push_back(tile);
+            page.width  = std::max(page.width, static_cast<uint32_t>(rect.x + rect.w));
+            page.height = std::max(page.height, static_cast<uint32_t>(rect.y + rect.h));
+        }
+
+        // a tile always fits in an empty page
+        assert(!page.tiles.empty());
+        pages.push_back(page);
+        rects.swap(remaining);
+    }
+
+    return pages;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+TextureRegistry::Placement TextureAtlas::placement(const Page& page, const Tile& tile)
+{
+    TextureRegistry::Placement placement;
+    placement.scale  = glm::vec2(float(tile.width) / page.width, float(tile.height) / page.height);
+    placement.offset = glm::vec2(float(tile.x) / page.width, float(tile.y) / page.height);
+    return placement;
+}
+
+//-------------------------------------------------------------------------
+// The padding and the rounding of each rectangle repeat its tile, the
+// texels between the rectangles stay black
+//
+std::vector<std::vector<uint8_t>> TextureAtlas::buildPage(const Page& page, const std::vector<const uint8_t*>& tiles,
+                                                          bool srgb)
+{
+    static const uint8_t errorColor[4] = { 255, 0, 255, 255 };
+
+    std::vector<std::vector<uint8_t>> levels(1);
+    levels[0].assign(static_cast<size_t>(page.width) * page.height * 4, 0);
+
+    uint8_t* pixels = levels[0].data();
+    for (size_t i = 0; i < page.tiles.size(); ++i) {
+        const Tile&    tile = page.tiles[i];
+        const uint8_t* rgba = tiles[i];
+
+        const uint32_t x0 = tile.x - PADDING;
+        const uint32_t y0 = tile.y - PADDING;
+        const uint32_t x1 = x0 + alignSize(tile.width + 2 * PADDING);
+        const uint32_t y1 = y0 + alignSize(tile.height + 2 * PADDING);
+
+        for (uint32_t y = y0; y < y1; ++y) {
+            const uint32_t ty = (y + tile.height - PADDING % tile.height - y0) % tile.height;
+            for (uint32_t x = x0; x < x1; ++x) {
+                const uint32_t tx  = (x + tile.width - PADDING % tile.width - x0) % tile.width;
+                const uint8_t* src = rgba ? rgba + (static_cast<size_t>(ty) * tile.width + tx) * 4 : errorColor;
+                memcpy(pixels + (static_cast<size_t>(y) * page.width + x) * 4, src, 4);
+            }
+        }
+    }
+
+    uint32_t width  = page.width;
+    uint32_t height = page.height;
+    for (uint32_t level = 1; level < PAGE_LEVELS; ++level) {
+        uint32_t nextWidth, nextHeight;
+        std::vector<uint8_t> next = tools::texture::downsample(levels.back().data(), width, height, srgb,
+                                                               nextWidth, nextHeight);
+        levels.push_back(std::move(next));
+        width  = nextWidth;
+        height = nextHeight;
+    }
+
+    return levels;
+}
@@ -0,0 +1,75 @@
+/*
+ *
+ * Andrew Frost
+ * textureatlas.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "textureregistry.hpp"
+
+///////////////////////////////////////////////////////////////////////////
+// Texture Atlas                                                         //
+///////////////////////////////////////////////////////////////////////////
+// Small textures packed in shared pages, with imstb_rectpack            //
+// - Textures of MAX_TILE_SIZE and below are tiles, the materials sample //
+//   them through the UV scale and offset of their placement            //
+// - Each tile is surrounded by PADDING texels repeating it, so the      //
+//   bilinear filtering wraps like on a separate image                  //
+// - Tiles are placed on 4 texel boundaries, the PAGE_LEVELS levels of   //
+//   a page keep the tiles apart                                         //
+// - A page is one registry slot, one image and one descriptor for all   //
+//   its tiles                                                           //
+///////////////////////////////////////////////////////////////////////////
+
+class TextureAtlas
+{
+public:
+    static const uint32_t MAX_TILE_SIZE = 64;
+    static const uint32_t PAGE_SIZE     = 1024;
+    static const uint32_t PADDING       = 4;
+    static const uint32_t PAGE_LEVELS   = 3;
+
+    struct Tile
+    {
+        std::string file;
+        uint32_t    width{ 0 };
+        uint32_t    height{ 0 };
+        uint32_t    x{ 0 };       // In the page, padding excluded
+        uint32_t    y{ 0 };
+    };
+
+    struct Page
+    {
+        uint32_t          slot{ 0 };   // Registry slot, once registered
+        uint32_t          width{ 0 };  // Area used by the tiles, rounded to 4 texels
+        uint32_t          height{ 0 };
+        std::vector<Tile> tiles;
+    };
+
+    //-------------------------------------------------------------------------
+    // Size of the image read from its header, false when it cannot be read
+    // or is larger than MAX_TILE_SIZE
+    //
+    static bool isTile(const std::string& file, uint32_t& width, uint32_t& height);
+
+    //-------------------------------------------------------------------------
+    // Places the tiles in as many pages as needed
+    //
+    static std::vector<Page> pack(const std::vector<Tile>& tiles);
+
+    static TextureRegistry::Placement placement(const Page& page, const Tile& tile);
+
+    //-------------------------------------------------------------------------
+    // RGBA8 levels of the page from the decoded tiles, in the page order.
+    // A missing tile is filled with the error color.
+    //
+    static std::vector<std::vector<uint8_t>> buildPage(const Page& page, const std::vector<const uint8_t*>& tiles,
+                                                       bool srgb);
+
+}; // class TextureAtlas
@@ -0,0 +1,231 @@
+/*
+ *
+ * Andrew Frost
+ * textureregistry.cpp
+ * 2020
+ *
+ */
+
+#include "textureregistry.hpp"
+
+#include <filesystem>
+
+#include "../general_helpers/texturecache.hpp"
+
+const char* const TextureRegistry::DUMMY = "";
+
+///////////////////////////////////////////////////////////////////////////
+// TextureRegistry                                                       //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// Paths are compared in their canonical form, the dummy key is kept as is
+//
+std::string TextureRegistry::canonicalPath(const std::string& filename)
+{
+    if (filename == DUMMY)
+        return filename;
+
+    std::error_code ec;
+    const auto canonical = std::filesystem::weakly_canonical(filename, ec);
+    return ec ? filename : canonical.generic_string();
+}
+
+//-------------------------------------------------------------------------
+// Adds a reference to the slot of the path, or of the same content under
+// another name which becomes an alias of the slot. Under the lock.
+//
+bool TextureRegistry::find(const std::string& path, uint64_t hash, uint64_t fileSize, Slot& slot)
+{
+    Alias alias;
+    auto  pathIt = m_paths.find(path);
+    if (pathIt != m_paths.end()) {
+        alias = pathIt->second;
+    }
+    else {
+        auto hashIt = hash != 0 ? m_hashes.find(hash) : m_hashes.end();
+        if (hashIt == m_hashes.end() || hashIt->second.fileSize != fileSize)
+            return false;
+        alias         = hashIt->second;
+        m_paths[path] = alias;
+    }
+
+    m_entries[alias.index].refCount++;
+    slot = { alias.index, false, alias.placement };
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// Free slot, without reference. Under the lock.
+//
+uint32_t TextureRegistry::reserve(const std::string& path)
+{
+    uint32_t index;
+    if (!m_freeSlots.empty()) {
+        index = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else {
+        index = static_cast<uint32_t>(m_entries.size());
+        m_entries.emplace_back();
+    }
+
+    m_entries[index]      = Entry();
+    m_entries[index].path = path;
+    return index;
+}
+
+//-------------------------------------------------------------------------
+// The content is only hashed when the path is not registered, outside of
+// the lock
+//
+TextureRegistry::Slot TextureRegistry::acquire(const std::string& filename)
+{
+    const std::string path = canonicalPath(filename);
+
+    Slot slot;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (find(path, 0, 0, slot))
+            return slot;
+    }
+
+    uint64_t fileSize = 0;
+    uint64_t hash     = path != DUMMY ? tools::texture::hashFile(path, fileSize) : 0;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // registered by another thread while hashing, or same content
+    if (find(path, hash, fileSize, slot))
+        return slot;
+
+    const uint32_t index = reserve(path);
+    m_entries[index].refCount = 1;
+
+    const Alias alias = { index, fileSize, Placement() };
+    m_paths[path] = alias;
+    if (hash != 0)
+        m_hashes[hash] = alias;
+
+    return { index, true, Placement() };
+}
+
+//-------------------------------------------------------------------------
+// The page holds one reference per tile, it is only reserved when a tile
+// is placed in it
+//
+std::vector<TextureRegistry::Slot> TextureRegistry::acquireTiles(const std::vector<std::string>& filenames,
+                                                                 const std::vector<Placement>&   placements,
+                                                                 const std::string&              pageKey)
+{
+    const size_t nbTiles = filenames.size();
+
+    std::vector<std::string> paths(nbTiles);
+    std::vector<uint64_t>    hashes(nbTiles);
+    std::vector<uint64_t>    fileSizes(nbTiles);
+    for (size_t i = 0; i < nbTiles; ++i) {
+        paths[i]  = canonicalPath(filenames[i]);
+        hashes[i] = tools::texture::hashFile(paths[i], fileSizes[i]);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<Slot> slots(nbTiles);
+    uint32_t          page = ~0u;
+
+    for (size_t i = 0; i < nbTiles; ++i) {
+        if (find(paths[i], hashes[i], fileSizes[i], slots[i]))
+            continue;
+
+        if (page == ~0u)
+            page = reserve(pageKey);
+        m_entries[page].refCount++;
+
+        const Alias alias = { page, fileSizes[i], placements[i] };
+        m_paths[paths[i]] = alias;
+        if (hashes[i] != 0)
+            m_hashes[hashes[i]] = alias;
+
+        slots[i] = { page, true, placements[i] };
+    }
+
+    return slots;
+}
+
+//-------------------------------------------------------------------------
+// The paths, their aliases and the hashes no longer find the slot once
+// free. Under the lock.
+//
+bool TextureRegistry::releaseSlot(uint32_t slot)
+{
+    Entry& entry = m_entries[slot];
+    if (entry.refCount == 0 || --entry.refCount > 0)
+        return false;
+
+    for (auto it = m_paths.begin(); it != m_paths.end();) {
+        if (it->second.index == slot)
+            it = m_paths.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = m_hashes.begin(); it != m_hashes.end();) {
+        if (it->second.index == slot)
+            it = m_hashes.erase(it);
+        else
+            ++it;
+    }
+
+    entry = Entry();
+    m_freeSlots.push_back(slot);
+    return true;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+bool TextureRegistry::release(uint32_t slot)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return releaseSlot(slot);
+}
+
+//-------------------------------------------------------------------------
+// Under a single lock, a slot freed here cannot be reserved by another
+// load before the owned ones are checked
+//
+std::vector<uint32_t> TextureRegistry::abandon(const std::vector<uint32_t>& references,
+                                               const std::vector<uint32_t>& owned)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (uint32_t slot : references)
+        releaseSlot(slot);
+
+    std::vector<uint32_t> orphans;
+    for (uint32_t slot : owned) {
+        if (slot < m_entries.size() && m_entries[slot].refCount > 0)
+            orphans.push_back(slot);
+    }
+    return orphans;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void TextureRegistry::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_freeSlots.clear();
+    m_paths.clear();
+    m_hashes.clear();
+}
+
+//-------------------------------------------------------------------------
+// Number of slots, free ones included
+//
+uint32_t TextureRegistry::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<uint32_t>(m_entries.size());
+}
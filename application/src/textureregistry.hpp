@@ -0,0 +1,111 @@
+/*
+ *
+ * Andrew Frost
+ * textureregistry.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+///////////////////////////////////////////////////////////////////////////
+// Texture Registry                                                      //
+///////////////////////////////////////////////////////////////////////////
+// Slots of the scene textures, shared between the models                //
+// - A texture is found by its canonical path, then by the hash of its   //
+//   content, so copies under another name are also shared               //
+// - The first model acquiring a texture owns its upload, the others     //
+//   only reference the slot                                             //
+// - When the owner fails, the slots still referenced by other models    //
+//   are handed back to the caller for their upload                      //
+// - Slots are reference counted, a released slot is reused              //
+// - Small textures share the slot of an atlas page, their placement     //
+//   gives their rectangle in it                                         //
+// - Thread safe, the models loaded in the background acquire their      //
+//   textures on the thread pool                                         //
+///////////////////////////////////////////////////////////////////////////
+
+class TextureRegistry
+{
+public:
+    // Key of the texture created when the scene has none
+    static const char* const DUMMY;
+
+    // Rectangle of a texture in the image of its slot, in UV space
+    struct Placement
+    {
+        glm::vec2 scale{ 1.f };
+        glm::vec2 offset{ 0.f };
+    };
+
+    struct Slot
+    {
+        uint32_t  index{ 0 };
+        bool      owner{ false }; // Texture to upload in the slot by the caller
+        Placement placement;
+    };
+
+    //-------------------------------------------------------------------------
+    // Adds a reference to the slot of the file, reserved when not found
+    //
+    Slot acquire(const std::string& filename);
+
+    //-------------------------------------------------------------------------
+    // Adds a reference to the slots of textures packed in a new atlas page.
+    // The ones not registered yet are placed in the page, reserved under
+    // 'pageKey' and returned as owned; the others keep their slot.
+    //
+    std::vector<Slot> acquireTiles(const std::vector<std::string>& filenames, const std::vector<Placement>& placements,
+                                   const std::string& pageKey);
+
+    //-------------------------------------------------------------------------
+    // True when it was the last reference, the slot is free
+    //
+    bool release(uint32_t slot);
+
+    //-------------------------------------------------------------------------
+    // Releases the references of a model whose upload failed. Returns the
+    // slots it owned that other models still reference, the caller uploads
+    // them in its place.
+    //
+    std::vector<uint32_t> abandon(const std::vector<uint32_t>& references, const std::vector<uint32_t>& owned);
+
+    void clear();
+
+    uint32_t size() const;
+
+private:
+    struct Entry
+    {
+        std::string path;          // Canonical path, empty when free
+        uint32_t    refCount{ 0 };
+    };
+
+    // Texture found by its path or content
+    struct Alias
+    {
+        uint32_t  index{ 0 };
+        uint64_t  fileSize{ 0 };   // Guarding against hash collisions
+        Placement placement;
+    };
+
+    static std::string canonicalPath(const std::string& filename);
+
+    bool     find(const std::string& path, uint64_t hash, uint64_t fileSize, Slot& slot);
+    uint32_t reserve(const std::string& path);
+    bool     releaseSlot(uint32_t slot);
+
+    mutable std::mutex                     m_mutex;
+    std::vector<Entry>                     m_entries;
+    std::vector<uint32_t>                  m_freeSlots;
+    std::unordered_map<std::string, Alias> m_paths;  // Canonical paths and their copies
+    std::unordered_map<uint64_t, Alias>    m_hashes;
+
+}; // class TextureRegistry
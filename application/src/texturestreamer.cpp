@@ -0,0 +1,625 @@
+/*
+ *
+ * Andrew Frost
+ * texturestreamer.cpp
+ * 2020
+ *
+ */
+
+#include "texturestreamer.hpp"
+
+#include <algorithm>
+
+#include "stb_image.h"
+#include "../vk_helpers/images.hpp"
+#include "../general_helpers/blockcompression.hpp"
+#include "../general_helpers/ktx2.hpp"
+#include "../general_helpers/threadpool.hpp"
+
+///////////////////////////////////////////////////////////////////////////
+// TextureStreamer                                                       //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// Own command pool and staging, the uploads are submitted on the queue of
+// the upload engine
+//
+void TextureStreamer::init(vk::Device device, vk::PhysicalDevice physicalDevice, app::Allocator& allocator,
+                           app::UploadEngine& uploads, uint32_t nbFrames, tools::texture::TextureCache* cache)
+{
+    m_device    = device;
+    m_allocator = &allocator;
+    m_uploads   = &uploads;
+    m_cache     = cache;
+    m_commandPool.init(device, uploads.getQueueFamily(), vk::CommandPoolCreateFlagBits::eTransient, uploads.getQueue());
+    m_staging.init(device, physicalDevice, allocator.getAllocator());
+
+    m_feedbackAlignment = physicalDevice.getProperties().limits.minStorageBufferOffsetAlignment;
+    m_frameNumbers.assign(std::max(nbFrames, 1u), 0);
+}
+
+//-------------------------------------------------------------------------
+// Waits for the residency changes in progress
+//
+void TextureStreamer::deinit()
+{
+    if (!m_device)
+        return;
+
+    for (auto& job : m_jobs)
+        destroyJob(*job, true);
+    m_jobs.clear();
+
+    if (m_feedback.buffer) {
+        m_allocator->unmap(m_feedback);
+        m_allocator->destroy(m_feedback);
+    }
+    m_feedbackData  = nullptr;
+    m_feedbackSlots = 0;
+
+    m_textures.clear();
+    m_residentBytes = 0;
+    m_staging.deinit();
+    m_commandPool.deinit();
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+// Levels of TAIL_SIZE and below
+//
+uint32_t TextureStreamer::tailLevel(uint32_t width, uint32_t height, uint32_t levels)
+{
+    uint32_t level = 0;
+    while (level + 1 < levels && (std::max(1u, width >> level) > TAIL_SIZE || std::max(1u, height >> level) > TAIL_SIZE))
+        level++;
+    return level;
+}
+
+//-------------------------------------------------------------------------
+// RGBA8, or 4x4 blocks of 8 bytes for BC1 and 16 bytes for the others
+//
+vk::DeviceSize TextureStreamer::levelBytes(const Source& source, uint32_t level)
+{
+    const vk::DeviceSize width  = std::max(1u, source.width >> level);
+    const vk::DeviceSize height = std::max(1u, source.height >> level);
+
+    if (!source.compressed)
+        return width * height * 4;
+
+    const bool bc1 = source.format == vk::Format::eBc1RgbUnormBlock || source.format == vk::Format::eBc1RgbSrgbBlock
+                  || source.format == vk::Format::eBc1RgbaUnormBlock || source.format == vk::Format::eBc1RgbaSrgbBlock;
+    return ((width + 3) / 4) * ((height + 3) / 4) * (bc1 ? 8 : 16);
+}
+
+//-------------------------------------------------------------------------
+// Each level is filtered from the previous one
+//
+std::vector<std::vector<uint8_t>> TextureStreamer::buildLevels(const uint8_t* rgba, const Source& source,
+                                                               uint32_t firstLevel, uint32_t lastLevel)
+{
+    std::vector<std::vector<uint8_t>> levels;
+
+    const bool           srgb   = source.format == vk::Format::eR8G8B8A8Srgb;
+    const uint8_t*       data   = rgba;
+    uint32_t             width  = source.width;
+    uint32_t             height = source.height;
+    std::vector<uint8_t> level;
+
+    for (uint32_t i = 0; i < lastLevel; ++i) {
+        if (i > 0) {
+            uint32_t nextWidth, nextHeight;
+            level  = tools::texture::downsample(data, width, height, srgb, nextWidth, nextHeight);
+            data   = level.data();
+            width  = nextWidth;
+            height = nextHeight;
+        }
+        if (i >= firstLevel)
+            levels.emplace_back(data, data + static_cast<size_t>(width) * height * 4);
+    }
+
+    return levels;
+}
+
+//-------------------------------------------------------------------------
+// From the texture cache, or the KTX2 file when compressed, or the image
+// decoded again otherwise. Nothing is returned if the file changed since
+// the texture was loaded.
+//
+std::vector<std::vector<uint8_t>> TextureStreamer::loadLevels(const Source& source, uint32_t firstLevel, uint32_t lastLevel,
+                                                              tools::texture::TextureCache* cache)
+{
+    tools::texture::CachedTexture cached;
+    const bool inCache = cache && (source.compressed ? cache->readCompressed(source.file, cached)
+                                                     : cache->read(source.file, source.format == vk::Format::eR8G8B8A8Srgb, cached));
+    if (inCache) {
+        const vk::Format cachedFormat = cached.compressed()
+            ? static_cast<vk::Format>(tools::texture::vkFormatOf(cached.blockFormat(), cached.srgb())) : source.format;
+        if (cachedFormat != source.format || cached.width() != source.width || cached.height() != source.height
+            || cached.levelCount() < lastLevel)
+            return {};
+
+        std::vector<std::vector<uint8_t>> levels;
+        for (uint32_t level = firstLevel; level < lastLevel; ++level)
+            levels.emplace_back(cached.level(level), cached.level(level) + cached.levelSize(level));
+        return levels;
+    }
+
+    if (source.compressed) {
+        tools::texture::CompressedTexture texture;
+        if (!tools::texture::readKtx2(source.file + ".ktx2", source.file, texture) || texture.width != source.width
+            || texture.height != source.height || texture.levels.size() < lastLevel)
+            return {};
+
+        return std::vector<std::vector<uint8_t>>(std::make_move_iterator(texture.levels.begin() + firstLevel),
+                                                 std::make_move_iterator(texture.levels.begin() + lastLevel));
+    }
+
+    int      width, height, channels;
+    stbi_uc* pixels = stbi_load(source.file.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels)
+        return {};
+
+    std::vector<std::vector<uint8_t>> levels;
+    if (static_cast<uint32_t>(width) == source.width && static_cast<uint32_t>(height) == source.height)
+        levels = buildLevels(pixels, source, firstLevel, lastLevel);
+
+    stbi_image_free(pixels);
+    return levels;
+}
+
+//-------------------------------------------------------------------------
+// Textures without levels above the tail are not streamed
+//
+void TextureStreamer::add(uint32_t slot, const Source& source, uint32_t residentLevel, vk::Image image)
+{
+    if (slot >= m_textures.size())
+        m_textures.resize(slot + 1);
+
+    Texture& texture = m_textures[slot];
+    if (texture.streamed)
+        m_residentBytes -= residentBytes(texture, texture.residentLevel);
+
+    texture                = Texture();
+    texture.source         = source;
+    texture.streamed       = residentLevel > 0;
+    texture.tailLevel      = tailLevel(source.width, source.height, source.levels);
+    texture.residentLevel  = residentLevel;
+    texture.requestedLevel = residentLevel;
+    texture.lastSeen       = m_frameNumber;
+    texture.changed        = m_frameNumber;
+    texture.image          = image;
+
+    if (texture.streamed)
+        m_residentBytes += residentBytes(texture, residentLevel);
+}
+
+//-------------------------------------------------------------------------
+// Bytes of the levels from 'level'
+//
+vk::DeviceSize TextureStreamer::residentBytes(const Texture& texture, uint32_t level) const
+{
+    vk::DeviceSize bytes = 0;
+    for (uint32_t i = level; i < texture.source.levels; ++i)
+        bytes += levelBytes(texture.source, i);
+    return bytes;
+}
+
+//-------------------------------------------------------------------------
+// Read back memory, one region per frame aligned for the dynamic offset
+//
+void TextureStreamer::prepareFeedback(uint32_t nbSlots)
+{
+    if (m_feedback.buffer && nbSlots <= m_feedbackSlots)
+        return;
+
+    if (m_feedback.buffer) {
+        m_allocator->unmap(m_feedback);
+        m_allocator->destroy(m_feedback);
+    }
+
+    // room for a few more textures before the next resize
+    m_feedbackSlots  = std::max(64u, nbSlots + nbSlots / 2);
+    m_feedbackStride = (m_feedbackSlots * sizeof(uint32_t) + m_feedbackAlignment - 1) / m_feedbackAlignment * m_feedbackAlignment;
+
+    m_feedback     = m_allocator->createBuffer(m_feedbackStride * m_frameNumbers.size(),
+                                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                               VMA_MEMORY_USAGE_GPU_TO_CPU);
+    m_feedbackData = static_cast<const uint32_t*>(m_allocator->map(m_feedback));
+
+    std::fill(m_frameNumbers.begin(), m_frameNumbers.end(), 0);
+}
+
+//-------------------------------------------------------------------------
+// The shader adds the offset of the frame, pushed with the draws
+//
+vk::DescriptorBufferInfo TextureStreamer::feedbackDescriptor() const
+{
+    return vk::DescriptorBufferInfo(m_feedback.buffer, 0, VK_WHOLE_SIZE);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint32_t TextureStreamer::feedbackOffset(uint32_t frame) const
+{
+    return static_cast<uint32_t>((frame % m_frameNumbers.size()) * m_feedbackStride);
+}
+
+//-------------------------------------------------------------------------
+// All levels are cleared to ~0, no texture sampled
+//
+void TextureStreamer::cmdBeginFrame(vk::CommandBuffer cmdBuffer, uint32_t frame)
+{
+    // the images of the changes are complete before the frame samples them
+    for (auto& job : m_jobs) {
+        if (job->recorded && !job->acquired && (!job->uploadValue || m_uploads->isComplete(job->uploadValue)))
+            cmdAcquireJob(cmdBuffer, *job);
+    }
+
+    if (!m_feedback.buffer)
+        return;
+
+    frame %= m_frameNumbers.size();
+    readFeedback(frame);
+    m_frameNumbers[frame] = ++m_frameNumber;
+
+    const vk::DeviceSize size = m_feedbackSlots * sizeof(uint32_t);
+    cmdBuffer.fillBuffer(m_feedback.buffer, feedbackOffset(frame), size, ~0u);
+
+    vk::BufferMemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_feedback.buffer, feedbackOffset(frame), size);
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+        vk::DependencyFlags(), nullptr, barrier, nullptr);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void TextureStreamer::cmdEndFrame(vk::CommandBuffer cmdBuffer, uint32_t frame)
+{
+    if (!m_feedback.buffer)
+        return;
+
+    vk::BufferMemoryBarrier barrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead,
+        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_feedback.buffer, feedbackOffset(frame),
+        m_feedbackSlots * sizeof(uint32_t));
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eHost,
+        vk::DependencyFlags(), nullptr, barrier, nullptr);
+}
+
+//-------------------------------------------------------------------------
+// Levels sampled in the frame, relative to the image bound when it was
+// recorded. Ignored for the textures changed since.
+//
+void TextureStreamer::readFeedback(uint32_t frame)
+{
+    const uint64_t frameNumber = m_frameNumbers[frame];
+    if (frameNumber == 0)
+        return;
+
+    const vk::DeviceSize offset = feedbackOffset(frame);
+    vmaInvalidateAllocation(m_allocator->getAllocator(), m_feedback.allocation, offset, m_feedbackSlots * sizeof(uint32_t));
+
+    const uint32_t* levels  = m_feedbackData + offset / sizeof(uint32_t);
+    const uint32_t  nbSlots = std::min(static_cast<uint32_t>(m_textures.size()), m_feedbackSlots);
+
+    for (uint32_t slot = 0; slot < nbSlots; ++slot) {
+        Texture& texture = m_textures[slot];
+        if (!texture.streamed || levels[slot] == ~0u || frameNumber <= texture.changed)
+            continue;
+
+        const int level = static_cast<int>(texture.residentLevel + levels[slot]) - static_cast<int>(FEEDBACK_LOD_OFFSET);
+        texture.requestedLevel = std::min(static_cast<uint32_t>(std::max(level, 0)), texture.tailLevel);
+        texture.lastSeen       = frameNumber;
+    }
+}
+
+//-------------------------------------------------------------------------
+// The most recently seen textures get their finest level requested first,
+// the others are kept coarser until all fit in the budget
+//
+std::vector<TextureStreamer::Update> TextureStreamer::update(vk::DeviceSize budget)
+{
+    std::vector<Update> updates;
+    m_staging.releaseResources();
+
+    // Loaded levels are recorded, completed changes are returned
+    for (size_t i = 0; i < m_jobs.size();) {
+        Job&     job     = *m_jobs[i];
+        Texture& texture = m_textures[job.slot];
+
+        if (!job.recorded) {
+            if (job.loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                i++;
+                continue;
+            }
+
+            std::vector<std::vector<uint8_t>> levels;
+            try {
+                levels = job.loading.get();
+            }
+            catch (const std::exception&) {
+            }
+
+            if (levels.empty()) {
+                texture.failed = true;
+                destroyJob(job, true);
+                m_jobs.erase(m_jobs.begin() + i);
+                continue;
+            }
+            recordJob(job, levels);
+            i++;
+            continue;
+        }
+
+        // the frame recording the change is in flight, the caller waits for it
+        if (!job.acquired) {
+            i++;
+            continue;
+        }
+
+        m_residentBytes += residentBytes(texture, job.level);
+        m_residentBytes -= residentBytes(texture, texture.residentLevel);
+        texture.residentLevel = job.level;
+        texture.changed       = m_frameNumber;
+        texture.image         = job.image.image;
+
+        updates.push_back({ job.slot, job.image, job.info });
+        destroyJob(job, false);
+        m_jobs.erase(m_jobs.begin() + i);
+    }
+
+    // Priority order of the streamed textures
+    std::vector<uint32_t> order;
+    vk::DeviceSize        planned = 0;
+    for (uint32_t slot = 0; slot < m_textures.size(); ++slot) {
+        const Texture& texture = m_textures[slot];
+        if (texture.streamed) {
+            order.push_back(slot);
+            planned += residentBytes(texture, texture.tailLevel);
+        }
+    }
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        const Texture& ta = m_textures[a];
+        const Texture& tb = m_textures[b];
+        return ta.lastSeen != tb.lastSeen ? ta.lastSeen > tb.lastSeen : ta.requestedLevel < tb.requestedLevel;
+    });
+
+    // Levels of each texture in the budget, the tails always fit
+    std::vector<uint32_t> target(m_textures.size(), 0);
+    for (uint32_t slot : order) {
+        const Texture& texture = m_textures[slot];
+        const bool     unused  = m_frameNumber - texture.lastSeen > EVICT_FRAMES;
+        const auto     tail    = residentBytes(texture, texture.tailLevel);
+
+        // failed textures keep their levels, no finer ones can be loaded
+        uint32_t level = unused ? texture.tailLevel : texture.requestedLevel;
+        if (texture.failed)
+            level = std::max(level, texture.residentLevel);
+
+        while (level < texture.tailLevel && planned + residentBytes(texture, level) - tail > budget)
+            level++;
+
+        planned += residentBytes(texture, level) - tail;
+        target[slot] = level;
+    }
+
+    // Evictions first, the least important textures first
+    const bool overBudget = m_residentBytes > budget;
+    for (auto it = order.rbegin(); it != order.rend() && m_jobs.size() < MAX_JOBS; ++it) {
+        const Texture& texture = m_textures[*it];
+        const bool     unused  = m_frameNumber - texture.lastSeen > EVICT_FRAMES;
+        if (!texture.busy && target[*it] > texture.residentLevel && (overBudget || unused))
+            startJob(*it, target[*it]);
+    }
+
+    // Then the finer levels, once they fit
+    for (uint32_t slot : order) {
+        if (m_jobs.size() >= MAX_JOBS)
+            break;
+
+        const Texture& texture = m_textures[slot];
+        if (texture.busy || texture.failed || target[slot] >= texture.residentLevel)
+            continue;
+
+        const vk::DeviceSize bytes = residentBytes(texture, target[slot]) - residentBytes(texture, texture.residentLevel);
+        if (m_residentBytes + bytes <= budget)
+            startJob(slot, target[slot]);
+    }
+
+    return updates;
+}
+
+//-------------------------------------------------------------------------
+// Finer levels are loaded on the thread pool, evictions are recorded at once
+//
+void TextureStreamer::startJob(uint32_t slot, uint32_t level)
+{
+    Texture& texture = m_textures[slot];
+
+    auto job   = std::make_unique<Job>();
+    job->slot  = slot;
+    job->level = level;
+
+    if (level < texture.residentLevel) {
+        const Source   source    = texture.source;
+        const uint32_t lastLevel = texture.residentLevel;
+        tools::texture::TextureCache* cache = m_cache;
+        job->loading = tools::ThreadPool::Singleton().submit([source, level, lastLevel, cache]() {
+            return loadLevels(source, level, lastLevel, cache);
+        });
+    }
+    else {
+        std::vector<std::vector<uint8_t>> levels;
+        recordJob(*job, levels);
+    }
+
+    texture.busy = true;
+    m_jobs.emplace_back(std::move(job));
+}
+
+//-------------------------------------------------------------------------
+// New image with the levels from 'job.level', the finer levels than the
+// current image are uploaded and the image released to the frames
+//
+void TextureStreamer::recordJob(Job& job, std::vector<std::vector<uint8_t>>& levels)
+{
+    const Source&  source   = m_textures[job.slot].source;
+    const uint32_t newLevel = job.level;
+
+    auto levelExtent = [&source](uint32_t level) {
+        return vk::Extent3D(std::max(1u, source.width >> level), std::max(1u, source.height >> level), 1);
+    };
+
+    const vk::Extent3D size = levelExtent(newLevel);
+    job.info           = app::image::create2DInfo(vk::Extent2D(size.width, size.height), source.format);
+    job.info.mipLevels = source.levels - newLevel;
+    job.image          = m_allocator->createImage(job.info);
+    job.recorded       = true;
+
+    // eviction, all the levels are copied by the frame
+    if (levels.empty())
+        return;
+
+    try {
+        job.fence = m_device.createFence({});
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create texture streaming fence!");
+    }
+    job.commandBuffer = m_commandPool.createBuffer();
+    vk::CommandBuffer cmdBuffer = job.commandBuffer;
+
+    const vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, job.info.mipLevels, 0, 1);
+
+    vk::ImageMemoryBarrier barrier = {};
+    barrier.image               = job.image.image;
+    barrier.oldLayout           = vk::ImageLayout::eUndefined;
+    barrier.newLayout           = vk::ImageLayout::eTransferDstOptimal;
+    barrier.dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange    = range;
+
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+        vk::DependencyFlags(), nullptr, nullptr, barrier);
+
+    for (size_t i = 0; i < levels.size(); ++i) {
+        const uint32_t level = newLevel + static_cast<uint32_t>(i);
+        vk::ImageSubresourceLayers subresource(vk::ImageAspectFlagBits::eColor, level - newLevel, 0, 1);
+        m_staging.cmdToImage(cmdBuffer, job.image.image, vk::Offset3D(), levelExtent(level), subresource,
+                             levels[i].size(), levels[i].data());
+    }
+    levels.clear();
+
+    // still written by the copies of the kept levels in the frame
+    barrier = m_uploads->releaseBarrier(job.image.image, range, vk::ImageLayout::eTransferDstOptimal,
+                                        vk::ImageLayout::eTransferDstOptimal);
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
+        vk::DependencyFlags(), nullptr, nullptr, barrier);
+
+    job.uploadValue = m_uploads->submit(cmdBuffer, job.fence);
+    m_staging.finalizeResources(job.fence);
+}
+
+//-------------------------------------------------------------------------
+// In the frame: the uploaded image is acquired, the levels in both images
+// copied from the current one, then both are sampled again
+//
+void TextureStreamer::cmdAcquireJob(vk::CommandBuffer cmdBuffer, Job& job)
+{
+    const Texture& texture  = m_textures[job.slot];
+    const Source&  source   = texture.source;
+    const uint32_t oldLevel = texture.residentLevel;
+    const uint32_t newLevel = job.level;
+    const uint32_t kept     = std::max(oldLevel, newLevel);
+
+    auto levelExtent = [&source](uint32_t level) {
+        return vk::Extent3D(std::max(1u, source.width >> level), std::max(1u, source.height >> level), 1);
+    };
+
+    const vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, job.info.mipLevels, 0, 1);
+
+    // new image written, old image read by the copies of the kept levels
+    vk::ImageMemoryBarrier barriers[2] = {};
+    if (job.uploadValue) {
+        barriers[0] = m_uploads->acquireBarrier(job.image.image, range, vk::ImageLayout::eTransferDstOptimal,
+                                                vk::ImageLayout::eTransferDstOptimal, vk::AccessFlagBits::eTransferWrite);
+        m_uploads->waitInFrame(job.uploadValue);
+    }
+    else {
+        barriers[0].image               = job.image.image;
+        barriers[0].oldLayout           = vk::ImageLayout::eUndefined;
+        barriers[0].newLayout           = vk::ImageLayout::eTransferDstOptimal;
+        barriers[0].dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
+        barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[0].subresourceRange    = range;
+    }
+
+    barriers[1].image               = texture.image;
+    barriers[1].oldLayout           = vk::ImageLayout::eShaderReadOnlyOptimal;
+    barriers[1].newLayout           = vk::ImageLayout::eTransferSrcOptimal;
+    barriers[1].dstAccessMask       = vk::AccessFlagBits::eTransferRead;
+    barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[1].subresourceRange    = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, kept - oldLevel,
+                                                                source.levels - kept, 0, 1);
+
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eTransfer,
+        vk::DependencyFlags(), nullptr, nullptr, barriers);
+
+    std::vector<vk::ImageCopy> copies;
+    for (uint32_t level = kept; level < source.levels; ++level) {
+        copies.emplace_back(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level - oldLevel, 0, 1), vk::Offset3D(),
+                            vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level - newLevel, 0, 1), vk::Offset3D(),
+                            levelExtent(level));
+    }
+    cmdBuffer.copyImage(texture.image, vk::ImageLayout::eTransferSrcOptimal, job.image.image,
+                        vk::ImageLayout::eTransferDstOptimal, copies);
+
+    // both images sampled again
+    barriers[0].oldLayout           = vk::ImageLayout::eTransferDstOptimal;
+    barriers[0].newLayout           = vk::ImageLayout::eShaderReadOnlyOptimal;
+    barriers[0].srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+    barriers[0].dstAccessMask       = vk::AccessFlagBits::eShaderRead;
+    barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[1].oldLayout           = vk::ImageLayout::eTransferSrcOptimal;
+    barriers[1].newLayout           = vk::ImageLayout::eShaderReadOnlyOptimal;
+    barriers[1].srcAccessMask       = vk::AccessFlags();
+    barriers[1].dstAccessMask       = vk::AccessFlagBits::eShaderRead;
+
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+        vk::DependencyFlags(), nullptr, nullptr, barriers);
+
+    job.acquired = true;
+}
+
+//-------------------------------------------------------------------------
+// The image is kept once published by the caller
+//
+void TextureStreamer::destroyJob(Job& job, bool destroyImage)
+{
+    if (job.loading.valid()) {
+        try {
+            job.loading.get();
+        }
+        catch (const std::exception&) {
+        }
+    }
+    if (job.fence) {
+        while (m_device.waitForFences(job.fence, VK_TRUE, 10000) == vk::Result::eTimeout) {}
+        m_device.destroy(job.fence);
+        job.fence = nullptr;
+    }
+    if (job.commandBuffer) {
+        m_commandPool.destroy(job.commandBuffer);
+        job.commandBuffer = nullptr;
+    }
+    if (destroyImage)
+        m_allocator->destroy(job.image);
+
+    m_textures[job.slot].busy = false;
+}
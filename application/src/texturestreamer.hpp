@@ -0,0 +1,194 @@
+/*
+ *
+ * Andrew Frost
+ * texturestreamer.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+
+#include "../vk_helpers/allocator.hpp"
+#include "../vk_helpers/commands.hpp"
+#include "../vk_helpers/uploadengine.hpp"
+#include "../general_helpers/texturecache.hpp"
+
+///////////////////////////////////////////////////////////////////////////
+// Texture Streamer                                                      //
+///////////////////////////////////////////////////////////////////////////
+// Mip levels of the scene textures loaded on demand                     //
+// - Textures are uploaded with their tail only, the levels of           //
+//   TAIL_SIZE and below, which always stay resident                     //
+// - The fragment shader writes the level it samples per texture in a    //
+//   feedback buffer, one region per frame in flight                     //
+// - Finer levels are loaded on the thread pool, the most recently seen  //
+//   textures first, as long as the textures fit in the budget           //
+// - Levels no longer needed are evicted when over budget or after       //
+//   EVICT_FRAMES frames without the texture being seen                  //
+// - A residency change creates an image and uploads the new levels on  //
+//   the transfer queue. The next frame once they are complete acquires  //
+//   the image and copies the levels kept from the previous one. The     //
+//   caller swaps the textures once the frames in flight are done.      //
+///////////////////////////////////////////////////////////////////////////
+
+class TextureStreamer
+{
+public:
+    // Largest size of the levels uploaded with the texture
+    static const uint32_t TAIL_SIZE = 64;
+
+    // Frames without being seen before the finer levels are evicted
+    static const uint64_t EVICT_FRAMES = 300;
+
+    // Residency changes recorded at once
+    static const uint32_t MAX_JOBS = 4;
+
+    // Level written by the shader is relative to the bound image, offset
+    // to keep the finer levels requested positive (FEEDBACK_LOD_OFFSET in
+    // frag_shader.frag)
+    static const uint32_t FEEDBACK_LOD_OFFSET = 16;
+
+    // Where the levels are loaded from
+    struct Source
+    {
+        std::string file;               // Image file, the KTX2 cache is 'file.ktx2' when compressed
+        vk::Format  format{ vk::Format::eUndefined };
+        bool        compressed{ false };
+        uint32_t    width{ 0 };          // Of level 0
+        uint32_t    height{ 0 };
+        uint32_t    levels{ 0 };
+    };
+
+    // New image of a texture slot, replacing the current one
+    struct Update
+    {
+        uint32_t            slot;
+        app::ImageVma       image;
+        vk::ImageCreateInfo info;
+    };
+
+    TextureStreamer(TextureStreamer const&) = delete;
+    TextureStreamer& operator=(TextureStreamer const&) = delete;
+
+    TextureStreamer() {}
+    ~TextureStreamer() { deinit(); }
+
+    void init(vk::Device device, vk::PhysicalDevice physicalDevice, app::Allocator& allocator,
+              app::UploadEngine& uploads, uint32_t nbFrames, tools::texture::TextureCache* cache = nullptr);
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // First level of the tail, and the size of the levels in memory
+    //
+    static uint32_t       tailLevel(uint32_t width, uint32_t height, uint32_t levels);
+    static vk::DeviceSize levelBytes(const Source& source, uint32_t level);
+
+    //-------------------------------------------------------------------------
+    // Levels [firstLevel, lastLevel) of an RGBA8 image, filtered from level 0
+    //
+    static std::vector<std::vector<uint8_t>> buildLevels(const uint8_t* rgba, const Source& source,
+                                                         uint32_t firstLevel, uint32_t lastLevel);
+
+    //-------------------------------------------------------------------------
+    // Levels [firstLevel, lastLevel) read from the source, empty on failure
+    //
+    static std::vector<std::vector<uint8_t>> loadLevels(const Source& source, uint32_t firstLevel, uint32_t lastLevel,
+                                                        tools::texture::TextureCache* cache = nullptr);
+
+    //-------------------------------------------------------------------------
+    // Texture of the slot, its image holds the levels from 'residentLevel'
+    //
+    void add(uint32_t slot, const Source& source, uint32_t residentLevel, vk::Image image);
+
+    //-------------------------------------------------------------------------
+    // Feedback buffer of binding 5, with room for 'nbSlots' textures. Only
+    // resized when no frame is in flight. The descriptor covers all the
+    // frames, the offset of a frame is in bytes.
+    //
+    void                     prepareFeedback(uint32_t nbSlots);
+    vk::DescriptorBufferInfo feedbackDescriptor() const;
+    uint32_t                 feedbackOffset(uint32_t frame) const;
+
+    //-------------------------------------------------------------------------
+    // Around the rendering of a frame, once its previous use completed:
+    // records the residency changes whose uploads are complete, reads and
+    // clears its region, then makes the levels written visible to the host
+    //
+    void cmdBeginFrame(vk::CommandBuffer cmdBuffer, uint32_t frame);
+    void cmdEndFrame(vk::CommandBuffer cmdBuffer, uint32_t frame);
+
+    //-------------------------------------------------------------------------
+    // Starts the residency changes for the levels requested in the budget,
+    // and returns the completed ones
+    //
+    std::vector<Update> update(vk::DeviceSize budget);
+
+    vk::DeviceSize residentBytes() const { return m_residentBytes; }
+    uint32_t       pendingJobs() const { return static_cast<uint32_t>(m_jobs.size()); }
+
+    const app::StagingMemoryManager& staging() const { return m_staging; }
+
+private:
+    struct Texture
+    {
+        Source   source;
+        bool     streamed{ false };   // Slots of textures uploaded in full are not streamed
+        bool     failed{ false };     // Source no longer readable
+        bool     busy{ false };       // Residency change in progress
+        uint32_t tailLevel{ 0 };
+        uint32_t residentLevel{ 0 };  // First level in the image
+        uint32_t requestedLevel{ 0 }; // Finest level sampled in the last frame read
+        uint64_t lastSeen{ 0 };       // Frame number
+        uint64_t changed{ 0 };        // Frame number of the last residency change
+        vk::Image image;              // Current image of the slot
+    };
+
+    struct Job
+    {
+        uint32_t                                       slot;
+        uint32_t                                       level;    // New first level
+        std::future<std::vector<std::vector<uint8_t>>> loading;  // Levels missing, none for an eviction
+        bool                                           recorded{ false };  // Upload submitted, if any
+        bool                                           acquired{ false };  // Recorded in a frame
+        vk::CommandBuffer                              commandBuffer;      // Upload, on the transfer queue
+        vk::Fence                                      fence;              // Of the upload, for the staging
+        uint64_t                                       uploadValue{ 0 };
+        app::ImageVma                                  image;
+        vk::ImageCreateInfo                            info;
+    };
+
+    vk::DeviceSize residentBytes(const Texture& texture, uint32_t level) const;
+
+    void readFeedback(uint32_t frame);
+    void startJob(uint32_t slot, uint32_t level);
+    void recordJob(Job& job, std::vector<std::vector<uint8_t>>& levels);
+    void cmdAcquireJob(vk::CommandBuffer cmdBuffer, Job& job);
+    void destroyJob(Job& job, bool destroyImage);
+
+    vk::Device                        m_device;
+    app::Allocator*                   m_allocator{ nullptr };
+    app::UploadEngine*                m_uploads{ nullptr };
+    app::CommandPool                  m_commandPool;      // On the transfer queue family
+    tools::texture::TextureCache*     m_cache{ nullptr };  // Decoded levels of the RGBA8 textures
+    app::StagingMemoryManagerVma      m_staging;
+
+    std::vector<Texture>              m_textures;    // By slot
+    std::vector<std::unique_ptr<Job>> m_jobs;
+    vk::DeviceSize                    m_residentBytes{ 0 };
+
+    // Feedback, one region per frame
+    app::BufferVma                    m_feedback;
+    const uint32_t*                   m_feedbackData{ nullptr };
+    vk::DeviceSize                    m_feedbackAlignment{ 256 };
+    vk::DeviceSize                    m_feedbackStride{ 0 };
+    uint32_t                          m_feedbackSlots{ 0 };
+    std::vector<uint64_t>             m_frameNumbers; // Of the frame recorded in each region, 0 when none
+    uint64_t                          m_frameNumber{ 0 };
+
+}; // class TextureStreamer
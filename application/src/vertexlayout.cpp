@@ -0,0 +1,134 @@
+/*
+ *
+ * Andrew Frost
+ * vertexlayout.cpp
+ * 2020
+ *
+ */
+
+#include "vertexlayout.hpp"
+
+#include "glm/gtc/packing.hpp"
+
+//-------------------------------------------------------------------------
+// Octahedral mapping of a unit vector in [-1, 1]^2
+//
+static glm::vec2 octahedralEncode(const glm::vec3& n)
+{
+    const float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 == 0.f)
+        return glm::vec2(0.f);
+
+    glm::vec2 p(n.x / l1, n.y / l1);
+    if (n.z < 0.f) {
+        p = glm::vec2((1.f - std::fabs(p.y)) * (p.x >= 0.f ? 1.f : -1.f),
+                      (1.f - std::fabs(p.x)) * (p.y >= 0.f ? 1.f : -1.f));
+    }
+    return p;
+}
+
+//-------------------------------------------------------------------------
+// Bytes per vertex
+//
+uint32_t vertexStride(VertexLayout layout)
+{
+    switch (layout) {
+    case VertexLayout::eUnorm16:
+    case VertexLayout::eHalf:
+        return 16;
+    default:
+        return sizeof(VertexObj);
+    }
+}
+
+//-------------------------------------------------------------------------
+// Locations match vert_shader: 0 position, 1 normal, 2 color, 3 uv. The
+// compact shader has no color.
+//
+std::vector<vk::VertexInputAttributeDescription> vertexAttributes(VertexLayout layout)
+{
+    if (layout == VertexLayout::eFloat32) {
+        return {
+            { 0, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, pos) },
+            { 1, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, nrm) },
+            { 2, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, color) },
+            { 3, 0, vk::Format::eR32G32Sfloat,    offsetof(VertexObj, texCoord) } };
+    }
+
+    const vk::Format positionFormat = layout == VertexLayout::eHalf ? vk::Format::eR16G16B16A16Sfloat
+                                                                     : vk::Format::eR16G16B16A16Unorm;
+
+    return {
+        { 0, 0, positionFormat,           0 },
+        { 1, 0, vk::Format::eR16G16Snorm, 8 },
+        { 3, 0, vk::Format::eR16G16Unorm, 12 } };
+}
+
+//-------------------------------------------------------------------------
+// Shaders are compiled by 'shaders/compile.bat'
+//
+std::string vertexShader(VertexLayout layout)
+{
+    if (layout == VertexLayout::eFloat32)
+        return "shaders/vert_shader.vert.spv";
+    return "shaders/vert_shader_compact.vert.spv";
+}
+
+//-------------------------------------------------------------------------
+// Positions and uvs are stored in [0, 1] relative to their bounds
+//
+std::vector<uint8_t> packVertices(VertexLayout layout, const VertexObj* vertices, size_t nbVertices, VertexDecode& decode)
+{
+    decode = VertexDecode();
+
+    const uint32_t       stride = vertexStride(layout);
+    std::vector<uint8_t> data(nbVertices * stride);
+
+    if (layout == VertexLayout::eFloat32) {
+        if (nbVertices > 0)
+            memcpy(data.data(), vertices, data.size());
+        return data;
+    }
+
+    if (nbVertices == 0)
+        return data;
+
+    // Bounds
+    glm::vec3 posMin = vertices[0].pos, posMax = vertices[0].pos;
+    glm::vec2 uvMin = vertices[0].texCoord, uvMax = vertices[0].texCoord;
+    for (size_t i = 1; i < nbVertices; ++i) {
+        posMin = glm::min(posMin, vertices[i].pos);
+        posMax = glm::max(posMax, vertices[i].pos);
+        uvMin  = glm::min(uvMin, vertices[i].texCoord);
+        uvMax  = glm::max(uvMax, vertices[i].texCoord);
+    }
+
+    decode.posOffset = posMin;
+    decode.posScale  = posMax - posMin;
+    decode.uvOffset  = uvMin;
+    decode.uvScale   = uvMax - uvMin;
+
+    // Flat axes are decoded to the offset
+    const glm::vec3 posInv(decode.posScale.x > 0.f ? 1.f / decode.posScale.x : 0.f,
+                           decode.posScale.y > 0.f ? 1.f / decode.posScale.y : 0.f,
+                           decode.posScale.z > 0.f ? 1.f / decode.posScale.z : 0.f);
+    const glm::vec2 uvInv(decode.uvScale.x > 0.f ? 1.f / decode.uvScale.x : 0.f,
+                          decode.uvScale.y > 0.f ? 1.f / decode.uvScale.y : 0.f);
+
+    for (size_t i = 0; i < nbVertices; ++i) {
+        const VertexObj& vertex = vertices[i];
+        uint8_t*         dst    = data.data() + i * stride;
+
+        const glm::vec3 p = (vertex.pos - posMin) * posInv;
+        const uint64_t  position = layout == VertexLayout::eHalf ? glm::packHalf4x16(glm::vec4(p, 0.f))
+                                                                 : glm::packUnorm4x16(glm::vec4(p, 0.f));
+        const uint32_t  normal   = glm::packSnorm2x16(octahedralEncode(vertex.nrm));
+        const uint32_t  texCoord = glm::packUnorm2x16((vertex.texCoord - uvMin) * uvInv);
+
+        memcpy(dst + 0, &position, sizeof(uint64_t));
+        memcpy(dst + 8, &normal, sizeof(uint32_t));
+        memcpy(dst + 12, &texCoord, sizeof(uint32_t));
+    }
+
+    return data;
+}
@@ -0,0 +1,66 @@
+/*
+ *
+ * Andrew Frost
+ * vertexlayout.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+
+#include "glm/glm.hpp"
+
+#include "../external/obj_loader.h"
+
+///////////////////////////////////////////////////////////////////////////
+// Vertex Layouts                                                        //
+///////////////////////////////////////////////////////////////////////////
+// Formats of the vertex buffers uploaded from the OBJ vertices          //
+// - eFloat32      : VertexObj as is, 44 bytes                           //
+// - eUnorm16      : unorm16 position in the AABB, octahedral snorm16    //
+//                   normal, unorm16 uv in the uv bounds, 16 bytes       //
+// - eHalf         : eUnorm16 with a half float position, 16 bytes       //
+// The quantized layouts use 'vert_shader_compact', decoding the         //
+// attributes with the VertexDecode of the model. The vertex colors are  //
+// not shaded, they are left out of the quantized layouts.               //
+///////////////////////////////////////////////////////////////////////////
+
+enum class VertexLayout
+{
+    eFloat32,
+    eUnorm16,
+    eHalf
+};
+
+// Position and uv bounds of the quantized attributes
+struct VertexDecode
+{
+    glm::vec3 posOffset{ 0.f };
+    glm::vec3 posScale{ 1.f };
+    glm::vec2 uvOffset{ 0.f };
+    glm::vec2 uvScale{ 1.f };
+};
+
+//-------------------------------------------------------------------------
+// Vertex input state of a layout, all attributes in binding 0
+//
+uint32_t vertexStride(VertexLayout layout);
+
+std::vector<vk::VertexInputAttributeDescription> vertexAttributes(VertexLayout layout);
+
+//-------------------------------------------------------------------------
+// SPIR-V vertex shader decoding the layout
+//
+std::string vertexShader(VertexLayout layout);
+
+//-------------------------------------------------------------------------
+// Encode the vertices in the layout, returns the vertex buffer data
+//
+std::vector<uint8_t> packVertices(VertexLayout     layout,
+                                  const VertexObj* vertices,
+                                  size_t           nbVertices,
+                                  VertexDecode&    decode);
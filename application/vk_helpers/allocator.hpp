@@ -11,6 +11,7 @@
 #include "..//external/vk_mem_alloc.h"
 #include "vulkan/vulkan.hpp"
 #include "memorymanagement.hpp"
+#include "imageuploadbatch.hpp"
 #include "samplers.hpp"
 #include "images.hpp"
 
@@ -230,11 +231,25 @@ public:
                            const void*        data,
                            VkBufferUsageFlags usage,
                            VmaMemoryUsage memUsage = VMA_MEMORY_USAGE_GPU_ONLY)
+    {
+        return createBuffer(cmdBuffer, m_staging, size, data, usage, memUsage);
+    }
+
+    //-------------------------------------------------------------------------
+    // Uploading through another staging manager, e.g. owned by a loading
+    // thread while this one is used by the render thread
+    //
+    BufferVma createBuffer(vk::CommandBuffer     cmdBuffer,
+                           StagingMemoryManager& staging,
+                           VkDeviceSize          size,
+                           const void*           data,
+                           VkBufferUsageFlags    usage,
+                           VmaMemoryUsage        memUsage = VMA_MEMORY_USAGE_GPU_ONLY)
     {
         BufferVma resultBuffer = createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memUsage);
         
         if (data) {
-            m_staging.cmdToBuffer(cmdBuffer, resultBuffer.buffer, 0, size, data);
+            staging.cmdToBuffer(cmdBuffer, resultBuffer.buffer, 0, size, data);
         }
 
         return resultBuffer;
@@ -246,7 +261,7 @@ public:
                            VkBufferUsageFlags usage,
                            vk::MemoryPropertyFlags memProps)
     {
-        createBuffer(cmdBuffer, size, data, usage, vkToVmaMemoryUsage(memProps));
+        return createBuffer(cmdBuffer, size, data, usage, vkToVmaMemoryUsage(memProps));
     }
 
     //-------------------------------------------------------------------------
@@ -258,13 +273,7 @@ public:
                            VkBufferUsageFlags    usage,
                            VmaMemoryUsage        memUsage = VMA_MEMORY_USAGE_GPU_ONLY)
     {
-        VkDeviceSize size = sizeof(T) * data.size();
-        BufferVma resultBuffer = createBuffer(size, usage, memUsage);
-        if (!data.empty()) {
-            m_staging.cmdToBuffer(cmdBuffer, resultBuffer.buffer, 0, size, data.data());
-        }
-
-        return resultBuffer;
+        return createBuffer(cmdBuffer, sizeof(T) * data.size(), data.empty() ? nullptr : data.data(), usage, memUsage);
     }
 
     template <typename T>
@@ -276,6 +285,16 @@ public:
         return createBuffer(cmdBuffer, data, usage, vkToVmaMemoryUsage(memProps));
     }
 
+    template <typename T>
+    BufferVma createBuffer(vk::CommandBuffer     cmdBuffer,
+                           StagingMemoryManager& staging,
+                           const std::vector<T>& data,
+                           VkBufferUsageFlags    usage,
+                           VmaMemoryUsage        memUsage = VMA_MEMORY_USAGE_GPU_ONLY)
+    {
+        return createBuffer(cmdBuffer, staging, sizeof(T) * data.size(), data.empty() ? nullptr : data.data(), usage, memUsage);
+    }
+
     //-------------------------------------------------------------------------
     // Create Image
     //
@@ -305,31 +324,26 @@ public:
         VkImageLayout            layout   = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
         VmaMemoryUsage           memUsage = VMA_MEMORY_USAGE_GPU_ONLY)
     {
-        ImageVma imageResult = createImage(info);
+        return createImage(cmdBuffer, m_staging, size, data, info, layout, memUsage);
+    }
+
+    ImageVma createImage(
+        const vk::CommandBuffer  cmdBuffer,
+        StagingMemoryManager&    staging,
+        vk::DeviceSize           size,
+        const void*              data,
+        const VkImageCreateInfo& info,
+        VkImageLayout            layout   = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VmaMemoryUsage           memUsage = VMA_MEMORY_USAGE_GPU_ONLY)
+    {
+        ImageVma imageResult = createImage(info, memUsage);
 
         // Copy the data to staging buffer than to image
         if (data != nullptr) {
-            // copy buffer to image
-            vk::ImageSubresourceRange subresourceRange = {};
-            subresourceRange.aspectMask     = vk::ImageAspectFlagBits::eColor;
-            subresourceRange.baseMipLevel   = 0;
-            subresourceRange.levelCount     = info.mipLevels;
-            subresourceRange.baseArrayLayer = 0;
-            subresourceRange.layerCount     = 1;
-
-            // doing these transitions per copy is not efficient, should do in bulk for many images
-            app::image::cmdBarrierImageLayout(cmdBuffer, imageResult.image, vk::ImageLayout::eUndefined,
-                vk::ImageLayout::eTransferDstOptimal, subresourceRange);
-
-            VkOffset3D offset = { 0 };
-            VkImageSubresourceLayers subresource = { 0 };
-            subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            subresource.layerCount = 1;
-
-            m_staging.cmdToImage(cmdBuffer, imageResult.image, offset, info.extent, subresource, size, data);
-
-            // Setting final image Layout
-            app::image::cmdBarrierImageLayout(vk::CommandBuffer(cmdBuffer), vk::Image(imageResult.image), vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout(layout));
+            ImageUploadBatch batch(staging);
+            batch.addImage(imageResult.image, vk::ImageCreateInfo(info), vk::ImageLayout(layout));
+            batch.addCopy(imageResult.image, 0, info.extent, size, data);
+            batch.cmdFlush(cmdBuffer);
         }
         else {
             // Setting final image layout
@@ -339,6 +353,21 @@ public:
         return imageResult;
     }
 
+    //-------------------------------------------------------------------------
+    // Create Image uploaded with a batch, its data is added to the batch
+    // and it is in 'layout' once the batch is flushed
+    //
+    ImageVma createImage(
+        ImageUploadBatch&        batch,
+        const VkImageCreateInfo& info,
+        VkImageLayout            layout   = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VmaMemoryUsage           memUsage = VMA_MEMORY_USAGE_GPU_ONLY)
+    {
+        ImageVma imageResult = createImage(info, memUsage);
+        batch.addImage(imageResult.image, vk::ImageCreateInfo(info), vk::ImageLayout(layout));
+        return imageResult;
+    }
+
     //-------------------------------------------------------------------------
     // Create Textures
     // 
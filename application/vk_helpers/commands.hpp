@@ -128,7 +128,8 @@ public:
     void destroy(vk::CommandBuffer cmd) { destroy(1, &cmd); }
 
     //-------------------------------------------------------------------------
-    // ends and submits to queue, waits for queue idle and destroys cmds
+    // ends and submits to queue, waits for the cmds only and destroys them,
+    // the frames in flight on the queue keep running
     //
     void submitAndWait(size_t count, const vk::CommandBuffer* commands, vk::Queue queue)
     {
@@ -142,13 +143,17 @@ public:
         submitInfo.commandBufferCount = static_cast<uint32_t>(count);
         submitInfo.pCommandBuffers    = commands;
 
+        vk::Fence fence;
         try {
-            m_queue.submit(submitInfo, nullptr);
+            fence = m_device.createFence({});
+            queue.submit(submitInfo, fence);
         }
         catch (vk::SystemError err) {
+            m_device.destroyFence(fence);
             throw std::runtime_error("failed to submit single command buffer!");
         }
-        m_queue.waitIdle();
+        while (m_device.waitForFences(fence, VK_TRUE, 10000) == vk::Result::eTimeout) {}
+        m_device.destroyFence(fence);
         m_device.freeCommandBuffers(m_commandPool, (uint32_t)count, commands);
     }
     
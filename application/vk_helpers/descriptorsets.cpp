@@ -69,10 +69,14 @@ uint32_t DescriptorSetBindings::getCount(uint32_t binding) const
 //
 vk::DescriptorSetLayout DescriptorSetBindings::createLayout(vk::Device device, vk::DescriptorSetLayoutCreateFlags flags) const
 {
+    // one flag per binding, the bindings after the last one set have none
+    std::vector<vk::DescriptorBindingFlags> bindingFlags = m_bindingFlags;
+    bindingFlags.resize(m_bindings.size(), vk::DescriptorBindingFlags());
+
     vk::DescriptorSetLayoutBindingFlagsCreateInfo extendedInfo{};
     extendedInfo.pNext         = nullptr;
-    extendedInfo.bindingCount  = static_cast<uint32_t>(m_bindingFlags.size());
-    extendedInfo.pBindingFlags = m_bindingFlags.data();
+    extendedInfo.bindingCount  = static_cast<uint32_t>(bindingFlags.size());
+    extendedInfo.pBindingFlags = bindingFlags.data();
 
     vk::DescriptorSetLayoutCreateInfo layoutCreateInfo = {};
     layoutCreateInfo.bindingCount = static_cast<uint32_t>(m_bindings.size());
@@ -93,7 +97,8 @@ vk::DescriptorSetLayout DescriptorSetBindings::createLayout(vk::Device device, v
 // generates the descriptor pool with enough space to handle all the 
 // bound resources and allocate up to maxSets descriptor sets
 //
-vk::DescriptorPool DescriptorSetBindings::createPool(vk::Device device, uint32_t maxSets) const
+vk::DescriptorPool DescriptorSetBindings::createPool(vk::Device device, uint32_t maxSets,
+    vk::DescriptorPoolCreateFlags flags) const
 {
     // Aggregate the bindings to obtain the required size of the descriptors using that layout
     std::vector<vk::DescriptorPoolSize> poolSizes;
@@ -107,6 +112,7 @@ vk::DescriptorPool DescriptorSetBindings::createPool(vk::Device device, uint32_t
     poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolCreateInfo.pPoolSizes    = poolSizes.data();
     poolCreateInfo.maxSets       = maxSets;
+    poolCreateInfo.flags         = flags;
 
     try {
         vk::DescriptorPool pool = device.createDescriptorPool(poolCreateInfo);
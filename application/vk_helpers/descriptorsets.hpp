@@ -159,7 +159,8 @@ public:
     vk::DescriptorSetLayout createLayout( vk::Device device, 
         vk::DescriptorSetLayoutCreateFlags flags = vk::DescriptorSetLayoutCreateFlags()) const;
 
-    vk::DescriptorPool createPool(vk::Device device, uint32_t maxSets = 1) const;
+    vk::DescriptorPool createPool(vk::Device device, uint32_t maxSets = 1,
+        vk::DescriptorPoolCreateFlags flags = vk::DescriptorPoolCreateFlags()) const;
 
     void addRequiredPoolSizes(std::vector<vk::DescriptorPoolSize>& poolSizes, uint32_t numSets) const;
 
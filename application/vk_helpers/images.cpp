@@ -193,7 +193,7 @@ void generateMipmaps(
         vk::DependencyFlags(), nullptr, nullptr, barrier);
 
     // transfer remaining mips to DST optimal
-    barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+    barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
     barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
     barrier.subresourceRange.baseMipLevel = 1;
     barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
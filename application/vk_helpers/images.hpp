@@ -82,8 +82,8 @@ vk::ImageViewCreateInfo makeImageViewCreateInfo(
     bool                       isCube = false);
 
 //-------------------------------------------------------------------------
-// mipmap generation relies on blitting
-// a more sophisticated version could be done with computer shader <-- TODO
+// mipmap generation relies on blitting, 'MipmapGenerator' does it with a
+// compute shader for RGBA8 images
 //
 void generateMipmaps(
     vk::CommandBuffer cmdBuffer, 
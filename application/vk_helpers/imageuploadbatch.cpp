@@ -0,0 +1,138 @@
+/*
+ *
+ * Andrew Frost
+ * imageuploadbatch.cpp
+ * 2020
+ *
+ */
+
+#include "imageuploadbatch.hpp"
+
+#include <algorithm>
+
+#include "images.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// ImageUploadBatch                                                      //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void ImageUploadBatch::addImage(vk::Image image, const vk::ImageCreateInfo& info, vk::ImageLayout layout)
+{
+    PendingImage pending;
+    pending.image  = image;
+    pending.range  = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, info.mipLevels, 0, info.arrayLayers);
+    pending.layout = layout;
+    m_images.push_back(pending);
+}
+
+//-------------------------------------------------------------------------
+// The copies mostly target the image added last, searched first
+//
+ImageUploadBatch::PendingImage& ImageUploadBatch::findImage(vk::Image image)
+{
+    auto it = std::find_if(m_images.rbegin(), m_images.rend(),
+                           [image](const PendingImage& pending) { return pending.image == image; });
+    assert(it != m_images.rend() && "image not added to the batch");
+    return *it;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void* ImageUploadBatch::addCopy(vk::Image image, uint32_t level, const vk::Extent3D& extent, vk::DeviceSize size,
+                                const void* data, uint32_t layer, const vk::Offset3D& offset)
+{
+    PendingImage& pending = findImage(image);
+
+    Copy copy;
+    void* mapping = m_staging->getStagingSpace(size, copy.buffer, copy.region.bufferOffset);
+    assert(mapping);
+
+    if (data)
+        memcpy(mapping, data, size);
+
+    copy.region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level, layer, 1);
+    copy.region.imageOffset      = offset;
+    copy.region.imageExtent      = extent;
+    pending.copies.push_back(copy);
+
+    return data ? nullptr : mapping;
+}
+
+//-------------------------------------------------------------------------
+// The regions of an image are sorted by staging buffer, so the copies
+// from the same block are merged in one command
+//
+void ImageUploadBatch::cmdFlush(vk::CommandBuffer cmdBuffer)
+{
+    if (m_images.empty())
+        return;
+
+    std::vector<vk::ImageMemoryBarrier> barriers(m_images.size());
+    for (size_t i = 0; i < m_images.size(); ++i) {
+        vk::ImageMemoryBarrier& barrier = barriers[i];
+        barrier.image               = m_images[i].image;
+        barrier.subresourceRange    = m_images[i].range;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.oldLayout           = vk::ImageLayout::eUndefined;
+        barrier.newLayout           = vk::ImageLayout::eTransferDstOptimal;
+        barrier.dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
+    }
+
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+        vk::DependencyFlags(), nullptr, nullptr, barriers);
+
+    std::vector<vk::BufferImageCopy> regions;
+    for (auto& pending : m_images) {
+        std::stable_sort(pending.copies.begin(), pending.copies.end(),
+                         [](const Copy& a, const Copy& b) { return a.buffer < b.buffer; });
+
+        for (size_t first = 0; first < pending.copies.size();) {
+            const vk::Buffer buffer = pending.copies[first].buffer;
+
+            regions.clear();
+            size_t last = first;
+            for (; last < pending.copies.size() && pending.copies[last].buffer == buffer; ++last)
+                regions.push_back(pending.copies[last].region);
+
+            cmdBuffer.copyBufferToImage(buffer, pending.image, vk::ImageLayout::eTransferDstOptimal, regions);
+            first = last;
+        }
+    }
+
+    // Final layouts, the images staying in eTransferDstOptimal are left to the caller
+    barriers.clear();
+    vk::PipelineStageFlags dstStages;
+    for (const auto& pending : m_images) {
+        if (pending.layout == vk::ImageLayout::eTransferDstOptimal)
+            continue;
+
+        vk::ImageMemoryBarrier barrier = {};
+        barrier.image               = pending.image;
+        barrier.subresourceRange    = pending.range;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.oldLayout           = vk::ImageLayout::eTransferDstOptimal;
+        barrier.newLayout           = pending.layout;
+        barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask       = image::accessFlagsForLayout(pending.layout);
+        barriers.push_back(barrier);
+
+        dstStages |= image::pipelineStageForLayout(pending.layout);
+    }
+
+    if (!barriers.empty()) {
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, dstStages,
+            vk::DependencyFlags(), nullptr, nullptr, barriers);
+    }
+
+    m_images.clear();
+}
+
+} // namespace app
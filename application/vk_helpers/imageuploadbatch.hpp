@@ -0,0 +1,83 @@
+/*
+ *
+ * Andrew Frost
+ * imageuploadbatch.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "memorymanagement.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// Image Upload Batch                                                    //
+///////////////////////////////////////////////////////////////////////////
+// Uploads of many images recorded together                              //
+// - The data is copied in the staging memory when added, the commands   //
+//   are only recorded by 'cmdFlush'                                     //
+// - One barrier to eTransferDstOptimal for all the images, one copy per //
+//   image and staging buffer with all its regions, then one barrier per //
+//   final layout                                                        //
+// - Not thread safe, like the staging memory manager it uses            //
+///////////////////////////////////////////////////////////////////////////
+
+class ImageUploadBatch
+{
+public:
+    ImageUploadBatch(ImageUploadBatch const&) = delete;
+    ImageUploadBatch& operator=(ImageUploadBatch const&) = delete;
+
+    ImageUploadBatch(StagingMemoryManager& staging) : m_staging(&staging) {}
+
+    //-------------------------------------------------------------------------
+    // Image whose levels are all written before being transitioned to
+    // 'layout', eTransferDstOptimal when more transfers follow
+    //
+    void addImage(vk::Image image, const vk::ImageCreateInfo& info,
+                  vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    //-------------------------------------------------------------------------
+    // Copy to a level of an image added to the batch. If data != nullptr,
+    // memcpies to the staging space and returns nullptr, otherwise returns
+    // the mapping to fill before the batch is submitted.
+    //
+    void* addCopy(vk::Image image, uint32_t level, const vk::Extent3D& extent, vk::DeviceSize size, const void* data,
+                  uint32_t layer = 0, const vk::Offset3D& offset = vk::Offset3D());
+
+    //-------------------------------------------------------------------------
+    // Records the barriers and copies, the batch is empty afterwards
+    //
+    void cmdFlush(vk::CommandBuffer cmdBuffer);
+
+    bool     empty() const { return m_images.empty(); }
+    uint32_t size() const { return static_cast<uint32_t>(m_images.size()); }
+
+private:
+    struct Copy
+    {
+        vk::Buffer          buffer;
+        vk::BufferImageCopy region;
+    };
+
+    struct PendingImage
+    {
+        vk::Image                 image;
+        vk::ImageSubresourceRange range;
+        vk::ImageLayout           layout;
+        std::vector<Copy>         copies;
+    };
+
+    PendingImage& findImage(vk::Image image);
+
+    StagingMemoryManager*     m_staging;
+    std::vector<PendingImage> m_images;
+
+}; // class ImageUploadBatch
+
+} // namespace app
@@ -14,6 +14,72 @@ namespace app {
 #undef max
 #endif
 
+static const uint32_t STAGING_ALIGNMENT = 16;
+
+static inline uint32_t bitScanForward(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline uint32_t bitScanReverse(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return index;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+static inline uint32_t histogramBin(vk::DeviceSize size)
+{
+    if (size >= (vk::DeviceSize(1) << 31))
+        return StagingStats::HISTOGRAM_BINS - 1;
+
+    const uint32_t log2 = bitScanReverse(std::max((uint32_t)size, 1u));
+    return std::min(std::max(log2, 8u) - 8, StagingStats::HISTOGRAM_BINS - 1);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Staging Stats                                                         //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void StagingStats::add(const StagingStats& other)
+{
+    bytes           += other.bytes;
+    allocations     += other.allocations;
+    batches         += other.batches;
+    lastBatchBytes   = std::max(lastBatchBytes, other.lastBatchBytes);
+    peakBatchBytes   = std::max(peakBatchBytes, other.peakBatchBytes);
+
+    allocatedSize     += other.allocatedSize;
+    peakAllocatedSize  = std::max(peakAllocatedSize, other.peakAllocatedSize);
+    usedSize          += other.usedSize;
+    peakUsedSize       = std::max(peakUsedSize, other.peakUsedSize);
+    blockCount        += other.blockCount;
+    peakBlockCount     = std::max(peakBlockCount, other.peakBlockCount);
+
+    releasedBatches += other.releasedBatches;
+    lastLatency      = std::max(lastLatency, other.lastLatency);
+    maxLatency       = std::max(maxLatency, other.maxLatency);
+    totalLatency    += other.totalLatency;
+
+    for (uint32_t i = 0; i < HISTOGRAM_BINS; i++)
+        histogram[i] += other.histogram[i];
+
+    blocks.insert(blocks.end(), other.blocks.begin(), other.blocks.end());
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // Staging Memory Manager                                                //
 ///////////////////////////////////////////////////////////////////////////
@@ -35,6 +101,11 @@ void StagingMemoryManager::init(vk::Device device, vk::PhysicalDevice physicalDe
     m_freeBlockIndex   = INVALID_ID_INDEX;
     m_usedSize         = 0;
     m_allocatedSize    = 0;
+    m_stats            = StagingStats();
+
+    std::fill(m_buckets, m_buckets + NUM_BUCKETS, INVALID_ID_INDEX);
+    m_bucketMask = 0;
+    m_lastBlock  = INVALID_ID_INDEX;
 
     m_stagingIndex = newStagingIndex();
 }
@@ -59,15 +130,7 @@ void StagingMemoryManager::deinit()
 //
 bool StagingMemoryManager::fitsInAllocated(vk::DeviceSize size) const
 {
-    for (const auto& block : m_blocks) {
-        if (block.buffer) {
-            if (block.range.isAvailable((uint32_t)size, 16)) {
-                return true;
-            }
-        }
-    }
-
-    return false;
+    return findBlock(size) != INVALID_ID_INDEX;
 }
 
 //-------------------------------------------------------------------------
@@ -141,6 +204,11 @@ void StagingMemoryManager::finalizeResources(vk::Fence fence)
     if (m_sets[m_stagingIndex].entries.empty())
         return;
 
+    const StagingSet& set = m_sets[m_stagingIndex];
+    m_stats.batches++;
+    m_stats.lastBatchBytes = set.bytes;
+    m_stats.peakBatchBytes = std::max(m_stats.peakBatchBytes, set.bytes);
+
     m_sets[m_stagingIndex].fence = fence;
     m_stagingIndex               = newStagingIndex();
 }
@@ -168,7 +236,16 @@ void StagingMemoryManager::releaseResources(uint32_t stagingID)
     StagingSet& set = m_sets[stagingID];
     assert(set.index == stagingID);
 
-    // free used allocation ranges
+    if (!set.entries.empty()) {
+        const double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - set.recorded).count();
+        m_stats.releasedBatches++;
+        m_stats.lastLatency   = latency;
+        m_stats.maxLatency    = std::max(m_stats.maxLatency, latency);
+        m_stats.totalLatency += latency;
+    }
+
+    // free used allocation ranges, the blocks left are put back in the
+    // bucket of their largest free range once all are freed
     for (auto& entry : set.entries) {
         Block& block = getBlock(entry.block);
         block.range.subFree(entry.offset, entry.size);
@@ -178,6 +255,15 @@ void StagingMemoryManager::releaseResources(uint32_t stagingID)
         if (block.range.isEmpty() && m_freeOnRelease) {
             freeBlock(block);
         }
+        else {
+            removeBucket(block);
+        }
+    }
+
+    for (auto& entry : set.entries) {
+        Block& block = getBlock(entry.block);
+        if (block.buffer && block.bucket == INVALID_ID_INDEX)
+            insertBucket(block);
     }
 
     set.entries.clear();
@@ -198,6 +284,33 @@ float StagingMemoryManager::getUtilisation(vk::DeviceSize& allocatedSize, vk::De
     return float(double(usedSize) / double(allocatedSize));
 }
 
+//-------------------------------------------------------------------------
+//
+//
+void StagingMemoryManager::getStats(StagingStats& stats) const
+{
+    stats               = m_stats;
+    stats.allocatedSize = m_allocatedSize;
+    stats.usedSize      = m_usedSize;
+
+    stats.blocks.clear();
+    for (const auto& block : m_blocks) {
+        if (!block.buffer)
+            continue;
+
+        StagingStats::BlockStats blockStats;
+        blockStats.size        = block.size;
+        blockStats.used        = block.range.usedSize();
+        blockStats.largestFree = block.range.largestFreeRange();
+
+        const vk::DeviceSize freeSize = blockStats.size - blockStats.used;
+        if (freeSize)
+            blockStats.fragmentation = 1.f - float(double(blockStats.largestFree) / double(freeSize));
+
+        stats.blocks.push_back(blockStats);
+    }
+}
+
 //-------------------------------------------------------------------------
 //
 //
@@ -214,6 +327,9 @@ void StagingMemoryManager::free(bool unusedOnly)
         m_blocks.clear();
         resizeBlocks(0);
         m_freeBlockIndex = INVALID_ID_INDEX;
+        std::fill(m_buckets, m_buckets + NUM_BUCKETS, INVALID_ID_INDEX);
+        m_bucketMask = 0;
+        m_lastBlock  = INVALID_ID_INDEX;
     }
 }
 
@@ -222,7 +338,9 @@ void StagingMemoryManager::free(bool unusedOnly)
 //
 void StagingMemoryManager::freeBlock(Block& block)
 {
+    removeBucket(block);
     m_allocatedSize -= block.size;
+    m_stats.blockCount--;
     freeBlockMemory(block.index, block);
     block.memory = nullptr;
     block.buffer = nullptr;
@@ -260,25 +378,103 @@ uint32_t StagingMemoryManager::newStagingIndex()
 }
 
 //-------------------------------------------------------------------------
+// Block whose largest free range may hold 'size', from the first non empty
+// bucket of ranges at least the size rounded to a power of two
+//
+uint32_t StagingMemoryManager::findBlock(vk::DeviceSize size) const
+{
+    if (size > (vk::DeviceSize(1) << 31))
+        return INVALID_ID_INDEX;
+
+    const uint32_t needed = std::max((uint32_t)RangeAllocator::alignedSize((RangeAllocator::size_type)size), 1u);
+    const uint32_t bucket = bitScanReverse(needed) + ((needed & (needed - 1)) ? 1 : 0);
+    if (bucket >= NUM_BUCKETS)
+        return INVALID_ID_INDEX;
+
+    const uint32_t mask = m_bucketMask & (~0u << bucket);
+    return mask ? m_buckets[bitScanForward(mask)] : INVALID_ID_INDEX;
+}
+
+//-------------------------------------------------------------------------
+// Full blocks are in no bucket, the ranges of 2GB and more are in the
+// last one
 //
+void StagingMemoryManager::insertBucket(Block& block)
+{
+    assert(block.bucket == INVALID_ID_INDEX);
+
+    const uint32_t largest = (uint32_t)std::min(block.range.largestFreeRange(), RangeAllocator::size_type(1) << 31);
+    if (!largest)
+        return;
+
+    const uint32_t bucket = bitScanReverse(largest);
+    block.bucket = bucket;
+    block.prev   = INVALID_ID_INDEX;
+    block.next   = m_buckets[bucket];
+
+    if (block.next != INVALID_ID_INDEX)
+        m_blocks[block.next].prev = block.index;
+
+    m_buckets[bucket] = block.index;
+    m_bucketMask |= 1u << bucket;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void StagingMemoryManager::removeBucket(Block& block)
+{
+    if (block.bucket == INVALID_ID_INDEX)
+        return;
+
+    if (block.prev != INVALID_ID_INDEX)
+        m_blocks[block.prev].next = block.next;
+    else
+        m_buckets[block.bucket] = block.next;
+
+    if (block.next != INVALID_ID_INDEX)
+        m_blocks[block.next].prev = block.prev;
+
+    if (m_buckets[block.bucket] == INVALID_ID_INDEX)
+        m_bucketMask &= ~(1u << block.bucket);
+
+    block.bucket = INVALID_ID_INDEX;
+    block.prev   = INVALID_ID_INDEX;
+    block.next   = INVALID_ID_INDEX;
+}
+
+//-------------------------------------------------------------------------
+// The space comes from a single block, picked from the buckets, or a new
+// one when none fits
 //
 void* StagingMemoryManager::getStagingSpace(vk::DeviceSize size, vk::Buffer& buffer, vk::DeviceSize& offset)
 {
     assert(m_sets[m_stagingIndex].index == m_stagingIndex && "illegal index, did you forget finalizeResources");
 
-    uint32_t usedOffset;
-    uint32_t usedSize;
-    uint32_t usedAligned;
+    RangeAllocator::size_type usedOffset;
+    RangeAllocator::size_type usedSize;
+    RangeAllocator::size_type usedAligned;
 
-    uint32_t blockIndex = INVALID_ID_INDEX;
+    const RangeAllocator::size_type rangeSize = (RangeAllocator::size_type)size;
 
-    for (uint32_t i = 0; i < (uint32_t)m_blocks.size(); i++) {
-        Block& block = m_blocks[i];
-        if (block.buffer && block.range.subAllocate((uint32_t)size, 16, usedOffset, usedAligned, usedSize)) {
-            blockIndex = block.index;
-
-            offset = usedAligned;
-            buffer = block.buffer;
+    // The block of the previous allocation is tried first, the uploads of a
+    // frame follow each other in it. Blocks freed or full are in no bucket.
+    uint32_t blockIndex = INVALID_ID_INDEX;
+    if (m_lastBlock < m_blocks.size() && m_blocks[m_lastBlock].bucket != INVALID_ID_INDEX
+        && m_blocks[m_lastBlock].range.subAllocate(rangeSize, STAGING_ALIGNMENT, usedOffset, usedAligned, usedSize)) {
+        blockIndex = m_lastBlock;
+    }
+    else {
+        // The bucket of a block is only lowered when an allocation fails: the
+        // largest free range is not searched again at each allocation. The
+        // block goes to a lower bucket, the loop ends.
+        while ((blockIndex = findBlock(size)) != INVALID_ID_INDEX) {
+            Block& block = m_blocks[blockIndex];
+            if (block.range.subAllocate(rangeSize, STAGING_ALIGNMENT, usedOffset, usedAligned, usedSize))
+                break;
+
+            removeBucket(block);
+            insertBucket(block);
         }
     }
 
@@ -301,7 +497,7 @@ void* StagingMemoryManager::getStagingSpace(vk::DeviceSize size, vk::Buffer& buf
 
         Block& block = m_blocks[blockIndex];
         block.size = std::max(m_stagingBlockSize, size);
-        block.size = block.range.alignedSize((uint32_t)block.size);
+        block.size = block.range.alignedSize((RangeAllocator::size_type)block.size);
 
         vk::Result result = allocBlockMemory(blockIndex, block.size, true, block);
         if (result != vk::Result::eSuccess) {
@@ -309,19 +505,39 @@ void* StagingMemoryManager::getStagingSpace(vk::DeviceSize size, vk::Buffer& buf
         }
 
         m_allocatedSize += block.size;
+        m_stats.blockCount++;
+        m_stats.peakBlockCount    = std::max(m_stats.peakBlockCount, m_stats.blockCount);
+        m_stats.peakAllocatedSize = std::max(m_stats.peakAllocatedSize, m_allocatedSize);
 
-        block.range.init((uint32_t)block.size);
-        block.range.subAllocate((uint32_t)size, 16, usedOffset, usedAligned, usedSize);
-
-        offset = usedAligned;
-        buffer = block.buffer;
+        block.range.init((RangeAllocator::size_type)block.size);
+        block.range.subAllocate(rangeSize, STAGING_ALIGNMENT, usedOffset, usedAligned, usedSize);
+        insertBucket(block);
     }
 
+    Block& block = m_blocks[blockIndex];
+    if (block.range.usedSize() >= block.size)
+        removeBucket(block);
+    m_lastBlock = blockIndex;
+
+    offset = usedAligned;
+    buffer = block.buffer;
+
     // append used space to current staging set list
+    StagingSet& set = m_sets[m_stagingIndex];
+    if (set.entries.empty()) {
+        set.bytes    = 0;
+        set.recorded = std::chrono::steady_clock::now();
+    }
+    set.bytes  += size;
     m_usedSize += usedSize;
-    m_sets[m_stagingIndex].entries.push_back({ blockIndex, usedOffset, usedSize });
+    set.entries.push_back({ blockIndex, usedOffset, usedSize });
+
+    m_stats.bytes += size;
+    m_stats.allocations++;
+    m_stats.histogram[histogramBin(size)]++;
+    m_stats.peakUsedSize = std::max(m_stats.peakUsedSize, m_usedSize);
 
-    return m_blocks[blockIndex].mapping + offset;
+    return block.mapping + offset;
 }
 
 
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <assert.h>
+#include <chrono>
 #include <vector>
 #include "../general_helpers/trangeallocator.hpp"
 #include <vulkan/vulkan.hpp>
@@ -23,6 +24,62 @@ namespace app {
 
 static const uint32_t INVALID_ID_INDEX = ~0;
 
+///////////////////////////////////////////////////////////////////////////
+// Staging Stats                                                         //
+///////////////////////////////////////////////////////////////////////////
+// Telemetry of a staging manager since its 'init', see 'getStats'       //
+// - A batch is the staging set closed by 'finalizeResources'            //
+// - The latency of a batch runs from its first allocation to its        //
+//   release, the fences are polled so it is an upper bound of the time  //
+//   to the signal                                                       //
+// - The fragmentation of a block is 1 - largest free range / free space //
+///////////////////////////////////////////////////////////////////////////
+
+struct StagingStats
+{
+    // bin i counts the allocations of [2^(i+8), 2^(i+9)) bytes, the first
+    // and last bins are open
+    static const uint32_t HISTOGRAM_BINS = 20;
+
+    struct BlockStats
+    {
+        vk::DeviceSize size{ 0 };
+        vk::DeviceSize used{ 0 };
+        vk::DeviceSize largestFree{ 0 };
+        float          fragmentation{ 0.f };
+    };
+
+    uint64_t       bytes{ 0 };          // Sizes requested
+    uint64_t       allocations{ 0 };
+    uint64_t       batches{ 0 };
+    vk::DeviceSize lastBatchBytes{ 0 };
+    vk::DeviceSize peakBatchBytes{ 0 };
+
+    vk::DeviceSize allocatedSize{ 0 };  // Blocks
+    vk::DeviceSize peakAllocatedSize{ 0 };
+    vk::DeviceSize usedSize{ 0 };       // Ranges allocated in the blocks
+    vk::DeviceSize peakUsedSize{ 0 };
+    uint32_t       blockCount{ 0 };
+    uint32_t       peakBlockCount{ 0 };
+
+    uint64_t       releasedBatches{ 0 };
+    double         lastLatency{ 0.0 };  // In ms
+    double         maxLatency{ 0.0 };
+    double         totalLatency{ 0.0 };
+
+    uint64_t       histogram[HISTOGRAM_BINS] = {};
+
+    std::vector<BlockStats> blocks;     // Filled by 'getStats'
+
+    double averageLatency() const { return releasedBatches ? totalLatency / releasedBatches : 0.0; }
+
+    //-------------------------------------------------------------------------
+    // Sums the counters, the peaks and the last values are the largest of
+    // the two
+    //
+    void add(const StagingStats& other);
+};
+
 ///////////////////////////////////////////////////////////////////////////
 // Staging Memory Manager                                                //
 ///////////////////////////////////////////////////////////////////////////
@@ -30,10 +87,18 @@ static const uint32_t INVALID_ID_INDEX = ~0;
 class StagingMemoryManager
 {
 protected:
+    // The sorted array is faster than TLSF for the few ranges of the staging
+    // blocks, see benchmarks/staging.cpp. TLSF is for 64-bit or heavily
+    // fragmented ranges.
+    using RangeAllocator = tools::TRangeAllocator<256>;
+
     //-------------------------------------------------------------------------
     // Block stores vk::Buffers taht we sub-allocate the staging space from.
     // The "index" element in the struct refers to the next free list item,
     // or itself when in use.
+    // Blocks in use with free space are linked in the bucket of their largest
+    // free range, or of a larger one until an allocation fails in the block,
+    // see 'm_buckets'.
     //
     struct Block
     {
@@ -41,15 +106,18 @@ protected:
         vk::DeviceSize              size = 0;
         vk::Buffer                  buffer = nullptr;
         vk::DeviceMemory            memory = nullptr;
-        tools::TRangeAllocator<256> range;
+        RangeAllocator              range;
         uint8_t*                    mapping;
+        uint32_t                    bucket = INVALID_ID_INDEX;
+        uint32_t                    prev = INVALID_ID_INDEX;  // blocks of the same bucket
+        uint32_t                    next = INVALID_ID_INDEX;
     };
 
     struct Entry
     {
-        uint32_t block;
-        uint32_t offset;
-        uint32_t size;
+        uint32_t                  block;
+        RangeAllocator::size_type offset;
+        RangeAllocator::size_type size;
     };
 
     //-------------------------------------------------------------------------
@@ -61,6 +129,8 @@ protected:
         uint32_t           index = INVALID_ID_INDEX;
         vk::Fence          fence = nullptr;
         std::vector<Entry> entries;
+        vk::DeviceSize     bytes = 0;  // requested by the entries
+        std::chrono::steady_clock::time_point recorded;  // first allocation
     };
 
 public:
@@ -102,6 +172,12 @@ public:
         vk::DeviceSize size,
         const void* data);
 
+    //-------------------------------------------------------------------------
+    // Space of the current staging set, the copy from 'buffer' at 'offset'
+    // is recorded by the caller (see 'ImageUploadBatch')
+    //
+    void* getStagingSpace(vk::DeviceSize size, vk::Buffer& buffer, vk::DeviceSize& offset);
+
     template <class T>
     T* cmdToBufferT(vk::CommandBuffer cmd, vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size)
     {
@@ -119,6 +195,12 @@ public:
 
     float getUtilisation(vk::DeviceSize& allocatedSize, vk::DeviceSize& usedSize) const;
 
+    //-------------------------------------------------------------------------
+    // Counters since 'init' and the blocks allocated, still valid after
+    // 'deinit' without the blocks
+    //
+    void getStats(StagingStats& stats) const;
+
 protected:
 
     uint32_t setIndexValue(uint32_t& index, uint32_t newValue)
@@ -133,7 +215,9 @@ protected:
 
     uint32_t newStagingIndex();
 
-    void* getStagingSpace(vk::DeviceSize size, vk::Buffer& buffer, vk::DeviceSize& offset);
+    uint32_t findBlock(vk::DeviceSize size) const;
+    void     insertBucket(Block& block);
+    void     removeBucket(Block& block);
 
     Block& getBlock(uint32_t index)
     {
@@ -165,9 +249,19 @@ protected:
     uint32_t m_freeStagingIndex; // linked-list to next free staging set    
     uint32_t m_freeBlockIndex;   // linked list to next free block
 
+    // Segregated lists of the blocks by largest free range, bucket i links the
+    // blocks whose range is in [2^i, 2^(i+1)) bytes. The mask has a bit per
+    // non empty bucket, so a block that fits is found without a search.
+    static const uint32_t NUM_BUCKETS = 32;
+    uint32_t m_buckets[NUM_BUCKETS];
+    uint32_t m_bucketMask;
+    uint32_t m_lastBlock;        // block of the previous allocation, tried first
+
     vk::DeviceSize m_allocatedSize;
     vk::DeviceSize m_usedSize;
 
+    StagingStats   m_stats;  // without the blocks
+
 
 }; // class StagingMemoryManager
 
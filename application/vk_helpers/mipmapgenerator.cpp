@@ -0,0 +1,246 @@
+/*
+ *
+ * Andrew Frost
+ * mipmapgenerator.cpp
+ * 2020
+ *
+ */
+
+#include "mipmapgenerator.hpp"
+#include "utilities.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// MipmapGenerator                                                       //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// Compute pipeline, and the layout of the descriptor set of each image:
+// the views of its levels (binding 0) and the workgroup counters (binding 1)
+//
+void MipmapGenerator::init(vk::Device device, Allocator& allocator, const std::string& shaderFile)
+{
+    m_device    = device;
+    m_allocator = &allocator;
+
+    std::vector<char> code = util::readFile(shaderFile);
+
+    m_bindings.clear();
+    m_bindings.addBinding(0, vk::DescriptorType::eStorageImage, MAX_LEVELS, vk::ShaderStageFlagBits::eCompute);
+    m_bindings.addBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute);
+    m_descriptorSetLayout = m_bindings.createLayout(m_device);
+
+    vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants));
+
+    vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+    pipelineLayoutCreateInfo.setLayoutCount         = 1;
+    pipelineLayoutCreateInfo.pSetLayouts            = &m_descriptorSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges    = &pushConstantRange;
+
+    vk::ShaderModuleCreateInfo shaderCreateInfo = {};
+    shaderCreateInfo.codeSize = code.size();
+    shaderCreateInfo.pCode    = reinterpret_cast<const uint32_t*>(code.data());
+
+    vk::ShaderModule shaderModule;
+    try {
+        m_pipelineLayout = m_device.createPipelineLayout(pipelineLayoutCreateInfo);
+        shaderModule     = m_device.createShaderModule(shaderCreateInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create mipmap pipeline layout!");
+    }
+
+    vk::ComputePipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.stage.stage  = vk::ShaderStageFlagBits::eCompute;
+    pipelineCreateInfo.stage.module = shaderModule;
+    pipelineCreateInfo.stage.pName  = "main";
+    pipelineCreateInfo.layout       = m_pipelineLayout;
+
+    try {
+        m_pipeline = m_device.createComputePipeline(nullptr, pipelineCreateInfo);
+    }
+    catch (vk::SystemError err) {
+        m_device.destroy(shaderModule);
+        throw std::runtime_error("failed to create mipmap pipeline!");
+    }
+    m_device.destroy(shaderModule);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void MipmapGenerator::deinit()
+{
+    if (!m_device)
+        return;
+
+    m_device.destroy(m_pipeline);
+    m_device.destroy(m_pipelineLayout);
+    m_device.destroy(m_descriptorSetLayout);
+    m_pipeline            = nullptr;
+    m_pipelineLayout      = nullptr;
+    m_descriptorSetLayout = nullptr;
+    m_device              = nullptr;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+bool MipmapGenerator::supports(const vk::ImageCreateInfo& info)
+{
+    return (info.format == vk::Format::eR8G8B8A8Unorm || info.format == vk::Format::eR8G8B8A8Srgb) &&
+           info.imageType == vk::ImageType::e2D && info.arrayLayers == 1 && info.mipLevels > 1 &&
+           info.mipLevels <= MAX_LEVELS;
+}
+
+//-------------------------------------------------------------------------
+// sRGB does not support storage, the image is written through UNORM views
+// and its sampled views must restrict their usage
+//
+void MipmapGenerator::prepareImageInfo(vk::ImageCreateInfo& info)
+{
+    info.usage |= vk::ImageUsageFlagBits::eStorage;
+    if (info.format == vk::Format::eR8G8B8A8Srgb)
+        info.flags |= vk::ImageCreateFlagBits::eMutableFormat | vk::ImageCreateFlagBits::eExtendedUsage;
+}
+
+//-------------------------------------------------------------------------
+// One barrier to the general layout, one dispatch per image, and one
+// barrier to the shader read layout
+//
+MipmapGenerator::Batch MipmapGenerator::cmdGenerate(vk::CommandBuffer cmdBuffer, const std::vector<Image>& images)
+{
+    Batch batch;
+    if (images.empty())
+        return batch;
+
+    const uint32_t nbImages = static_cast<uint32_t>(images.size());
+
+    batch.counters = m_allocator->createBuffer(sizeof(uint32_t) * nbImages,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    batch.descriptorPool = m_bindings.createPool(m_device, nbImages);
+
+    std::vector<vk::DescriptorSet> sets;
+    util::allocateDescriptorSets(m_device, batch.descriptorPool, m_descriptorSetLayout, nbImages, sets);
+
+    // Views of each level, the unused descriptors repeat the last level
+    std::vector<vk::DescriptorImageInfo> imageInfos(static_cast<size_t>(nbImages) * MAX_LEVELS);
+    vk::DescriptorBufferInfo             counterInfo(batch.counters.buffer, 0, VK_WHOLE_SIZE);
+    std::vector<vk::WriteDescriptorSet>  writes;
+
+    for (uint32_t i = 0; i < nbImages; ++i) {
+        vk::ImageViewCreateInfo viewCreateInfo = {};
+        viewCreateInfo.image            = images[i].image;
+        viewCreateInfo.viewType         = vk::ImageViewType::e2D;
+        viewCreateInfo.format           = vk::Format::eR8G8B8A8Unorm;
+        viewCreateInfo.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+
+        for (uint32_t level = 0; level < MAX_LEVELS; ++level) {
+            vk::DescriptorImageInfo& imageInfo = imageInfos[i * MAX_LEVELS + level];
+            if (level < images[i].mipLevels) {
+                viewCreateInfo.subresourceRange.baseMipLevel = level;
+                try {
+                    batch.views.push_back(m_device.createImageView(viewCreateInfo));
+                }
+                catch (vk::SystemError err) {
+                    throw std::runtime_error("failed to create mipmap image view!");
+                }
+            }
+            imageInfo = vk::DescriptorImageInfo(nullptr, batch.views.back(), vk::ImageLayout::eGeneral);
+        }
+
+        writes.push_back(m_bindings.makeWriteArray(sets[i], 0, &imageInfos[i * MAX_LEVELS]));
+        writes.push_back(m_bindings.makeWrite(sets[i], 1, &counterInfo));
+    }
+    m_device.updateDescriptorSets(writes, nullptr);
+
+    // Counters start at zero, level 0 is read and the others written
+    cmdBuffer.fillBuffer(batch.counters.buffer, 0, VK_WHOLE_SIZE, 0);
+
+    vk::BufferMemoryBarrier counterBarrier(vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, batch.counters.buffer, 0, VK_WHOLE_SIZE);
+
+    std::vector<vk::ImageMemoryBarrier> barriers;
+    for (const auto& image : images) {
+        vk::ImageMemoryBarrier barrier = {};
+        barrier.image               = image.image;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.oldLayout           = vk::ImageLayout::eTransferDstOptimal;
+        barrier.newLayout           = vk::ImageLayout::eGeneral;
+        barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask       = vk::AccessFlagBits::eShaderRead;
+        barrier.subresourceRange    = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+        barriers.push_back(barrier);
+
+        barrier.oldLayout                     = vk::ImageLayout::eUndefined;
+        barrier.srcAccessMask                 = vk::AccessFlags();
+        barrier.dstAccessMask                 = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        barrier.subresourceRange.baseMipLevel = 1;
+        barrier.subresourceRange.levelCount   = VK_REMAINING_MIP_LEVELS;
+        barriers.push_back(barrier);
+    }
+
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+        vk::DependencyFlags(), nullptr, counterBarrier, barriers);
+
+    cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline);
+    for (uint32_t i = 0; i < nbImages; ++i) {
+        const Image& image = images[i];
+
+        PushConstants constants = {};
+        constants.width      = image.size.width;
+        constants.height     = image.size.height;
+        constants.levelCount = image.mipLevels;
+        constants.srgb       = image.format == vk::Format::eR8G8B8A8Srgb ? 1 : 0;
+        constants.counter    = i;
+
+        const uint32_t groupsX = (image.size.width + 63) / 64;
+        const uint32_t groupsY = (image.size.height + 63) / 64;
+        constants.workGroups   = groupsX * groupsY;
+
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pipelineLayout, 0, sets[i], nullptr);
+        cmdBuffer.pushConstants<PushConstants>(m_pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, constants);
+        cmdBuffer.dispatch(groupsX, groupsY, 1);
+    }
+
+    // All levels to the shader read layout
+    std::vector<vk::ImageMemoryBarrier> readBarriers;
+    for (const auto& image : images) {
+        vk::ImageMemoryBarrier barrier = {};
+        barrier.image               = image.image;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.oldLayout           = vk::ImageLayout::eGeneral;
+        barrier.newLayout           = vk::ImageLayout::eShaderReadOnlyOptimal;
+        barrier.srcAccessMask       = vk::AccessFlagBits::eShaderWrite;
+        barrier.dstAccessMask       = vk::AccessFlagBits::eShaderRead;
+        barrier.subresourceRange    = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, 1);
+        readBarriers.push_back(barrier);
+    }
+
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eFragmentShader,
+        vk::DependencyFlags(), nullptr, nullptr, readBarriers);
+
+    return batch;
+}
+
+//-------------------------------------------------------------------------
+// Once the commands of the batch completed
+//
+void MipmapGenerator::destroy(Batch& batch)
+{
+    if (!batch.descriptorPool)
+        return;
+
+    for (auto& view : batch.views)
+        m_device.destroy(view);
+    m_device.destroy(batch.descriptorPool);
+    m_allocator->destroy(batch.counters);
+    batch = Batch();
+}
+
+} // namespace app
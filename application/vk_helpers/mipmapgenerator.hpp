@@ -0,0 +1,99 @@
+/*
+ *
+ * Andrew Frost
+ * mipmapgenerator.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "allocator.hpp"
+#include "descriptorsets.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// MipmapGenerator                                                       //
+///////////////////////////////////////////////////////////////////////////
+// Mip chains of RGBA8 images built by a compute shader (mipmaps.comp)   //
+// - One dispatch per image writes all its levels, up to 4096x4096       //
+// - All images of a call share two pipeline barriers, instead of one    //
+//   blit and barrier per level and image                                //
+// - sRGB images are filtered in linear space, they are written through  //
+//   UNORM views so must be created with 'prepareImageInfo'              //
+// - Recording is thread safe, the descriptors and views of each call    //
+//   are returned in a Batch to destroy once the commands completed      //
+///////////////////////////////////////////////////////////////////////////
+
+class MipmapGenerator
+{
+public:
+    static const uint32_t MAX_LEVELS = 13;
+
+    // Image with level 0 filled, in eTransferDstOptimal
+    struct Image
+    {
+        vk::Image    image;
+        vk::Format   format;
+        vk::Extent2D size;
+        uint32_t     mipLevels;
+    };
+
+    // Transient resources of a generation
+    struct Batch
+    {
+        vk::DescriptorPool         descriptorPool;
+        std::vector<vk::ImageView> views;
+        BufferVma                  counters;
+    };
+
+    MipmapGenerator(MipmapGenerator const&) = delete;
+    MipmapGenerator& operator=(MipmapGenerator const&) = delete;
+
+    MipmapGenerator() {}
+    ~MipmapGenerator() { deinit(); }
+
+    void init(vk::Device device, Allocator& allocator, const std::string& shaderFile);
+    void deinit();
+
+    bool isValid() const { return m_pipeline; }
+
+    //-------------------------------------------------------------------------
+    // RGBA8 images up to MAX_LEVELS, storage usage and UNORM views allowed
+    //
+    static bool supports(const vk::ImageCreateInfo& info);
+    static void prepareImageInfo(vk::ImageCreateInfo& info);
+
+    //-------------------------------------------------------------------------
+    // All levels of the images end in eShaderReadOnlyOptimal
+    //
+    Batch cmdGenerate(vk::CommandBuffer cmdBuffer, const std::vector<Image>& images);
+
+    void destroy(Batch& batch);
+
+private:
+    struct PushConstants
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t levelCount;
+        uint32_t srgb;
+        uint32_t counter;
+        uint32_t workGroups;
+    };
+
+    vk::Device              m_device;
+    Allocator*              m_allocator{ nullptr };
+    DescriptorSetBindings   m_bindings;
+    vk::DescriptorSetLayout m_descriptorSetLayout;
+    vk::PipelineLayout      m_pipelineLayout;
+    vk::Pipeline            m_pipeline;
+
+}; // class MipmapGenerator
+
+} // namespace app
@@ -0,0 +1,157 @@
+/*
+ *
+ * Andrew Frost
+ * uploadengine.cpp
+ * 2020
+ *
+ */
+
+#include "uploadengine.hpp"
+
+#include <assert.h>
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// UploadEngine                                                          //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void UploadEngine::init(vk::Device device, uint32_t transferFamily, vk::Queue transferQueue, uint32_t graphicsFamily)
+{
+    assert(!m_device);
+    m_device         = device;
+    m_queue          = transferQueue;
+    m_transferFamily = transferFamily;
+    m_graphicsFamily = graphicsFamily;
+
+    vk::SemaphoreTypeCreateInfoKHR typeInfo(vk::SemaphoreTypeKHR::eTimeline, 0);
+    vk::SemaphoreCreateInfo        createInfo = {};
+    createInfo.pNext = &typeInfo;
+
+    try {
+        m_semaphore = m_device.createSemaphore(createInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create upload timeline semaphore!");
+    }
+
+    m_submitted = m_completed = m_frameWait = 0;
+}
+
+//-------------------------------------------------------------------------
+// Waits for the batches in flight
+//
+void UploadEngine::deinit()
+{
+    if (!m_device)
+        return;
+
+    wait(m_submitted);
+    m_device.destroy(m_semaphore);
+    m_semaphore = nullptr;
+    m_device    = nullptr;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint64_t UploadEngine::submit(vk::CommandBuffer cmdBuffer, vk::Fence fence)
+{
+    cmdBuffer.end();
+
+    const uint64_t value = m_submitted + 1;
+
+    vk::TimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues    = &value;
+
+    vk::SubmitInfo submitInfo       = {};
+    submitInfo.pNext                = &timelineInfo;
+    submitInfo.commandBufferCount   = 1;
+    submitInfo.pCommandBuffers      = &cmdBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores    = &m_semaphore;
+
+    try {
+        m_queue.submit(submitInfo, fence);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to submit upload batch!");
+    }
+
+    m_submitted = value;
+    return value;
+}
+
+//-------------------------------------------------------------------------
+// The counter is only read when the value is not known to be reached
+//
+bool UploadEngine::isComplete(uint64_t value)
+{
+    if (value > m_completed)
+        m_completed = m_device.getSemaphoreCounterValueKHR(m_semaphore);
+    return value <= m_completed;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void UploadEngine::wait(uint64_t value)
+{
+    if (isComplete(value))
+        return;
+
+    vk::SemaphoreWaitInfoKHR waitInfo = {};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores    = &m_semaphore;
+    waitInfo.pValues        = &value;
+    while (m_device.waitSemaphoresKHR(waitInfo, 10000) == vk::Result::eTimeout) {}
+
+    m_completed = std::max(m_completed, value);
+}
+
+//-------------------------------------------------------------------------
+// The destination access is set by the acquire, a release ignores it
+//
+vk::ImageMemoryBarrier UploadEngine::releaseBarrier(vk::Image image, const vk::ImageSubresourceRange& range,
+                                                    vk::ImageLayout oldLayout, vk::ImageLayout newLayout) const
+{
+    vk::ImageMemoryBarrier barrier = {};
+    barrier.image               = image;
+    barrier.subresourceRange    = range;
+    barrier.oldLayout           = oldLayout;
+    barrier.newLayout           = newLayout;
+    barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+    barrier.srcQueueFamilyIndex = isDedicated() ? m_transferFamily : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = isDedicated() ? m_graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+    return barrier;
+}
+
+//-------------------------------------------------------------------------
+// The writes of the batch are made visible by the wait of the frame, the
+// source access is ignored for an acquire
+//
+vk::ImageMemoryBarrier UploadEngine::acquireBarrier(vk::Image image, const vk::ImageSubresourceRange& range,
+                                                    vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+                                                    vk::AccessFlags dstAccess) const
+{
+    vk::ImageMemoryBarrier barrier = releaseBarrier(image, range, oldLayout, newLayout);
+    barrier.srcAccessMask = vk::AccessFlags();
+    barrier.dstAccessMask = dstAccess;
+    return barrier;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint64_t UploadEngine::takeFrameWait()
+{
+    const uint64_t value = m_frameWait;
+    m_frameWait = 0;
+    return value;
+}
+
+} // namespace app
@@ -0,0 +1,88 @@
+/*
+ *
+ * Andrew Frost
+ * uploadengine.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vulkan/vulkan.hpp>
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// Upload Engine                                                         //
+///////////////////////////////////////////////////////////////////////////
+// Copies submitted on a transfer only queue, next to the rendering      //
+// - Each batch signals the next value of a timeline semaphore, polled   //
+//   by 'isComplete' instead of a fence per batch                        //
+// - Resources written by a batch are released to the graphics family,   //
+//   and acquired by a barrier recorded in a frame. The frame submitted  //
+//   next waits on the batch value (see 'VulkanBackend::submitFrame').   //
+// - Without a transfer only family, the batches are submitted on the    //
+//   graphics queue and the ownership barriers are plain barriers        //
+// - The copies are whole levels, valid for any image transfer           //
+//   granularity of the family                                           //
+// - Submissions from one thread, command buffers recorded anywhere      //
+//   from pools of 'getQueueFamily'                                      //
+///////////////////////////////////////////////////////////////////////////
+
+class UploadEngine
+{
+public:
+    UploadEngine() = default;
+    UploadEngine(UploadEngine const&) = delete;
+    UploadEngine& operator=(UploadEngine const&) = delete;
+
+    void init(vk::Device device, uint32_t transferFamily, vk::Queue transferQueue, uint32_t graphicsFamily);
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // Ends and submits the batch, the fence is for the staging memory of
+    // the batch. Returns the value signaled once complete.
+    //
+    uint64_t submit(vk::CommandBuffer cmdBuffer, vk::Fence fence = nullptr);
+
+    bool isComplete(uint64_t value);
+    void wait(uint64_t value);
+
+    //-------------------------------------------------------------------------
+    // Ownership of an image written by a batch, the release recorded at the
+    // end of the batch and the acquire in a frame, with the same layouts.
+    // The acquired image is only used after 'waitInFrame'.
+    //
+    vk::ImageMemoryBarrier releaseBarrier(vk::Image image, const vk::ImageSubresourceRange& range,
+                                          vk::ImageLayout oldLayout, vk::ImageLayout newLayout) const;
+    vk::ImageMemoryBarrier acquireBarrier(vk::Image image, const vk::ImageSubresourceRange& range,
+                                          vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+                                          vk::AccessFlags dstAccess) const;
+
+    //-------------------------------------------------------------------------
+    // The next frame submitted waits for the value, 'takeFrameWait' returns
+    // the largest one since the previous frame
+    //
+    void     waitInFrame(uint64_t value) { m_frameWait = std::max(m_frameWait, value); }
+    uint64_t takeFrameWait();
+
+    bool          isDedicated() const { return m_transferFamily != m_graphicsFamily; }
+    uint32_t      getQueueFamily() const { return m_transferFamily; }
+    vk::Queue     getQueue() const { return m_queue; }
+    vk::Semaphore getSemaphore() const { return m_semaphore; }
+
+private:
+    vk::Device    m_device;
+    vk::Queue     m_queue;
+    uint32_t      m_transferFamily{ VK_QUEUE_FAMILY_IGNORED };
+    uint32_t      m_graphicsFamily{ VK_QUEUE_FAMILY_IGNORED };
+
+    vk::Semaphore m_semaphore;        // Timeline
+    uint64_t      m_submitted{ 0 };   // Value of the last batch
+    uint64_t      m_completed{ 0 };   // Last value read
+    uint64_t      m_frameWait{ 0 };
+
+}; // class UploadEngine
+
+} // namespace app
@@ -0,0 +1,116 @@
+/*
+ *
+ * Andrew Frost
+ * uploadring.cpp
+ * 2020
+ *
+ */
+
+#include "uploadring.hpp"
+
+#include <algorithm>
+#include <assert.h>
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// UploadRing                                                            //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void UploadRing::init(vk::PhysicalDevice physicalDevice, VmaAllocator allocator, vk::DeviceSize frameSize,
+                      uint32_t frameCount)
+{
+    assert(!m_allocator);
+
+    const vk::PhysicalDeviceLimits limits = physicalDevice.getProperties().limits;
+    m_alignment = std::max({ vk::DeviceSize(16), limits.minUniformBufferOffsetAlignment,
+                             limits.minStorageBufferOffsetAlignment });
+    m_size      = (frameSize * frameCount + m_alignment - 1) / m_alignment * m_alignment;
+
+    VkBufferCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size  = m_size;
+    createInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                     | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage         = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    allocInfo.flags         = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    allocInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VkBuffer          buffer;
+    VmaAllocationInfo allocationInfo;
+    if (vmaCreateBuffer(allocator, &createInfo, &allocInfo, &buffer, &m_allocation, &allocationInfo) != VK_SUCCESS)
+        throw std::runtime_error("failed to create upload ring!");
+
+    m_allocator = allocator;
+    m_buffer    = buffer;
+    m_mapping   = static_cast<uint8_t*>(allocationInfo.pMappedData);
+
+    m_head = m_tail = 0;
+    m_frameEnds.assign(frameCount, 0);
+    m_frame = ~0u;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void UploadRing::deinit()
+{
+    if (!m_allocator)
+        return;
+
+    vmaDestroyBuffer(m_allocator, m_buffer, m_allocation);
+    m_allocator  = nullptr;
+    m_allocation = nullptr;
+    m_buffer     = nullptr;
+    m_mapping    = nullptr;
+    m_frameEnds.clear();
+}
+
+//-------------------------------------------------------------------------
+// The allocations up to the end of the previous use of the frame are
+// complete
+//
+void UploadRing::beginFrame(uint32_t frame)
+{
+    assert(frame < m_frameEnds.size());
+
+    if (m_frame != ~0u)
+        m_frameEnds[m_frame] = m_head;
+
+    m_tail  = std::max(m_tail, m_frameEnds[frame]);
+    m_frame = frame;
+}
+
+//-------------------------------------------------------------------------
+// An allocation never straddles the end of the buffer, the space left
+// there is skipped
+//
+UploadRing::Allocation UploadRing::allocate(vk::DeviceSize size)
+{
+    assert(m_frame != ~0u && "beginFrame not called");
+
+    const vk::DeviceSize alignedSize = (std::max(size, vk::DeviceSize(1)) + m_alignment - 1) / m_alignment * m_alignment;
+
+    vk::DeviceSize offset  = m_head % m_size;
+    vk::DeviceSize skipped = offset + alignedSize > m_size ? m_size - offset : 0;
+
+    if (m_head + skipped + alignedSize - m_tail > m_size)
+        throw std::runtime_error("failed to allocate from the upload ring, the frames in flight use all of it!");
+
+    m_head += skipped;
+    offset  = m_head % m_size;
+    m_head += alignedSize;
+
+    Allocation allocation;
+    allocation.data   = m_mapping + offset;
+    allocation.buffer = m_buffer;
+    allocation.offset = offset;
+    return allocation;
+}
+
+} // namespace app
@@ -0,0 +1,83 @@
+/*
+ *
+ * Andrew Frost
+ * uploadring.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "../external/vk_mem_alloc.h"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// Upload Ring                                                           //
+///////////////////////////////////////////////////////////////////////////
+// Persistently mapped buffer for the data written every frame           //
+// - Sized for the frames in flight, each frame allocates after the      //
+//   previous one and wraps around the end of the buffer                 //
+// - The space of a frame is reclaimed by 'beginFrame', once the fence   //
+//   of the frame has signaled. The frames are submitted to one queue,   //
+//   so the frames before it are also complete                           //
+// - Host coherent memory, mapped once: no allocation, map or flush      //
+//   after 'init'                                                        //
+///////////////////////////////////////////////////////////////////////////
+
+class UploadRing
+{
+public:
+    struct Allocation
+    {
+        void*          data{ nullptr };
+        vk::Buffer     buffer;
+        vk::DeviceSize offset{ 0 };
+    };
+
+    UploadRing() = default;
+    UploadRing(UploadRing const&) = delete;
+    UploadRing& operator=(UploadRing const&) = delete;
+
+    //-------------------------------------------------------------------------
+    // Room for 'frameSize' bytes per frame, the buffer can be bound as a
+    // uniform or storage buffer or copied from
+    //
+    void init(vk::PhysicalDevice physicalDevice, VmaAllocator allocator, vk::DeviceSize frameSize, uint32_t frameCount);
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // Index of the frame fence, called once it has signaled (see
+    // 'VulkanBackend::prepareFrame'), before the allocations of the frame
+    //
+    void beginFrame(uint32_t frame);
+
+    //-------------------------------------------------------------------------
+    // Space of the current frame, aligned for the uniform and storage buffer
+    // offsets. Throws when the frames in flight use all the ring.
+    //
+    Allocation allocate(vk::DeviceSize size);
+
+    vk::Buffer     getBuffer() const { return m_buffer; }
+    vk::DeviceSize getSize() const { return m_size; }
+    vk::DeviceSize getUsedSize() const { return m_head - m_tail; }
+
+private:
+    VmaAllocator          m_allocator{ nullptr };
+    VmaAllocation         m_allocation{ nullptr };
+    vk::Buffer            m_buffer;
+    uint8_t*              m_mapping{ nullptr };
+    vk::DeviceSize        m_size{ 0 };
+    vk::DeviceSize        m_alignment{ 256 };
+
+    uint64_t              m_head{ 0 };      // Positions since 'init', the space in use is [tail, head)
+    uint64_t              m_tail{ 0 };
+    std::vector<uint64_t> m_frameEnds;      // Head once the frame was done allocating, by fence index
+    uint32_t              m_frame{ ~0u };
+
+}; // class UploadRing
+
+} // namespace app
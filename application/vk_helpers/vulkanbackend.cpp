@@ -83,6 +83,8 @@ void VulkanBackend::destroy()
 
     m_device.destroyCommandPool(m_commandPool);
 
+    m_uploadEngine.deinit();
+
     m_device.destroy();
 
     if (m_debugMessenger)
@@ -163,6 +165,7 @@ void VulkanBackend::pickPhysicalDevice(const ContextCreateInfo& info)
     for (auto device : devices) {
         uint32_t graphicsIdx = -1;
         uint32_t presentIdx = -1;
+        uint32_t transferIdx = -1;
 
         auto queueFamilyProperties = device.getQueueFamilyProperties();
         auto deviceExtensionProperties = device.enumerateDeviceExtensionProperties();
@@ -187,6 +190,19 @@ void VulkanBackend::pickPhysicalDevice(const ContextCreateInfo& info)
             }
         }
 
+        // transfer only queue, the DMA engines of the discrete GPUs
+        for (uint32_t j = 0; j < queueFamilyProperties.size(); ++j) {
+            vk::QueueFamilyProperties& queueFamily = queueFamilyProperties[j];
+
+            if (queueFamily.queueCount == 0) continue;
+
+            if ((queueFamily.queueFlags & vk::QueueFlagBits::eTransfer)
+                && !(queueFamily.queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute))) {
+                transferIdx = j;
+                break;
+            }
+        }
+
         // present queue 
         for (uint32_t j = 0; j < queueFamilyProperties.size(); ++j) {
             vk::QueueFamilyProperties& queueFamily = queueFamilyProperties[j];
@@ -205,6 +221,7 @@ void VulkanBackend::pickPhysicalDevice(const ContextCreateInfo& info)
             m_physicalDevice = device;
             m_graphicsQueueIdx = graphicsIdx;
             m_presentQueueIdx = presentIdx;
+            m_transferQueueIdx = transferIdx != uint32_t(-1) ? transferIdx : graphicsIdx;
 
             m_vsync = false;
             m_depthFormat = vk::Format::eD32SfloatS8Uint;
@@ -239,7 +256,7 @@ void VulkanBackend::createLogicalDeviceAndQueues(const ContextCreateInfo& info)
     auto queueFamilyProperties = m_physicalDevice.getQueueFamilyProperties();
 
     std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = { m_graphicsQueueIdx,  m_presentQueueIdx };
+    std::set<uint32_t> uniqueQueueFamilies = { m_graphicsQueueIdx,  m_presentQueueIdx, m_transferQueueIdx };
 
     const float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -250,7 +267,10 @@ void VulkanBackend::createLogicalDeviceAndQueues(const ContextCreateInfo& info)
 
         queueCreateInfos.push_back(queueInfo);
     }
+    vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR  timelineFeature = {};
+
     vk::PhysicalDeviceDescriptorIndexingFeaturesEXT indexFeature = {};
+    indexFeature.pNext = &timelineFeature;
 
     vk::PhysicalDeviceScalarBlockLayoutFeaturesEXT  scalarFeature = {};
     scalarFeature.pNext = &indexFeature;
@@ -288,6 +308,9 @@ void VulkanBackend::createLogicalDeviceAndQueues(const ContextCreateInfo& info)
     // Initialize default queues
     m_graphicsQueue = m_device.getQueue(m_graphicsQueueIdx, 0);
     m_presentQueue = m_device.getQueue(m_presentQueueIdx, 0);
+    m_transferQueue = m_device.getQueue(m_transferQueueIdx, 0);
+
+    m_uploadEngine.init(m_device, m_transferQueueIdx, m_transferQueue, m_graphicsQueueIdx);
 
     // Initialize debugging tool for queue object names
 #if _DEBUG
@@ -296,6 +319,10 @@ void VulkanBackend::createLogicalDeviceAndQueues(const ContextCreateInfo& info)
 
     m_device.setDebugUtilsObjectNameEXT(
         { vk::ObjectType::eQueue, (uint64_t)(VkQueue)m_presentQueue, "presentQueue" });
+
+    if (m_transferQueue != m_graphicsQueue)
+        m_device.setDebugUtilsObjectNameEXT(
+            { vk::ObjectType::eQueue, (uint64_t)(VkQueue)m_transferQueue, "transferQueue" });
 #endif
 }
 
@@ -649,13 +676,25 @@ void VulkanBackend::submitFrame()
     vk::Semaphore semaphoreRead  = m_swapchain.getActiveReadSemaphore();
     vk::Semaphore semaphoreWrite = m_swapchain.getActiveWrittenSemaphore();
 
+    // Uploads acquired by the frame, the value is ignored for the binary semaphore
+    const uint64_t uploadValue = m_uploadEngine.takeFrameWait();
+
+    const std::array<vk::Semaphore, 2> waitSemaphores = { semaphoreRead, m_uploadEngine.getSemaphore() };
+    const std::array<uint64_t, 2>      waitValues     = { 0, uploadValue };
+
     // Pipeline stage at which the queue submission will wait (via pWaitSemaphores)
-    const vk::PipelineStageFlags waitStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+    const std::array<vk::PipelineStageFlags, 2> waitStageMasks = { vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                                                                   vk::PipelineStageFlagBits::eAllCommands };
+
+    vk::TimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+    timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues    = waitValues.data();
 
     vk::SubmitInfo submitInfo = {};
-    submitInfo.waitSemaphoreCount   = 1;                              // One wait semaphore
-    submitInfo.pWaitSemaphores      = &semaphoreRead;                 // Semaphore(s) to wait upon before the submitted command buffer starts executing
-    submitInfo.pWaitDstStageMask    = &waitStageMask;                 // Pointer to the list of pipeline stages that the semaphore waits will occur at
+    submitInfo.pNext                = uploadValue ? &timelineInfo : nullptr;
+    submitInfo.waitSemaphoreCount   = uploadValue ? 2 : 1;            // Swapchain image, and the uploads when any
+    submitInfo.pWaitSemaphores      = waitSemaphores.data();          // Semaphore(s) to wait upon before the submitted command buffer starts executing
+    submitInfo.pWaitDstStageMask    = waitStageMasks.data();          // Pointer to the list of pipeline stages that the semaphore waits will occur at
     submitInfo.commandBufferCount   = 1;                              // One Command Buffer
     submitInfo.pCommandBuffers      = &m_commandBuffers[imageIndex];  // Command buffers(s) to execute in this batch (submission)
     submitInfo.signalSemaphoreCount = 1;                              // One signal Semaphore
@@ -27,6 +27,7 @@
 
 #include "swapchain.hpp"
 #include "commands.hpp"
+#include "uploadengine.hpp"
 #include "../general_helpers/manipulator.h"
 #include "../general_helpers/cameraintertia.hpp"
 
@@ -110,7 +111,7 @@ public:
 
     void createSyncObjects();
     
-    void prepareFrame();
+    virtual void prepareFrame();
 
     void submitFrame();
 
@@ -177,6 +178,9 @@ public:
     uint32_t                              getGraphicsQueueIdx()   { return m_graphicsQueueIdx; }
     vk::Queue                             getPresentQueue()       { return m_presentQueue; }
     uint32_t                              getPresentQueueIdx()    { return m_presentQueueIdx; }
+    vk::Queue                             getTransferQueue()      { return m_transferQueue; }
+    uint32_t                              getTransferQueueIdx()   { return m_transferQueueIdx; }
+    app::UploadEngine&                    getUploadEngine()       { return m_uploadEngine; }
     vk::Extent2D                          getSize()               { return m_size; }
     vk::RenderPass                        getRenderPass()         { return m_renderPass; }
     vk::PipelineCache                     getPipelineCache()      { return m_pipelineCache; }
@@ -196,8 +200,12 @@ protected:
 
     vk::Queue                      m_graphicsQueue;
     vk::Queue                      m_presentQueue;
+    vk::Queue                      m_transferQueue;     // Transfer only when the device has one, graphics otherwise
     uint32_t                       m_graphicsQueueIdx{ VK_QUEUE_FAMILY_IGNORED };
     uint32_t                       m_presentQueueIdx{ VK_QUEUE_FAMILY_IGNORED };
+    uint32_t                       m_transferQueueIdx{ VK_QUEUE_FAMILY_IGNORED };
+
+    app::UploadEngine              m_uploadEngine;      // Batches on the transfer queue, waited on by the frames
 
     vk::CommandPool                m_commandPool;
 